@@ -0,0 +1,420 @@
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/bio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <linux/filter.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#if OPENSSL_VERSION_NUMBER >= 0x30200000L && !defined(OPENSSL_NO_QUIC)
+#include <openssl/quic.h>
+#define NF_QUIC_CLIENT 1
+#else
+#define NF_QUIC_CLIENT 0
+#endif
+
+/*
+ * LOGIN_REQ -> LOGIN_RES latency over TLS/TCP and QUIC against a running nf-server.
+ *
+ *   LossBench [--loss PCT] [--conns K] [--rounds R] [--host ADDR]
+ *             [--tcp-port 8000] [--quic-port 8002] [--proto tls|quic|both]
+ *
+ * Every round logs in K times at once: over K fresh TLS connections, and over K
+ * fresh streams on one QUIC connection. Handshakes are outside the timing; a
+ * sample runs from the send to the full reply frame.
+ *
+ * --loss drops that share of the packets the client receives, with a cBPF
+ * socket filter (SKF_AD_RANDOM), so it needs no privileges. Only the
+ * server -> client direction is lossy; for both directions use
+ * `tc qdisc add dev lo root netem loss PCT%` and leave --loss at 0.
+ */
+
+#define BENCH_HEADER_SIZE (16)
+#define BENCH_ROUND_TIMEOUT_MS (60 * 1000)
+
+using Clock = std::chrono::steady_clock;
+
+static const unsigned char s_alpn[] = {2, 'n', 'f'};
+
+struct Options {
+    double lossPct{0};
+    int conns{8};
+    int rounds{50};
+    std::string host{"127.0.0.1"};
+    int tcpPort{8000};
+    int quicPort{8002};
+    std::string proto{"both"};
+};
+
+/* one login in flight: the reply is complete once BENCH_HEADER_SIZE + bodyLen bytes are in */
+struct Sample {
+    Clock::time_point sent;
+    std::vector<uint8_t> rx;
+    bool done{false};
+    double ms{0};
+};
+
+static std::vector<uint8_t> buildLoginReq() {
+    const char *id = "test";
+    const char *pw = "test";
+    const uint16_t bodyLen = (uint16_t)(2 + std::strlen(id) + 2 + std::strlen(pw));
+
+    std::vector<uint8_t> pkt(BENCH_HEADER_SIZE + bodyLen, 0);
+    pkt[0] = 0x01;
+    pkt[1] = 0x10;
+    pkt[2] = bodyLen >> 8;
+    pkt[3] = bodyLen & 0xFF;
+
+    size_t off = BENCH_HEADER_SIZE;
+    for (const char *s : {id, pw}) {
+        const uint16_t len = (uint16_t)std::strlen(s);
+        pkt[off++] = len >> 8;
+        pkt[off++] = len & 0xFF;
+        std::memcpy(pkt.data() + off, s, len);
+        off += len;
+    }
+    return pkt;
+}
+
+static bool frameComplete(const std::vector<uint8_t> &rx) {
+    if (rx.size() < BENCH_HEADER_SIZE)
+        return false;
+    const size_t bodyLen = ((size_t)rx[2] << 8) | rx[3];
+    return rx.size() >= BENCH_HEADER_SIZE + bodyLen;
+}
+
+static void finish(Sample &s) {
+    s.done = true;
+    s.ms = std::chrono::duration<double, std::milli>(Clock::now() - s.sent).count();
+}
+
+/* the request never left; counted as lost */
+static void fail(Sample &s) {
+    s.done = true;
+    s.ms = -1;
+}
+
+static size_t countPending(const std::vector<Sample> &samples) {
+    size_t n = 0;
+    for (const auto &s : samples)
+        n += s.done ? 0 : 1;
+    return n;
+}
+
+static bool attachLossFilter(int fd, double lossPct) {
+    if (lossPct <= 0)
+        return true;
+
+    /* keep the packet when a random u32 is at or above the threshold */
+    const uint32_t threshold = (uint32_t)std::min(4294967295.0, lossPct / 100.0 * 4294967296.0);
+    sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t)(SKF_AD_OFF + SKF_AD_RANDOM)),
+        BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, threshold, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    sock_fprog prog{(unsigned short)(sizeof(code) / sizeof(code[0])), code};
+    return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) == 0;
+}
+
+static sockaddr_in makeAddr(const std::string &host, int port) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+    return addr;
+}
+
+static void report(const char *proto, const Options &opt, std::vector<double> &ms, int lost, double wallSec) {
+    std::sort(ms.begin(), ms.end());
+    auto pct = [&ms](double p) {
+        if (ms.empty()) return 0.0;
+        return ms[std::min(ms.size() - 1, (size_t)(p * (double)ms.size()))];
+    };
+    std::printf("%-5s loss=%.1f%% samples=%zu lost=%d p50=%.3f ms p99=%.3f ms max=%.3f ms wall=%.2f s\n",
+                proto, opt.lossPct, ms.size(), lost, pct(0.50), pct(0.99),
+                ms.empty() ? 0.0 : ms.back(), wallSec);
+}
+
+/* ---- TLS over TCP ---- */
+
+struct TlsConn {
+    int fd{-1};
+    SSL *ssl{nullptr};
+};
+
+static bool tlsConnect(SSL_CTX *ctx, const Options &opt, TlsConn &c) {
+    c.fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (c.fd < 0 || !attachLossFilter(c.fd, opt.lossPct))
+        return false;
+
+    int one = 1;
+    setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    sockaddr_in addr = makeAddr(opt.host, opt.tcpPort);
+    if (connect(c.fd, (sockaddr *) &addr, sizeof(addr)) != 0)
+        return false;
+
+    c.ssl = SSL_new(ctx);
+    if (!c.ssl || SSL_set_fd(c.ssl, c.fd) != 1 || SSL_connect(c.ssl) != 1)
+        return false;
+
+    return fcntl(c.fd, F_SETFL, fcntl(c.fd, F_GETFL, 0) | O_NONBLOCK) == 0;
+}
+
+static void tlsClose(TlsConn &c) {
+    if (c.ssl) {
+        SSL_shutdown(c.ssl);
+        SSL_free(c.ssl);
+    }
+    if (c.fd >= 0)
+        close(c.fd);
+    c = TlsConn{};
+}
+
+static bool runTls(const Options &opt) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    if (!ctx)
+        return false;
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+
+    const std::vector<uint8_t> req = buildLoginReq();
+    std::vector<double> ms;
+    int lost = 0;
+    const auto start = Clock::now();
+
+    for (int round = 0; round < opt.rounds; ++round) {
+        std::vector<TlsConn> conns((size_t)opt.conns);
+        for (auto &c : conns) {
+            if (!tlsConnect(ctx, opt, c)) {
+                std::fprintf(stderr, "tls: connect failed errno=%d\n", errno);
+                SSL_CTX_free(ctx);
+                return false;
+            }
+        }
+
+        std::vector<Sample> samples((size_t)opt.conns);
+        for (size_t i = 0; i < conns.size(); ++i) {
+            samples[i].sent = Clock::now();
+            if (SSL_write(conns[i].ssl, req.data(), (int)req.size()) <= 0)
+                fail(samples[i]);
+        }
+
+        const auto deadline = Clock::now() + std::chrono::milliseconds(BENCH_ROUND_TIMEOUT_MS);
+        size_t pending = countPending(samples);
+        while (pending > 0 && Clock::now() < deadline) {
+            std::vector<pollfd> pfds;
+            std::vector<size_t> idx;
+            for (size_t i = 0; i < conns.size(); ++i) {
+                if (samples[i].done)
+                    continue;
+                pfds.push_back(pollfd{conns[i].fd, POLLIN, 0});
+                idx.push_back(i);
+            }
+            poll(pfds.data(), pfds.size(), 10);
+
+            for (size_t k = 0; k < pfds.size(); ++k) {
+                const size_t i = idx[k];
+                uint8_t buf[1024];
+                int n;
+                while ((n = SSL_read(conns[i].ssl, buf, sizeof(buf))) > 0)
+                    samples[i].rx.insert(samples[i].rx.end(), buf, buf + n);
+                if (frameComplete(samples[i].rx)) {
+                    finish(samples[i]);
+                    pending--;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < conns.size(); ++i) {
+            if (samples[i].done && samples[i].ms >= 0)
+                ms.push_back(samples[i].ms);
+            else
+                lost++;
+            tlsClose(conns[i]);
+        }
+    }
+
+    report("tls", opt, ms, lost, std::chrono::duration<double>(Clock::now() - start).count());
+    SSL_CTX_free(ctx);
+    return true;
+}
+
+/* ---- QUIC ---- */
+
+#if NF_QUIC_CLIENT
+static SSL *quicConnect(SSL_CTX *ctx, const Options &opt) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return nullptr;
+    if (!attachLossFilter(fd, opt.lossPct) || !BIO_socket_nbio(fd, 1)) {
+        close(fd);
+        return nullptr;
+    }
+
+    sockaddr_in addr = makeAddr(opt.host, opt.quicPort);
+    if (connect(fd, (sockaddr *) &addr, sizeof(addr)) != 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    BIO *bio = BIO_new_dgram(fd, BIO_CLOSE);
+    SSL *ssl = SSL_new(ctx);
+    BIO_ADDR *peer = BIO_ADDR_new();
+    bool ok = bio && ssl && peer &&
+              BIO_ADDR_rawmake(peer, AF_INET, &addr.sin_addr, sizeof(addr.sin_addr), addr.sin_port);
+    if (ok) {
+        SSL_set_bio(ssl, bio, bio);
+        bio = nullptr;
+        ok = SSL_set_alpn_protos(ssl, s_alpn, sizeof(s_alpn)) == 0 &&
+             SSL_set1_initial_peer_addr(ssl, peer) &&
+             SSL_set_default_stream_mode(ssl, SSL_DEFAULT_STREAM_MODE_NONE) &&
+             SSL_connect(ssl) == 1 &&
+             SSL_set_blocking_mode(ssl, 0);
+    }
+
+    BIO_ADDR_free(peer);
+    if (bio)
+        BIO_free(bio);
+    if (!ok) {
+        ERR_print_errors_fp(stderr);
+        SSL_free(ssl);
+        return nullptr;
+    }
+    return ssl;
+}
+
+/* sleeps on the socket until OpenSSL has work, at most 10 ms */
+static void quicWait(SSL *conn) {
+    timeval tv{};
+    int infinite = 0;
+    int ms = 10;
+    if (SSL_get_event_timeout(conn, &tv, &infinite) && !infinite)
+        ms = std::min(ms, (int)(tv.tv_sec * 1000 + tv.tv_usec / 1000));
+
+    pollfd pfd{SSL_get_fd(conn), POLLIN, 0};
+    poll(&pfd, 1, ms);
+}
+
+static bool runQuic(const Options &opt) {
+    SSL_CTX *ctx = SSL_CTX_new(OSSL_QUIC_client_method());
+    if (!ctx)
+        return false;
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+
+    SSL *conn = quicConnect(ctx, opt);
+    if (!conn) {
+        std::fprintf(stderr, "quic: connect failed\n");
+        SSL_CTX_free(ctx);
+        return false;
+    }
+
+    const std::vector<uint8_t> req = buildLoginReq();
+    std::vector<double> ms;
+    int lost = 0;
+    const auto start = Clock::now();
+
+    for (int round = 0; round < opt.rounds; ++round) {
+        std::vector<SSL *> streams((size_t)opt.conns, nullptr);
+        std::vector<Sample> samples((size_t)opt.conns);
+
+        /* a stream costs no round trip, so it is opened inside the timing */
+        for (size_t i = 0; i < streams.size(); ++i) {
+            samples[i].sent = Clock::now();
+            streams[i] = SSL_new_stream(conn, 0);
+            size_t written = 0;
+            if (!streams[i] || !SSL_write_ex(streams[i], req.data(), req.size(), &written))
+                fail(samples[i]);
+        }
+
+        const auto deadline = Clock::now() + std::chrono::milliseconds(BENCH_ROUND_TIMEOUT_MS);
+        size_t pending = countPending(samples);
+
+        while (pending > 0 && Clock::now() < deadline) {
+            SSL_handle_events(conn);
+
+            bool progress = false;
+            for (size_t i = 0; i < streams.size(); ++i) {
+                if (samples[i].done)
+                    continue;
+                uint8_t buf[1024];
+                size_t n = 0;
+                while (SSL_read_ex(streams[i], buf, sizeof(buf), &n)) {
+                    samples[i].rx.insert(samples[i].rx.end(), buf, buf + n);
+                    progress = true;
+                }
+                if (frameComplete(samples[i].rx)) {
+                    finish(samples[i]);
+                    pending--;
+                }
+            }
+            ERR_clear_error();
+
+            if (!progress && pending > 0)
+                quicWait(conn);
+        }
+
+        for (size_t i = 0; i < streams.size(); ++i) {
+            if (samples[i].done && samples[i].ms >= 0)
+                ms.push_back(samples[i].ms);
+            else
+                lost++;
+            if (streams[i]) {
+                SSL_stream_conclude(streams[i], 0);
+                SSL_free(streams[i]);
+            }
+        }
+    }
+
+    report("quic", opt, ms, lost, std::chrono::duration<double>(Clock::now() - start).count());
+    SSL_shutdown(conn);
+    SSL_free(conn);
+    SSL_CTX_free(ctx);
+    return true;
+}
+#else
+static bool runQuic(const Options &) {
+    std::fprintf(stderr, "quic: needs OpenSSL >= 3.2 with QUIC\n");
+    return false;
+}
+#endif
+
+int main(int argc, char **argv) {
+    Options opt;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string key = argv[i];
+        const char *val = argv[i + 1];
+        if (key == "--loss") opt.lossPct = std::atof(val);
+        else if (key == "--conns") opt.conns = std::max(1, std::atoi(val));
+        else if (key == "--rounds") opt.rounds = std::max(1, std::atoi(val));
+        else if (key == "--host") opt.host = val;
+        else if (key == "--tcp-port") opt.tcpPort = std::atoi(val);
+        else if (key == "--quic-port") opt.quicPort = std::atoi(val);
+        else if (key == "--proto") opt.proto = val;
+        else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    bool ok = true;
+    if (opt.proto == "tls" || opt.proto == "both")
+        ok = runTls(opt) && ok;
+    if (opt.proto == "quic" || opt.proto == "both")
+        ok = runQuic(opt) && ok;
+    return ok ? 0 : 1;
+}
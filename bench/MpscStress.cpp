@@ -0,0 +1,43 @@
+#include "TxQueueModel.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#define STRESS_ITEMS (4000ULL)   // per producer and round
+
+/*
+ * Stress check for util/MpscQueue.h and the util/TxHandoff.h hand-off the servers share.
+ *
+ * Short bursts with a yield in between keep the reactor draining while
+ * producers push, which is where a lost wakeup strands packets; random yields
+ * inside the hand-off interleave its steps even on one core (a missing fence
+ * only shows on several). Exits non-zero
+ * if a round loses, duplicates or reorders an item, or stalls.
+ *
+ *   MpscStress [rounds]
+ */
+int main(int argc, char **argv) {
+    const int rounds = argc > 1 ? std::atoi(argv[1]) : 10;
+    const int producerCounts[] = {2, 4, 8, 16};
+    const int connCounts[] = {1, 4};
+
+    int failed = 0;
+    for (int round = 0; round < rounds; ++round) {
+        for (int producers : producerCounts) {
+            for (int conns : connCounts) {
+                MpscTx model(conns);
+                model.setJitter(true);
+                TxRunResult res = runTx(model, producers, STRESS_ITEMS, conns, 1 + (uint64_t)(round % 8), 2000);
+                if (!res.ok) {
+                    std::printf("FAIL round=%d producers=%d conns=%d delivered=%llu/%llu\n",
+                                round, producers, conns, (unsigned long long)res.delivered,
+                                (unsigned long long)producers * STRESS_ITEMS);
+                    failed++;
+                }
+            }
+        }
+    }
+
+    std::printf("MpscStress: %d rounds, %d failed\n", rounds, failed);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,293 @@
+#pragma once
+
+#include "util/MpscQueue.h"
+#include "util/TxHandoff.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/*
+ * The shard -> reactor tx hand-off of TcpServer/TlsServer, without sockets.
+ *
+ *  MpscTx  : per-connection MpscQueue linked on a util/TxHandoff ready list, one
+ *            eventfd write per drain; the servers' enqueueTx/flushAllPending steps
+ *  MutexTx : one map of deques under a mutex, an eventfd write per packet
+ *
+ * Producers call enqueue() from any thread; one consumer thread calls wait()
+ * and drain().
+ */
+
+struct BenchItem : MpscNode {
+    uint32_t producer{0};
+    uint64_t seq{0};
+};
+
+class TxModel {
+public:
+    TxModel() : m_eventFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+
+    virtual ~TxModel() {
+        if (m_eventFd >= 0) close(m_eventFd);
+    }
+
+    virtual void enqueue(int conn, BenchItem *item) = 0;
+
+    /* hands every item it can reach to fn; returns how many */
+    template <typename Fn>
+    size_t drain(Fn &&fn) {
+        std::vector<BenchItem *> out;
+        collect(out);
+        for (BenchItem *item : out)
+            fn(*item);
+        return out.size();
+    }
+
+    /* false on timeout */
+    bool wait(int timeoutMs) {
+        pollfd pfd{m_eventFd, POLLIN, 0};
+        if (poll(&pfd, 1, timeoutMs) <= 0)
+            return false;
+        uint64_t v;
+        while (read(m_eventFd, &v, sizeof(v)) > 0) {}
+        return true;
+    }
+
+    uint64_t kicks() const { return m_kicks.load(std::memory_order_relaxed); }
+
+    /* yield at random between the steps of the hand-off, so a one-core box still interleaves them */
+    void setJitter(bool on) { m_jitter = on; }
+
+protected:
+    void window() const {
+        static thread_local uint32_t x = 2463534242u ^ (uint32_t)(uintptr_t)&x;
+        if (!m_jitter)
+            return;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        if ((x & 7) == 0)
+            std::this_thread::yield();
+    }
+
+    virtual void collect(std::vector<BenchItem *> &out) = 0;
+
+    void kickFd() {
+        uint64_t v = 1;
+        write(m_eventFd, &v, sizeof(v));
+        m_kicks.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    int m_eventFd;
+    std::atomic<uint64_t> m_kicks{0};
+    bool m_jitter{false};
+};
+
+class MpscTx final : public TxModel {
+public:
+    explicit MpscTx(int connCount) : m_conns(connCount) {
+        for (auto &c : m_conns)
+            c = std::make_unique<Conn>();
+    }
+
+    void enqueue(int conn, BenchItem *item) override {
+        Conn &c = *m_conns[(size_t)conn];
+        c.txQueue.push(item);
+        window();
+
+        if (!TxHandoff<Conn>::claim(c))
+            return;
+        window();
+        m_txReady.link(c);
+        window();
+
+        if (m_txReady.kick())
+            kickFd();
+    }
+
+protected:
+    void collect(std::vector<BenchItem *> &out) override {
+        m_txReady.beginDrain();
+        window();
+
+        while (Conn *c = m_txReady.pop()) {
+            window();
+            while (BenchItem *item = c->txQueue.pop()) {
+                out.push_back(item);
+                window();
+            }
+        }
+    }
+
+private:
+    struct Conn : MpscNode {
+        MpscQueue<BenchItem> txQueue;
+        std::atomic<bool> txScheduled{false};
+    };
+
+    std::vector<std::unique_ptr<Conn>> m_conns;
+    TxHandoff<Conn> m_txReady;
+};
+
+class MutexTx final : public TxModel {
+public:
+    void enqueue(int conn, BenchItem *item) override {
+        {
+            std::lock_guard<std::mutex> lock(m_txLock);
+            m_txQueue[conn].push_back(item);
+        }
+        kickFd();
+    }
+
+protected:
+    /* as the old flushAllPending: list the busy fds, then one lock per packet */
+    void collect(std::vector<BenchItem *> &out) override {
+        std::vector<int> conns;
+        {
+            std::lock_guard<std::mutex> lock(m_txLock);
+            for (auto &kv : m_txQueue)
+                if (!kv.second.empty())
+                    conns.push_back(kv.first);
+        }
+
+        for (int conn : conns) {
+            while (true) {
+                std::lock_guard<std::mutex> lock(m_txLock);
+                auto &q = m_txQueue[conn];
+                if (q.empty())
+                    break;
+                out.push_back(q.front());
+                q.pop_front();
+            }
+        }
+    }
+
+private:
+    std::mutex m_txLock;
+    std::unordered_map<int, std::deque<BenchItem *>> m_txQueue;
+};
+
+struct TxRunResult {
+    bool ok{false};          // everything arrived, in per-producer order
+    uint64_t delivered{0};
+    double enqueueSec{0};    // until the last producer returned
+    double totalSec{0};      // until the consumer had everything
+    uint64_t kicks{0};
+};
+
+/*
+ * producers threads push itemsPerProducer items each, spread round robin over
+ * connCount connections. The calling thread is the reactor.
+ *
+ * With burst > 0 a producer waits after every burst until the reactor has all
+ * of its items, so each burst ends on a "last packet" that nothing later would
+ * flush out. A wait that times out with items missing means a wakeup was lost.
+ */
+inline TxRunResult runTx(TxModel &model, int producers, uint64_t itemsPerProducer, int connCount,
+                         uint64_t burst, int stallTimeoutMs) {
+    using Clock = std::chrono::steady_clock;
+
+    /* MpscNode is not movable, so each producer's items live in one fixed array */
+    std::vector<std::unique_ptr<BenchItem[]>> items((size_t)producers);
+    for (int p = 0; p < producers; ++p) {
+        items[(size_t)p].reset(new BenchItem[itemsPerProducer]);
+        for (uint64_t i = 0; i < itemsPerProducer; ++i) {
+            items[(size_t)p][i].producer = (uint32_t)p;
+            items[(size_t)p][i].seq = i;
+        }
+    }
+
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    std::atomic<int> done{0};
+    std::atomic<bool> stalled{false};
+    std::unique_ptr<std::atomic<uint64_t>[]> got(new std::atomic<uint64_t>[(size_t)producers]);
+    for (int p = 0; p < producers; ++p)
+        got[(size_t)p].store(0);
+    std::vector<std::thread> threads;
+
+    const auto start = Clock::now();
+    Clock::time_point enqueueEnd = start;
+
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p]() {
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+
+            BenchItem *mine = items[(size_t)p].get();
+            for (uint64_t i = 0; i < itemsPerProducer && !stalled.load(std::memory_order_relaxed); ++i) {
+                model.enqueue((int)((i + (uint64_t)p) % (uint64_t)connCount), &mine[i]);
+                if (burst == 0 || ((i + 1) % burst != 0 && i + 1 != itemsPerProducer))
+                    continue;
+
+                const auto deadline = Clock::now() + std::chrono::milliseconds(stallTimeoutMs);
+                while (got[(size_t)p].load(std::memory_order_acquire) < i + 1) {
+                    if (Clock::now() > deadline) {
+                        stalled.store(true, std::memory_order_relaxed);
+                        break;
+                    }
+                    std::this_thread::yield();
+                }
+            }
+            done.fetch_add(1, std::memory_order_release);
+        });
+    }
+
+    while (ready.load() < producers)
+        std::this_thread::yield();
+    const auto goTime = Clock::now();
+    go.store(true, std::memory_order_release);
+
+    TxRunResult res;
+    const uint64_t total = (uint64_t)producers * itemsPerProducer;
+    std::vector<uint64_t> next((size_t)producers * (size_t)connCount, 0);
+    bool ordered = true;
+    bool enqueueDone = false;
+
+    auto take = [&](BenchItem &item) {
+        /* a producer's items for one connection come out in push order */
+        const int conn = (int)((item.seq + item.producer) % (uint64_t)connCount);
+        uint64_t &expect = next[(size_t)item.producer * (size_t)connCount + (size_t)conn];
+        if (item.seq < expect)
+            ordered = false;
+        expect = item.seq + 1;
+        res.delivered++;
+        got[item.producer].fetch_add(1, std::memory_order_release);
+    };
+
+    while (res.delivered < total) {
+        if (!model.wait(stallTimeoutMs)) {
+            if (done.load(std::memory_order_acquire) == producers)
+                break;
+            continue;
+        }
+        model.drain(take);
+
+        if (!enqueueDone && done.load(std::memory_order_acquire) == producers) {
+            enqueueDone = true;
+            enqueueEnd = Clock::now();
+        }
+    }
+
+    for (auto &t : threads)
+        t.join();
+    if (!enqueueDone)
+        enqueueEnd = Clock::now();
+
+    res.ok = ordered && !stalled.load() && res.delivered == total;
+    res.enqueueSec = std::chrono::duration<double>(enqueueEnd - goTime).count();
+    res.totalSec = std::chrono::duration<double>(Clock::now() - goTime).count();
+    res.kicks = model.kicks();
+    return res;
+}
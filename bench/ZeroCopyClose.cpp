@@ -0,0 +1,205 @@
+#include "protocol/tcp/ZeroCopy.h"
+#include "packet/Packet.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define ZC_PACKET_SIZE  (64 * 1024)
+#define ZC_MAX_PACKETS  (64)
+#define ZC_SKIP         (77)        // ctest SKIP_RETURN_CODE: no MSG_ZEROCOPY here
+
+/*
+ * Close with zero-copy sends in flight.
+ *
+ * The peer does not read, so part of what the sender queued with MSG_ZEROCOPY is
+ * still pinned in its write queue when the connection is closed and handed to a
+ * ZeroCopyGraveyard. The heap is then churned with poison-filled buffers of the
+ * packet size: if a pending packet had been freed, its pages would be reused and
+ * the peer would read poison. The peer then reads everything and must see the
+ * original bytes followed by EOF, and the graveyard must close the fd on its own.
+ * A second pass leaves the peer silent until the deadline and expects a reset.
+ */
+
+static uint64_t nowMs() {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint8_t patternAt(size_t off) {
+    return (uint8_t) (off * 7 + off / ZC_PACKET_SIZE);
+}
+
+static bool connectPair(int &sender, int &peer) {
+    int lfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (lfd < 0 || bind(lfd, (sockaddr *) &addr, sizeof(addr)) != 0 || listen(lfd, 1) != 0 ||
+        getsockname(lfd, (sockaddr *) &addr, &len) != 0)
+        return false;
+
+    peer = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int small = 4096;
+    setsockopt(peer, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    timeval tv{2, 0};
+    setsockopt(peer, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (connect(peer, (sockaddr *) &addr, sizeof(addr)) != 0)
+        return false;
+
+    sender = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    close(lfd);
+    return sender >= 0;
+}
+
+/* queues MSG_ZEROCOPY sends until the socket pushes back; returns the bytes the kernel took */
+static size_t fill(int fd, ZeroCopyState &zc) {
+    size_t sent = 0;
+    for (int i = 0; i < ZC_MAX_PACKETS; ++i) {
+        std::vector<uint8_t> payload(ZC_PACKET_SIZE);
+        for (size_t k = 0; k < payload.size(); ++k)
+            payload[k] = patternAt(sent + k);
+
+        auto pkt = std::make_unique<Packet>(fd, Protocol::TCP, std::move(payload), sockaddr_in{}, sockaddr_in{});
+        ssize_t n = send(fd, pkt->getPayload().data(), ZC_PACKET_SIZE, MSG_NOSIGNAL | MSG_ZEROCOPY);
+        if (n <= 0)
+            break;
+
+        sent += (size_t) n;
+        zc.pending.emplace_back(zc.nextId++, std::move(pkt));
+        if (n < ZC_PACKET_SIZE)
+            break;
+    }
+    return sent;
+}
+
+/* freed packet buffers would be handed out again here */
+static void churn(std::vector<std::vector<uint8_t>> &poison) {
+    for (int i = 0; i < ZC_MAX_PACKETS; ++i)
+        poison.emplace_back(ZC_PACKET_SIZE, 0xEE);
+}
+
+static bool checkDrainAndClose() {
+    int sender = -1, peer = -1;
+    if (!connectPair(sender, peer))
+        return false;
+
+    int on = 1;
+    if (setsockopt(sender, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) != 0)
+        exit(ZC_SKIP);
+
+    auto zc = std::make_unique<ZeroCopyState>();
+    const size_t sent = fill(sender, *zc);
+    zc->drain(sender);
+    if (zc->pending.empty()) {
+        std::printf("ZeroCopyClose: nothing left in flight after %zu bytes\n", sent);
+        exit(ZC_SKIP);
+    }
+    const size_t inFlight = zc->pending.size();
+
+    ZeroCopyGraveyard graves;
+    ZeroCopyCounts counts = graves.park(sender, std::move(zc), nowMs() + 10 * 1000);
+    if (graves.size() != 1 || counts.closed != 0) {
+        std::printf("FAIL drain: parked connection was closed with %zu packets in flight\n", inFlight);
+        return false;
+    }
+
+    std::vector<std::vector<uint8_t>> poison;
+    churn(poison);
+
+    size_t got = 0;
+    bool eof = false;
+    std::vector<uint8_t> buf(16 * 1024);
+    const uint64_t deadline = nowMs() + 5000;
+    while (nowMs() < deadline && (!eof || !graves.empty())) {
+        if (!eof) {
+            ssize_t n = recv(peer, buf.data(), buf.size(), 0);
+            if (n < 0) {
+                std::printf("FAIL drain: peer recv errno=%d after %zu/%zu bytes\n", errno, got, sent);
+                return false;
+            }
+            for (ssize_t k = 0; k < n; ++k, ++got) {
+                if (buf[(size_t) k] != patternAt(got)) {
+                    std::printf("FAIL drain: byte %zu is 0x%02x, expected 0x%02x\n",
+                                got, buf[(size_t) k], patternAt(got));
+                    return false;
+                }
+            }
+            eof = (n == 0);
+        } else {
+            poll(nullptr, 0, 10);
+        }
+
+        const ZeroCopyCounts c = graves.reap(nowMs());
+        counts.closed += c.closed;
+        counts.aborted += c.aborted;
+        churn(poison);
+        if (poison.size() > 16 * ZC_MAX_PACKETS)
+            poison.clear();
+    }
+    close(peer);
+
+    if (got != sent || !graves.empty() || counts.closed != 1 || counts.aborted != 0) {
+        std::printf("FAIL drain: got=%zu/%zu parked=%zu closed=%llu aborted=%llu\n", got, sent, graves.size(),
+                    (unsigned long long) counts.closed, (unsigned long long) counts.aborted);
+        return false;
+    }
+    std::printf("ZeroCopyClose drain: %zu packets in flight at close, %zu bytes intact, fd closed on completion\n",
+                inFlight, sent);
+    return true;
+}
+
+static bool checkDeadlineReset() {
+    int sender = -1, peer = -1;
+    if (!connectPair(sender, peer))
+        return false;
+
+    int on = 1;
+    setsockopt(sender, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on));
+
+    auto zc = std::make_unique<ZeroCopyState>();
+    fill(sender, *zc);
+
+    ZeroCopyGraveyard graves;
+    const uint64_t deadline = nowMs() + 200;
+    graves.park(sender, std::move(zc), deadline);
+
+    /* the peer stays silent: nothing completes before the deadline */
+    const ZeroCopyCounts early = graves.reap(deadline - 100);
+    const ZeroCopyCounts late = graves.reap(deadline);
+
+    /* the reset throws away what the peer had buffered */
+    uint8_t b;
+    ssize_t n;
+    while ((n = recv(peer, &b, 1, 0)) > 0) {}
+    const int err = errno;
+    close(peer);
+
+    if (early.closed + early.aborted != 0 || late.aborted != 1 || !graves.empty() || n != -1 || err != ECONNRESET) {
+        std::printf("FAIL deadline: early=%llu/%llu late aborted=%llu parked=%zu peer recv=%zd errno=%d\n",
+                    (unsigned long long) early.closed, (unsigned long long) early.aborted,
+                    (unsigned long long) late.aborted, graves.size(), n, err);
+        return false;
+    }
+    std::printf("ZeroCopyClose deadline: silent peer reset at the deadline\n");
+    return true;
+}
+
+int main() {
+    const bool drained = checkDrainAndClose();
+    const bool reset = checkDeadlineReset();
+    return drained && reset ? 0 : 1;
+}
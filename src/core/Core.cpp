@@ -60,9 +60,52 @@ bool Core::initializeRuntime() {
     m_tcpServerWorkerThread = 3;
     m_udpServerWorkerThread = 3;
     m_tlsServerWorkerThread = 3;
+    m_tlsServerReactorThread = 2;
+
+    m_tcpConfig.reactorCount = 2;
+    m_tcpConfig.ioBackend = TcpIoBackend::EPOLL;
+    m_tcpConfig.edgeTriggered = false;
+    m_tcpConfig.txQuantum = 16 * 1024;
+    m_tcpConfig.txHighWatermark = 4 * 1024 * 1024;
+    m_tcpConfig.txLowWatermark = 1024 * 1024;
+    m_tcpConfig.firstFrameTimeoutMs = 10 * 1000;
+    m_tcpConfig.idleTimeoutMs = 120 * 1000;
+    m_tcpConfig.acceptBudget = 64;
+    m_tcpConfig.maxConnections = 100000;
+    m_tcpConfig.maxConnectionsPerIp = 1024;
+    m_tcpConfig.tlsPort = 0;
+    m_txTickBatching = true;
+    m_udpConfig.batchSize = 32;
+    m_udpConfig.shardSockets = true;
+    m_udpConfig.shardCount = m_shardWorkerThread;
+    m_tlsConfig.reactorCount = m_tlsServerReactorThread;
+    m_tlsConfig.balance = TlsBalance::LEAST_CONNECTIONS;
+    m_tlsConfig.engine = TlsEngine::MEMORY_BIO;
+    m_tlsConfig.handshakeWorkers = 2;
+    m_tlsConfig.handshakeTimeoutMs = 10 * 1000;
+    m_tlsConfig.firstFrameTimeoutMs = 10 * 1000;
+    m_tlsConfig.idleTimeoutMs = 120 * 1000;
+    m_tlsConfig.sessionTickets = true;
+    m_tlsConfig.ticketKeyRotationSec = 3600;
+    m_tlsConfig.sessionLifetimeSec = 7200;
+    m_tlsConfig.sessionCacheSize = 20000;
+    m_tlsConfig.ktls = true;
+    m_tlsConfig.txRecordSize = 16 * 1024;
+    m_tlsConfig.txHighWatermark = 4 * 1024 * 1024;
+    m_tlsConfig.txLowWatermark = 1024 * 1024;
+    m_tlsConfig.releaseBuffers = true;
+    m_tlsConfig.sslPoolSize = 256;
+    m_tlsConfig.memoryAccounting = true;
+    m_quicConfig.enabled = true;
+    m_quicConfig.maxConnections = 10000;
+    m_quicConfig.maxStreamsPerConnection = 16;
+    m_quicConfig.idleTimeoutMs = 120 * 1000;
+    m_quicConfig.txHighWatermark = 1024 * 1024;
+    m_quicConfig.txLowWatermark = 256 * 1024;
 
     m_tcpServerPort = 8000;
     m_udpServerPort = 8001;
+    m_quicServerPort = 8002;
 
     if (m_enableDb) {
         if (not initDatabase()) {
@@ -92,7 +135,7 @@ bool Core::initializeTlsContext() {
         return false;
     }
 
-    if (not m_tlsContext->init("/etc/nf/cert/cert.pem", "/etc/nf/cert/key.pem")) {
+    if (not m_tlsContext->init("/etc/nf/cert/cert.pem", "/etc/nf/cert/key.pem", m_tlsConfig)) {
         LOG_FATAL("Failed to initialize TLS context");
         return false;
     }
@@ -110,7 +153,8 @@ void Core::initializeIngress() {
             sslCtx,
             m_rxRouter.get(),
             m_tlsServerWorkerThread,
-            m_threadManager.get()
+            m_threadManager.get(),
+            m_tlsConfig
     );
 
     m_tcpServer = std::make_unique<TcpServer>(
@@ -118,15 +162,33 @@ void Core::initializeIngress() {
             m_rxRouter.get(),
             m_tcpServerWorkerThread,
             m_threadManager.get(),
-            m_tlsServer
+            m_tlsServer,
+            m_tcpConfig
     );
 
     m_udpServer = std::make_unique<UdpServer>(
             m_udpServerPort,
             m_rxRouter.get(),
             m_udpServerWorkerThread,
-            m_threadManager.get()
+            m_threadManager.get(),
+            m_udpConfig
     );
+
+    if (m_quicConfig.enabled) {
+        m_quicServer = std::make_unique<QuicServer>(
+                m_quicServerPort,
+                "/etc/nf/cert/cert.pem",
+                "/etc/nf/cert/key.pem",
+                m_rxRouter.get(),
+                m_quicConfig
+        );
+
+        /* the rest of the server runs without it */
+        if (not m_quicServer->isReady()) {
+            LOG_WARN("QUIC listener unavailable, serving TLS over TCP only");
+            m_quicServer.reset();
+        }
+    }
 }
 
 void Core::initializeEgress() {
@@ -134,7 +196,9 @@ void Core::initializeEgress() {
             m_tlsServer.get(),
             m_tcpServer.get(),
             m_udpServer.get(),
-            m_sessionManager.get()
+            m_quicServer.get(),
+            m_sessionManager.get(),
+            m_txTickBatching
     );
 
     for (size_t i = 0; i < m_shardManager->getWorkerCount(); ++i) {
@@ -155,6 +219,12 @@ void Core::startThreads() {
                                std::bind(&UdpServer::start, m_udpServer.get()),
                                std::bind(&UdpServer::stopReact, m_udpServer.get()));
 
+    if (m_quicServer) {
+        m_threadManager->addThread("quic_reactor",
+                                   std::bind(&QuicServer::start, m_quicServer.get()),
+                                   std::bind(&QuicServer::stopReact, m_quicServer.get()));
+    }
+
     m_threadManager->addThread("tcp_reactor",
                                std::bind(&TcpServer::start, m_tcpServer.get()),
                                std::bind(&TcpServer::stopReact, m_tcpServer.get()));
@@ -229,6 +299,25 @@ void Core::initializeClients() {
 void Core::waitForShutdown() {
     while (m_running) {
         std::this_thread::sleep_for(std::chrono::seconds(3));
+        dumpStats();
+    }
+}
+
+void Core::dumpStats() {
+    if (m_tlsContext) {
+        m_tlsContext->dumpStats();
+    }
+    if (m_tlsServer) {
+        m_tlsServer->dumpStats();
+    }
+    if (m_tcpServer) {
+        m_tcpServer->dumpStats();
+    }
+    if (m_udpServer) {
+        m_udpServer->dumpStats();
+    }
+    if (m_quicServer) {
+        m_quicServer->dumpStats();
     }
 }
 
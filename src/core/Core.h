@@ -10,6 +10,7 @@
 #include "protocol/tcp/TcpServer.h"
 #include "protocol/tls/TlsServer.h"
 #include "protocol/tls/TlsContext.h"
+#include "protocol/quic/QuicServer.h"
 
 #include "ingress/RxRouter.h"
 #include "egress/TxRouter.h"
@@ -59,6 +60,8 @@ private:
 
     void waitForShutdown();
 
+    void dumpStats();
+
     std::unique_ptr <TlsContext> m_tlsContext;
 
     std::unique_ptr <DbManager> m_dbManager;
@@ -72,6 +75,7 @@ private:
     std::unique_ptr <UdpServer> m_udpServer;
     std::unique_ptr <TcpServer> m_tcpServer;
     std::shared_ptr <TlsServer> m_tlsServer;
+    std::unique_ptr <QuicServer> m_quicServer;
 
     std::vector <std::unique_ptr<Client>> m_clientList;
     /*
@@ -92,9 +96,17 @@ private:
     int m_tcpServerWorkerThread = 0;
     int m_udpServerWorkerThread = 0;
     int m_tlsServerWorkerThread = 0;
+    int m_tlsServerReactorThread = 1;
+
+    TcpConfig m_tcpConfig{};
+    UdpConfig m_udpConfig{};
+    TlsConfig m_tlsConfig{};
+    QuicConfig m_quicConfig{};
+    bool m_txTickBatching = false;  // shard workers publish tx once per loop pass
 
     int m_tcpServerPort = 0;
     int m_udpServerPort = 0;
+    int m_quicServerPort = 0;
 
     static std::atomic<bool> m_running;
 };
@@ -4,12 +4,40 @@
 #include "protocol/tls/TlsServer.h"
 #include "protocol/tcp/TcpServer.h"
 #include "protocol/udp/UdpServer.h"
+#include "protocol/quic/QuicServer.h"
 
-TxRouter::TxRouter(TlsServer *tls, TcpServer *tcp, UdpServer *udp, SessionManager *sessionManager)
+/* batch of the shard worker running on this thread, null outside beginBatch / flushBatch */
+static thread_local std::vector<std::unique_ptr<Packet>> *t_txBatch = nullptr;
+
+TxRouter::TxRouter(TlsServer *tls, TcpServer *tcp, UdpServer *udp, QuicServer *quic, SessionManager *sessionManager,
+                   bool tickBatching)
         : m_tlsServer(tls),
           m_tcpServer(tcp),
           m_udpServer(udp),
-          m_sessionManager(sessionManager) {
+          m_quicServer(quic),
+          m_sessionManager(sessionManager),
+          m_tickBatching(tickBatching) {
+}
+
+void TxRouter::beginBatch(std::vector<std::unique_ptr<Packet>> &batch) {
+    if (m_tickBatching) {
+        t_txBatch = &batch;
+    }
+}
+
+void TxRouter::flushBatch(std::vector<std::unique_ptr<Packet>> &batch) {
+    if (t_txBatch == &batch) {
+        t_txBatch = nullptr;
+    }
+
+    if (batch.empty()) {
+        return;
+    }
+
+    if (m_tcpServer) {
+        m_tcpServer->enqueueTxBatch(batch);
+    }
+    batch.clear();
 }
 
 void TxRouter::handlePacket(uint64_t sessionId, Opcode opcode, std::vector<uint8_t> payload) {
@@ -42,7 +70,9 @@ void TxRouter::handlePacket(uint64_t sessionId, Opcode opcode, std::vector<uint8
             break;
 
         case Protocol::TCP:
-            if (m_tcpServer)
+            if (t_txBatch)
+                t_txBatch->push_back(std::move(packet));
+            else if (m_tcpServer)
                 m_tcpServer->enqueueTx(std::move(packet));
             break;
 
@@ -51,6 +81,11 @@ void TxRouter::handlePacket(uint64_t sessionId, Opcode opcode, std::vector<uint8
                 m_udpServer->enqueueTx(std::move(packet));
             break;
 
+        case Protocol::QUIC:
+            if (m_quicServer)
+                m_quicServer->enqueueTx(std::move(packet));
+            break;
+
         default:
             LOG_WARN("Unsupported protocol");
             break;
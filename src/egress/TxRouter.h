@@ -6,6 +6,7 @@
 
 #include <memory>
 #include <cstdint>
+#include <vector>
 
 class TlsServer;
 
@@ -13,16 +14,30 @@ class TcpServer;
 
 class UdpServer;
 
+class QuicServer;
+
 class TxRouter {
 public:
-    TxRouter(TlsServer *tls, TcpServer *tcp, UdpServer *udp, SessionManager *sessionManager);
+    TxRouter(TlsServer *tls, TcpServer *tcp, UdpServer *udp, QuicServer *quic, SessionManager *sessionManager,
+             bool tickBatching);
 
     void handlePacket(uint64_t sessionId, Opcode opcode, std::vector<uint8_t> payload);
 
+    /*
+     * Tick batching: between beginBatch and flushBatch, TCP packets built on the calling
+     * thread are held in batch and published together, one eventfd write per reactor.
+     * No-op when tick batching is off.
+     */
+    void beginBatch(std::vector <std::unique_ptr<Packet>> &batch);
+
+    void flushBatch(std::vector <std::unique_ptr<Packet>> &batch);
+
 private:
     PacketBuilder m_packetBuilder;
     TlsServer *m_tlsServer;
     TcpServer *m_tcpServer;
     UdpServer *m_udpServer;
+    QuicServer *m_quicServer;
     SessionManager *m_sessionManager;
+    bool m_tickBatching;
 };
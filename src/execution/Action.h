@@ -10,5 +10,8 @@ public:
     virtual ~Action() = default;
 
     virtual void handleAction(ShardContext &shardContext) = 0;
+
+    /* session the action writes to, 0 when it sends nothing */
+    virtual uint64_t sessionId() const { return 0; }
 };
 
@@ -0,0 +1,11 @@
+#include "execution/TxBackpressureEvent.h"
+
+TxBackpressureEvent::TxBackpressureEvent(uint64_t sessionId, bool paused) :
+    Event(sessionId),
+    m_paused(paused)
+{
+}
+
+void TxBackpressureEvent::handleEvent(ShardContext& shardContext) {
+    shardContext.setTxBackpressure(sessionId(), m_paused);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "execution/Event.h"
+#include "shard/ShardContext.h"
+
+/* Raised by the transport when a session's tx queue crosses its high (paused) or low (resumed) watermark */
+class TxBackpressureEvent final : public Event
+{
+public:
+    TxBackpressureEvent(uint64_t sessionId, bool paused);
+
+    void handleEvent(ShardContext& shardContext) override;
+
+    bool paused() const { return m_paused; }
+
+private:
+    bool m_paused;
+};
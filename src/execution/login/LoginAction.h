@@ -21,7 +21,7 @@ public:
 
     const std::vector<uint8_t> takePayload() { return std::move(m_payload); }
 
-    uint64_t sessionId() const { return m_sessionId; }
+    uint64_t sessionId() const override { return m_sessionId; }
 
     Opcode opcode() const { return m_opcode; }
 
@@ -40,7 +40,7 @@ public:
 
     const std::vector<uint8_t> takePayload() { return std::move(m_payload); }
 
-    uint64_t sessionId() const { return m_sessionId; }
+    uint64_t sessionId() const override { return m_sessionId; }
 
     Opcode opcode() const { return m_opcode; }
 
@@ -3,6 +3,7 @@
 #include "ingress/EventFactory.h"
 #include "shard/ShardManager.h"
 #include "execution/Event.h"
+#include "execution/TxBackpressureEvent.h"
 
 RxRouter::RxRouter(ShardManager *shardManager, SessionManager *sessionManager) :
         m_shardManager(shardManager),
@@ -59,6 +60,15 @@ void RxRouter::handlePacket(std::unique_ptr <Packet> packet) {
     m_shardManager->dispatch(shardIdx, std::move(event));
 }
 
+void RxRouter::handleTxBackpressure(uint64_t sessionId, bool paused) {
+    if (sessionId == 0) {
+        return;
+    }
+
+    m_shardManager->dispatch(selectShard(sessionId),
+                             std::make_unique<TxBackpressureEvent>(sessionId, paused));
+}
+
 size_t RxRouter::selectShard(const uint64_t sessionId) const {
     size_t workerCount = m_shardManager->getWorkerCount();
 
@@ -19,6 +19,8 @@ public:
 
     void handlePacket(std::unique_ptr <Packet> packet);
 
+    void handleTxBackpressure(uint64_t sessionId, bool paused);
+
 private:
     size_t selectShard(const uint64_t sessionId) const;
 
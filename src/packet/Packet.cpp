@@ -39,6 +39,8 @@ std::string Packet::dump() const {
                 return "UDP";
             case Protocol::TLS:
                 return "TLS";
+            case Protocol::QUIC:
+                return "QUIC";
             default:
                 return "UNKNOWN";
         }
@@ -114,6 +116,22 @@ int Packet::getFd() const {
     return m_fd;
 }
 
+uint32_t Packet::getConnGen() const {
+    return m_connGen;
+}
+
+void Packet::setConnGen(uint32_t gen) {
+    m_connGen = gen;
+}
+
+uint64_t Packet::getQueuedAt() const {
+    return m_queuedAt;
+}
+
+void Packet::setQueuedAt(uint64_t ns) {
+    m_queuedAt = ns;
+}
+
 size_t Packet::getTxOffset() const {
     return m_txOffset;
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "util/MpscQueue.h"
+
 #include <string>
 #include <netinet/in.h>
 #include <vector>
@@ -9,6 +11,7 @@ enum class Protocol {
     TCP,
     UDP,
     TLS,
+    QUIC,
     UNKNOWN
 };
 
@@ -20,7 +23,8 @@ struct ConnInfo {
     uint16_t dstPort;
 };
 
-class Packet {
+/* MpscNode: a packet waits in a connection's lock-free tx queue */
+class Packet : public MpscNode {
 public:
     Packet(int fd,
            Protocol proto,
@@ -36,6 +40,16 @@ public:
 
     int getFd() const;
 
+    /* generation of the connection behind fd, 0 when the packet is not tied to one */
+    uint32_t getConnGen() const;
+
+    void setConnGen(uint32_t gen);
+
+    /* monotonic ns when the packet entered a tx queue, for residency stats */
+    uint64_t getQueuedAt() const;
+
+    void setQueuedAt(uint64_t ns);
+
     size_t getTxOffset() const;
 
     const ConnInfo &getConnInfo() const;
@@ -56,6 +70,8 @@ public:
 
 private:
     int m_fd;
+    uint32_t m_connGen = 0;
+    uint64_t m_queuedAt = 0;
     ConnInfo m_connInfo;
     std::vector <uint8_t> m_payload;
     size_t m_txOffset = 0;
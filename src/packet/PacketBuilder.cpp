@@ -16,21 +16,32 @@ sockaddr_in PacketBuilder::createSockAddr(uint32_t ip, uint16_t port) {
 std::unique_ptr <Packet> PacketBuilder::build(std::vector<uint8_t> payload, const SessionTxSnapshot& snap) {
     const ConnInfo& ci = snap.connInfo;
 
-    // 논리적 src / dst addr 구성 (TCP/TLS/UDP 공통)
+    // 논리적 src / dst addr 구성 (TCP/TLS/UDP/QUIC 공통)
     sockaddr_in srcAddr = createSockAddr(ci.srcIp, ci.srcPort);
     sockaddr_in dstAddr = createSockAddr(ci.dstIp, ci.dstPort);
 
+    std::unique_ptr<Packet> packet;
+
     switch (snap.protocol) {
 
     case Protocol::TCP:
-        return std::make_unique<Packet>(snap.tcpFd, snap.protocol, std::move(payload), srcAddr, dstAddr);
+        packet = std::make_unique<Packet>(snap.tcpFd, snap.protocol, std::move(payload), srcAddr, dstAddr);
+        packet->setConnGen(snap.tcpGen);
+        return packet;
 
     case Protocol::TLS:
-        return std::make_unique<Packet>(snap.tlsFd, snap.protocol, std::move(payload), srcAddr, dstAddr);
+        packet = std::make_unique<Packet>(snap.tlsFd, snap.protocol, std::move(payload), srcAddr, dstAddr);
+        packet->setConnGen(snap.tlsGen);
+        return packet;
 
     case Protocol::UDP:
         return std::make_unique<Packet>(snap.udpFd, snap.protocol, std::move(payload), srcAddr, dstAddr);
 
+    case Protocol::QUIC:
+        packet = std::make_unique<Packet>(snap.quicFd, snap.protocol, std::move(payload), srcAddr, dstAddr);
+        packet->setConnGen(snap.quicGen);
+        return packet;
+
     default:
         LOG_WARN("PacketBuilder: unsupported protocol");
         return nullptr;
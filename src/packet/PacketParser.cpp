@@ -56,7 +56,7 @@ std::optional <ParsedPacket> PacketParser::parse(std::unique_ptr <Packet> packet
         return std::nullopt;
     }
 
-    return ParsedPacket(packet->getFd(), packet->getConnInfo(), version, opcode,
+    return ParsedPacket(packet->getFd(), packet->getConnGen(), packet->getConnInfo(), version, opcode,
             flags, sessionId, std::move(payload), HEADER_SIZE, bodyLen);
 }
 
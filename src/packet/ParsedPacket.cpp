@@ -5,6 +5,7 @@
 #include <arpa/inet.h>
 
 ParsedPacket::ParsedPacket(int fd,
+                           uint32_t connGen,
                            ConnInfo connInfo,
                            PacketVersion version,
                            Opcode opcode,
@@ -14,6 +15,7 @@ ParsedPacket::ParsedPacket(int fd,
                            size_t bodyOffset,
                            size_t bodyLen):
         m_fd(fd),
+        m_connGen(connGen),
         m_connInfo(connInfo),
         m_version(version),
         m_opcode(opcode),
@@ -45,6 +47,10 @@ int ParsedPacket::getFd() const {
     return m_fd;
 }
 
+uint32_t ParsedPacket::getConnGen() const {
+    return m_connGen;
+}
+
 const ConnInfo &ParsedPacket::getConnInfo() const {
     return m_connInfo;
 }
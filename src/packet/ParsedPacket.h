@@ -13,6 +13,7 @@ class ParsedPacket {
 public:
     ParsedPacket(
             int fd,
+            uint32_t connGen,
             ConnInfo connInfo,
             PacketVersion version,
             Opcode opcode,
@@ -34,6 +35,8 @@ public:
     // getters
     int getFd() const;
 
+    uint32_t getConnGen() const;
+
     const ConnInfo &getConnInfo() const;
 
     PacketVersion version() const;
@@ -48,6 +51,7 @@ public:
 
 private:
     int m_fd{0};
+    uint32_t m_connGen{0};
     ConnInfo m_connInfo;
 
     PacketVersion m_version{};
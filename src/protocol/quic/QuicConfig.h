@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+
+struct QuicConfig {
+    bool enabled = false;                  // QUIC listener next to the TLS-over-TCP one, needs OpenSSL with the QUIC server API
+    int maxConnections = 10000;            // accepted QUIC connections beyond this are closed right away
+    int maxStreamsPerConnection = 16;      // client-opened bidirectional streams, each carries its own frame stream
+    int idleTimeoutMs = 120 * 1000;        // no complete frame on any stream of a connection for this long closes it, 0 disables
+    size_t txHighWatermark = 1024 * 1024;  // queued tx bytes that stop reading a stream, QUIC flow control then holds the peer
+    size_t txLowWatermark = 256 * 1024;    // reads resume once the queue drains to this
+};
@@ -0,0 +1,849 @@
+#include "QuicServer.h"
+#include "util/Logger.h"
+#include "packet/Packet.h"
+#include "ingress/RxRouter.h"
+
+#include <openssl/err.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cstring>
+#include <endian.h>
+
+#define QUIC_HEADER_SIZE        (sizeof(CommonPacketHeader)) // 16 Byte
+#define QUIC_MAX_BODY_LEN       (64 * 1024) // 64 KB
+#define QUIC_RECV_CHUNK_SIZE    (4096)
+#define QUIC_MAX_RX_BUFFER_SIZE (QUIC_HEADER_SIZE + QUIC_MAX_BODY_LEN)
+#define QUIC_SOCKET_BUFFER_SIZE (4 * 1024 * 1024) // 4 MB, one socket carries every connection
+#define QUIC_MAX_EVENTS         (16)
+
+/* ALPN in wire format; clients must offer it */
+static const unsigned char s_alpn[] = {2, 'n', 'f'};
+
+QuicServer::QuicServer(int port,
+                       const std::string &certPath,
+                       const std::string &keyPath,
+                       RxRouter *rxRouter,
+                       const QuicConfig &config)
+        : m_port(port),
+          m_rxRouter(rxRouter),
+          m_config(config) {
+    m_ready = init() && initContext(certPath, keyPath) && initListener();
+    if (!m_ready)
+        deinit();
+}
+
+QuicServer::~QuicServer() {
+    deinit();
+}
+
+bool QuicServer::isReady() const {
+    return m_ready;
+}
+
+bool QuicServer::init() {
+#if !NF_QUIC_SERVER
+    LOG_WARN("QuicServer: {} has no QUIC server API (3.5+ needed), QUIC listener disabled", OPENSSL_VERSION_TEXT);
+    return false;
+#endif
+
+    if (m_config.txLowWatermark > m_config.txHighWatermark) {
+        LOG_WARN("QuicServer: txLowWatermark {} above txHighWatermark {}, clamped",
+                 m_config.txLowWatermark, m_config.txHighWatermark);
+        m_config.txLowWatermark = m_config.txHighWatermark;
+    }
+
+    m_serverAddr.sin_family = AF_INET;
+    m_serverAddr.sin_addr.s_addr = INADDR_ANY;
+    m_serverAddr.sin_port = htons(m_port);
+
+    m_stopEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_txEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_epFd = epoll_create1(0);
+    if (m_stopEventFd < 0 || m_txEventFd < 0 || m_epFd < 0) {
+        LOG_ERROR("QuicServer: eventfd/epoll init failed errno={}", errno);
+        return false;
+    }
+
+    if (!initSocket()) {
+        LOG_ERROR("QuicServer: socket init failed port={} errno={}", m_port, errno);
+        return false;
+    }
+
+    m_sockInterest = EPOLLIN;
+    return addToEpoll(m_sockFd, m_sockInterest) &&
+           addToEpoll(m_stopEventFd, EPOLLIN) &&
+           addToEpoll(m_txEventFd, EPOLLIN);
+}
+
+bool QuicServer::initSocket() {
+    m_sockFd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_sockFd < 0)
+        return false;
+
+    int opt = 1;
+    setsockopt(m_sockFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    int size = QUIC_SOCKET_BUFFER_SIZE;
+    setsockopt(m_sockFd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(m_sockFd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+    return bind(m_sockFd, (sockaddr *) &m_serverAddr, sizeof(m_serverAddr)) == 0;
+}
+
+void QuicServer::logOpenSslError(const char *msg) {
+    unsigned long e = ERR_get_error();
+    char buf[256];
+    ERR_error_string_n(e, buf, sizeof(buf));
+    LOG_ERROR("QuicServer: {}: {}", msg, buf);
+}
+
+void QuicServer::drainEventFd(int efd) {
+    uint64_t v;
+    while (read(efd, &v, sizeof(v)) == (ssize_t) sizeof(v)) {}
+}
+
+bool QuicServer::addToEpoll(int fd, uint32_t events) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    return epoll_ctl(m_epFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+void QuicServer::stopReact() {
+    m_running = false;
+
+    uint64_t v = 1;
+    if (m_stopEventFd >= 0)
+        (void) write(m_stopEventFd, &v, sizeof(v));
+}
+
+void QuicServer::enqueueTx(std::unique_ptr <Packet> packet) {
+    if (!packet)
+        return;
+
+    if (!m_ready) {
+        m_stats.txStale.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    {
+        std::lock_guard <std::mutex> lock(m_txLock);
+        m_txQueue.push_back(std::move(packet));
+    }
+
+    uint64_t v = 1;
+    (void) write(m_txEventFd, &v, sizeof(v));
+}
+
+void QuicServer::dumpStats() {
+    if (!m_ready)
+        return;
+
+    LOG_TRACE("QuicServer conns: accepted={} refused={} closed={} idleTimeouts={} | streams: accepted={} refused={} | "
+              "rx: frames={} bytes={} pauses={} | tx: frames={} bytes={} blocked={} stale={} | ticks={}",
+              m_stats.accepted.load(std::memory_order_relaxed),
+              m_stats.refused.load(std::memory_order_relaxed),
+              m_stats.closed.load(std::memory_order_relaxed),
+              m_stats.timeoutsIdle.load(std::memory_order_relaxed),
+              m_stats.streams.load(std::memory_order_relaxed),
+              m_stats.streamsRefused.load(std::memory_order_relaxed),
+              m_stats.rxFrames.load(std::memory_order_relaxed),
+              m_stats.rxBytes.load(std::memory_order_relaxed),
+              m_stats.rxPauses.load(std::memory_order_relaxed),
+              m_stats.txFrames.load(std::memory_order_relaxed),
+              m_stats.txBytes.load(std::memory_order_relaxed),
+              m_stats.txBlocked.load(std::memory_order_relaxed),
+              m_stats.txStale.load(std::memory_order_relaxed),
+              m_stats.ticks.load(std::memory_order_relaxed));
+}
+
+#if NF_QUIC_SERVER
+
+bool QuicServer::initContext(const std::string &certPath, const std::string &keyPath) {
+    m_ctx = SSL_CTX_new(OSSL_QUIC_server_method());
+    if (!m_ctx) {
+        logOpenSslError("SSL_CTX_new(OSSL_QUIC_server_method) failed");
+        return false;
+    }
+
+    if (SSL_CTX_use_certificate_chain_file(m_ctx, certPath.c_str()) <= 0 ||
+        SSL_CTX_use_PrivateKey_file(m_ctx, keyPath.c_str(), SSL_FILETYPE_PEM) <= 0 ||
+        SSL_CTX_check_private_key(m_ctx) <= 0) {
+        logOpenSslError("certificate / key load failed");
+        return false;
+    }
+
+    /* QUIC has no handshake without ALPN */
+    SSL_CTX_set_alpn_select_cb(m_ctx, &QuicServer::selectAlpn, this);
+
+    /* a stream write takes what flow control allows, the rest stays queued at its tx offset */
+    SSL_CTX_set_mode(m_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE);
+    return true;
+}
+
+bool QuicServer::initListener() {
+    m_listener = SSL_new_listener(m_ctx, 0);
+    if (!m_listener) {
+        logOpenSslError("SSL_new_listener failed");
+        return false;
+    }
+
+    /* non-blocking is inherited by every connection and stream accepted from the listener */
+    if (!SSL_set_fd(m_listener, m_sockFd) || !SSL_set_blocking_mode(m_listener, 0)) {
+        logOpenSslError("listener setup failed");
+        return false;
+    }
+
+    if (!SSL_listen(m_listener)) {
+        logOpenSslError("SSL_listen failed");
+        return false;
+    }
+
+    LOG_INFO("QuicServer: listening on udp port {} ({})", m_port, OPENSSL_VERSION_TEXT);
+    return true;
+}
+
+int QuicServer::selectAlpn(SSL *, const unsigned char **out, unsigned char *outLen,
+                           const unsigned char *in, unsigned int inLen, void *) {
+    if (SSL_select_next_proto((unsigned char **) out, outLen, s_alpn, sizeof(s_alpn), in, inLen) ==
+        OPENSSL_NPN_NEGOTIATED)
+        return SSL_TLSEXT_ERR_OK;
+    return SSL_TLSEXT_ERR_ALERT_FATAL;
+}
+
+void QuicServer::deinit() {
+    {
+        std::lock_guard <std::mutex> lock(m_txLock);
+        m_txQueue.clear();
+    }
+
+    for (auto &s: m_streams) {
+        if (s->ssl)
+            SSL_free(s->ssl);
+        s->ssl = nullptr;
+    }
+    m_streams.clear();
+    m_freeStreams.clear();
+
+    for (auto &conn: m_conns) {
+        m_timers.cancel(*conn);
+        SSL_free(conn->ssl);
+    }
+    m_conns.clear();
+    m_closedConns.clear();
+
+    if (m_listener) SSL_free(m_listener);
+    if (m_ctx) SSL_CTX_free(m_ctx);
+    m_listener = nullptr;
+    m_ctx = nullptr;
+
+    if (m_epFd >= 0) close(m_epFd);
+    if (m_sockFd >= 0) close(m_sockFd);
+    if (m_stopEventFd >= 0) close(m_stopEventFd);
+    if (m_txEventFd >= 0) close(m_txEventFd);
+    m_epFd = m_sockFd = m_stopEventFd = m_txEventFd = -1;
+}
+
+void QuicServer::start() {
+    if (!m_ready)
+        return;
+
+    m_running = true;
+    runReactor();
+}
+
+/*
+ * One pass:
+ *   epoll wakes for a datagram, a tx kick or OpenSSL's next timer
+ *   SSL_handle_events    receive, timers, retransmits for every connection
+ *   SSL_poll             accept connections and streams, read frames, retry blocked writes
+ *   flush                frames the shards queued since the last pass
+ *   SSL_handle_events    again if anything was written, so replies leave in this pass
+ */
+void QuicServer::runReactor() {
+    epoll_event events[QUIC_MAX_EVENTS];
+
+    while (m_running) {
+        int n = epoll_wait(m_epFd, events, QUIC_MAX_EVENTS, nextTimeoutMs());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("QuicServer: epoll_wait failed errno={}", errno);
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == m_stopEventFd)
+                handleStopEvent();
+            else if (fd == m_txEventFd)
+                handleTxEvent();
+        }
+        if (!m_running)
+            break;
+
+        m_nowMs = TimerWheel::nowMs();
+        m_wrote = false;
+
+        SSL_handle_events(m_listener);
+        m_stats.ticks.fetch_add(1, std::memory_order_relaxed);
+
+        pollObjects();
+        flushAllPending();
+
+        if (m_wrote) {
+            SSL_handle_events(m_listener);
+            m_stats.ticks.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        m_timers.advance(m_nowMs, [this](TimerNode &node) {
+            handleIdleTimer(static_cast<Connection &>(node));
+        });
+
+        m_closedConns.clear();
+        updateInterest();
+    }
+}
+
+int QuicServer::nextTimeoutMs() {
+    int timeoutMs = -1;
+
+    timeval tv{};
+    int infinite = 0;
+    if (SSL_get_event_timeout(m_listener, &tv, &infinite) && !infinite)
+        timeoutMs = (int) (tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000);
+
+    const int wheelMs = m_timers.nextTimeoutMs(TimerWheel::nowMs());
+    if (wheelMs >= 0 && (timeoutMs < 0 || wheelMs < timeoutMs))
+        timeoutMs = wheelMs;
+
+    return timeoutMs;
+}
+
+void QuicServer::handleStopEvent() {
+    drainEventFd(m_stopEventFd);
+    m_running = false;
+}
+
+void QuicServer::handleTxEvent() {
+    drainEventFd(m_txEventFd);
+
+    std::deque <std::unique_ptr<Packet>> batch;
+    {
+        std::lock_guard <std::mutex> lock(m_txLock);
+        batch.swap(m_txQueue);
+    }
+
+    for (auto &pkt: batch) {
+        const int handle = pkt->getFd();
+        Stream *s = findStream(handle, pkt->getConnGen());
+        if (!s) {
+            m_stats.txStale.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        if (s->txQueue.empty() && !s->txBlocked)
+            m_txPendingStreams.push_back(handle);
+
+        s->txQueuedBytes += pkt->getPayload().size();
+        s->txQueue.push_back(std::move(pkt));
+        updateBackpressure(handle);
+    }
+}
+
+void QuicServer::updateInterest() {
+    /* OpenSSL wants EPOLLOUT only when a send hit a full socket buffer */
+    const uint32_t want = EPOLLIN | (SSL_net_write_desired(m_listener) ? EPOLLOUT : 0);
+    if (want == m_sockInterest)
+        return;
+
+    epoll_event ev{};
+    ev.events = want;
+    ev.data.fd = m_sockFd;
+    if (epoll_ctl(m_epFd, EPOLL_CTL_MOD, m_sockFd, &ev) == 0)
+        m_sockInterest = want;
+}
+
+void QuicServer::rebuildPollSet() {
+    m_pollItems.clear();
+    m_pollTargets.clear();
+
+    auto add = [this](SSL *ssl, uint64_t events, const PollTarget &target) {
+        SSL_POLL_ITEM item{};
+        item.desc = SSL_as_poll_descriptor(ssl);
+        item.events = events;
+        m_pollItems.push_back(item);
+        m_pollTargets.push_back(target);
+    };
+
+    add(m_listener, SSL_POLL_EVENT_IC | SSL_POLL_EVENT_EL, PollTarget{});
+
+    for (auto &conn: m_conns) {
+        PollTarget target;
+        target.kind = PollKind::CONNECTION;
+        target.conn = conn.get();
+
+        /* a closing connection is only watched until its close has drained */
+        if (conn->closing) {
+            add(conn->ssl, SSL_POLL_EVENT_ECD, target);
+            continue;
+        }
+        add(conn->ssl, SSL_POLL_EVENT_ISB | SSL_POLL_EVENT_EC | SSL_POLL_EVENT_ECD, target);
+
+        for (int handle: conn->streams) {
+            const Stream &s = *m_streams[handle];
+
+            uint64_t events = SSL_POLL_EVENT_ER | SSL_POLL_EVENT_EW;
+            if (!s.rxPaused && !s.finishing)
+                events |= SSL_POLL_EVENT_R;
+            if (s.txBlocked)
+                events |= SSL_POLL_EVENT_W;
+
+            target.kind = PollKind::STREAM;
+            target.stream = handle;
+            target.gen = s.gen;
+            add(s.ssl, events, target);
+        }
+    }
+
+    m_pollDirty = false;
+}
+
+void QuicServer::pollObjects() {
+    if (m_pollDirty)
+        rebuildPollSet();
+
+    /* the tick already ran; this only reads readiness off the objects */
+    const timeval noWait{0, 0};
+    size_t ready = 0;
+    if (!SSL_poll(m_pollItems.data(), m_pollItems.size(), sizeof(SSL_POLL_ITEM), &noWait,
+                  SSL_POLL_FLAG_NO_HANDLE_EVENTS, &ready)) {
+        logOpenSslError("SSL_poll failed");
+        m_pollDirty = true;
+        return;
+    }
+    if (ready == 0)
+        return;
+
+    /* handlers may close objects or mark the set dirty; the items of this pass stay valid until it ends */
+    for (size_t i = 0; i < m_pollItems.size(); ++i) {
+        const uint64_t revents = m_pollItems[i].revents;
+        if (revents == 0)
+            continue;
+
+        const PollTarget &target = m_pollTargets[i];
+        switch (target.kind) {
+            case PollKind::LISTENER:
+                if (revents & SSL_POLL_EVENT_EL) {
+                    LOG_ERROR("QuicServer: listener failed, stopping");
+                    m_running = false;
+                    return;
+                }
+                acceptConnections();
+                break;
+
+            case PollKind::CONNECTION: {
+                Connection &conn = *target.conn;
+                if (!conn.ssl)
+                    break;
+
+                if (revents & SSL_POLL_EVENT_ECD)
+                    freeConnection(conn);
+                else if (revents & SSL_POLL_EVENT_EC)
+                    closeConnection(conn);
+                else if (revents & SSL_POLL_EVENT_ISB)
+                    acceptStreams(conn);
+                break;
+            }
+
+            case PollKind::STREAM: {
+                if (!findStream(target.stream, target.gen))
+                    break;
+
+                if (revents & (SSL_POLL_EVENT_R | SSL_POLL_EVENT_ER))
+                    readStream(target.stream);
+
+                Stream *s = findStream(target.stream, target.gen);
+                if (s && (revents & SSL_POLL_EVENT_W)) {
+                    s->txBlocked = false;
+                    m_pollDirty = true;
+                    flushStream(target.stream);
+                }
+
+                /* peer sent STOP_SENDING or reset: nothing more can go out */
+                if (findStream(target.stream, target.gen) && (revents & SSL_POLL_EVENT_EW))
+                    closeStream(target.stream);
+                break;
+            }
+        }
+    }
+}
+
+void QuicServer::acceptConnections() {
+    while (SSL *ssl = SSL_accept_connection(m_listener, SSL_ACCEPT_CONNECTION_NO_BLOCK)) {
+        if (m_conns.size() >= (size_t) std::max(m_config.maxConnections, 0)) {
+            m_stats.refused.fetch_add(1, std::memory_order_relaxed);
+            (void) SSL_shutdown_ex(ssl, SSL_SHUTDOWN_FLAG_NO_BLOCK | SSL_SHUTDOWN_FLAG_RAPID, nullptr, 0);
+            SSL_free(ssl);
+            continue;
+        }
+
+        /* frames only travel on client-opened streams; the connection has no default stream.
+         * Explicit event handling (streams inherit it): reads and writes leave the I/O to the reactor's tick */
+        if (!SSL_set_default_stream_mode(ssl, SSL_DEFAULT_STREAM_MODE_NONE) ||
+            !SSL_set_incoming_stream_policy(ssl, SSL_INCOMING_STREAM_POLICY_ACCEPT, 0) ||
+            !SSL_set_event_handling_mode(ssl, SSL_VALUE_EVENT_HANDLING_MODE_EXPLICIT)) {
+            logOpenSslError("connection stream setup failed");
+            SSL_free(ssl);
+            continue;
+        }
+
+        auto conn = std::make_unique<Connection>();
+        conn->ssl = ssl;
+        conn->idx = m_conns.size();
+        conn->addr.first = m_serverAddr;
+        conn->addr.second.sin_family = AF_INET;
+        conn->lastRxMs = m_nowMs;
+
+        BIO_ADDR *peer = BIO_ADDR_new();
+        if (peer && SSL_get_peer_addr(ssl, peer) && BIO_ADDR_family(peer) == AF_INET) {
+            size_t len = sizeof(conn->addr.second.sin_addr);
+            BIO_ADDR_rawaddress(peer, &conn->addr.second.sin_addr, &len);
+            conn->addr.second.sin_port = BIO_ADDR_rawport(peer);
+        }
+        BIO_ADDR_free(peer);
+
+        if (m_config.idleTimeoutMs > 0)
+            m_timers.arm(*conn, m_nowMs, (uint64_t) m_config.idleTimeoutMs);
+
+        Connection &ref = *conn;
+        m_conns.push_back(std::move(conn));
+        m_pollDirty = true;
+        m_stats.accepted.fetch_add(1, std::memory_order_relaxed);
+
+        /* streams opened together with the handshake are already waiting */
+        acceptStreams(ref);
+    }
+}
+
+void QuicServer::acceptStreams(Connection &conn) {
+    while (SSL *ssl = SSL_accept_stream(conn.ssl, SSL_ACCEPT_STREAM_NO_BLOCK)) {
+        if (conn.streams.size() >= (size_t) std::max(m_config.maxStreamsPerConnection, 0)) {
+            /* freeing an unfinished stream resets it and asks the peer to stop sending */
+            m_stats.streamsRefused.fetch_add(1, std::memory_order_relaxed);
+            SSL_free(ssl);
+            continue;
+        }
+
+        const int handle = allocStream();
+        Stream &s = *m_streams[handle];
+        s.ssl = ssl;
+        s.conn = &conn;
+        s.rxBuffer = RxBuffer(QUIC_MAX_RX_BUFFER_SIZE);
+        conn.streams.push_back(handle);
+
+        m_pollDirty = true;
+        m_stats.streams.fetch_add(1, std::memory_order_relaxed);
+
+        readStream(handle);
+    }
+}
+
+int QuicServer::allocStream() {
+    int handle;
+    if (!m_freeStreams.empty()) {
+        handle = m_freeStreams.back();
+        m_freeStreams.pop_back();
+    } else {
+        handle = (int) m_streams.size();
+        m_streams.push_back(std::make_unique<Stream>());
+    }
+
+    /* tx still addressed to the previous user of this handle no longer matches */
+    m_streams[handle]->gen++;
+    return handle;
+}
+
+QuicServer::Stream *QuicServer::findStream(int handle, uint32_t gen) {
+    if (handle < 0 || (size_t) handle >= m_streams.size())
+        return nullptr;
+
+    Stream *s = m_streams[handle].get();
+    return (s->ssl && s->gen == gen) ? s : nullptr;
+}
+
+void QuicServer::readStream(int handle) {
+    Stream &s = *m_streams[handle];
+
+    while (!s.rxPaused) {
+        uint8_t *dst = s.rxBuffer.prepare(QUIC_RECV_CHUNK_SIZE);
+        if (!dst) {
+            closeStream(handle);
+            return;
+        }
+
+        size_t bytes = 0;
+        if (!SSL_read_ex(s.ssl, dst, s.rxBuffer.writable(), &bytes)) {
+            const int err = SSL_get_error(s.ssl, 0);
+            if (err == SSL_ERROR_WANT_READ)
+                break;
+
+            /* ZERO_RETURN: the peer finished its side. Like a TLS peer's close, that ends the frame stream,
+             * but what is queued still goes out before our FIN */
+            if (err == SSL_ERROR_ZERO_RETURN) {
+                if (!s.finishing)
+                    finishStream(handle);
+                return;
+            }
+            closeStream(handle);
+            return;
+        }
+
+        s.rxBuffer.commit(bytes);
+        m_stats.rxBytes.fetch_add(bytes, std::memory_order_relaxed);
+
+        if (!parseFrames(handle)) {
+            LOG_WARN("QuicServer: bad frame on stream {}, closing it", handle);
+            closeStream(handle);
+            return;
+        }
+    }
+
+    if (s.rxBuffer.empty())
+        s.rxBuffer.shrink();
+}
+
+bool QuicServer::parseFrames(int handle) {
+    Stream &s = *m_streams[handle];
+    auto &buf = s.rxBuffer;
+
+    while (buf.size() >= QUIC_HEADER_SIZE) {
+        const uint8_t *frame = buf.data();
+
+        CommonPacketHeader hdr{};
+        std::memcpy(&hdr, frame, QUIC_HEADER_SIZE);
+
+        uint16_t bodyLen = ntohs(hdr.bodyLen);
+        if (bodyLen > QUIC_MAX_BODY_LEN)
+            return false;
+
+        size_t frameLen = QUIC_HEADER_SIZE + bodyLen;
+        if (buf.size() < frameLen)
+            break;
+
+        if (hdr.sessionId != 0)
+            s.sessionId = be64toh(hdr.sessionId);
+
+        s.conn->lastRxMs = m_nowMs;
+
+        std::vector <uint8_t> payload(frame, frame + frameLen);
+        buf.consume(frameLen);
+
+        auto pkt = std::make_unique<Packet>(
+                handle, Protocol::QUIC,
+                std::move(payload),
+                s.conn->addr.second,
+                s.conn->addr.first);
+        pkt->setConnGen(s.gen);
+        m_stats.rxFrames.fetch_add(1, std::memory_order_relaxed);
+
+        /* one reactor reads every stream, so handing over here keeps each stream's frames in order */
+        m_rxRouter->handlePacket(std::move(pkt));
+    }
+    return true;
+}
+
+void QuicServer::flushAllPending() {
+    for (int handle: m_txPendingStreams) {
+        Stream *s = m_streams[handle].get();
+        if (s->ssl && !s->txBlocked)
+            flushStream(handle);
+    }
+    m_txPendingStreams.clear();
+}
+
+void QuicServer::flushStream(int handle) {
+    Stream &s = *m_streams[handle];
+
+    while (!s.txQueue.empty()) {
+        Packet &pkt = *s.txQueue.front();
+        const auto &payload = pkt.getPayload();
+        const size_t offset = pkt.getTxOffset();
+        const size_t remaining = payload.size() - offset;
+
+        size_t written = 0;
+        if (!SSL_write_ex(s.ssl, payload.data() + offset, remaining, &written)) {
+            if (SSL_get_error(s.ssl, 0) != SSL_ERROR_WANT_WRITE) {
+                closeStream(handle);
+                return;
+            }
+            written = 0;
+        }
+
+        if (written > 0) {
+            m_wrote = true;
+            m_stats.txBytes.fetch_add(written, std::memory_order_relaxed);
+            s.txQueuedBytes -= written;
+        }
+
+        if (written < remaining) {
+            /* stream or connection flow control is closed; SSL_poll reports W once the peer opens it */
+            pkt.updateTxOffset(written);
+            if (!s.txBlocked) {
+                s.txBlocked = true;
+                m_pollDirty = true;
+                m_stats.txBlocked.fetch_add(1, std::memory_order_relaxed);
+            }
+            break;
+        }
+
+        s.txQueue.pop_front();
+        m_stats.txFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (s.finishing && s.txQueue.empty()) {
+        closeStream(handle);
+        return;
+    }
+    updateBackpressure(handle);
+}
+
+void QuicServer::updateBackpressure(int handle) {
+    Stream &s = *m_streams[handle];
+    if (m_config.txHighWatermark == 0)
+        return;
+
+    if (!s.rxPaused && s.txQueuedBytes >= m_config.txHighWatermark) {
+        s.rxPaused = true;
+        m_stats.rxPauses.fetch_add(1, std::memory_order_relaxed);
+    } else if (s.rxPaused && s.txQueuedBytes <= m_config.txLowWatermark) {
+        s.rxPaused = false;
+    } else {
+        return;
+    }
+
+    /* R comes off the poll set while paused: unread data fills the stream window and holds the peer */
+    m_pollDirty = true;
+    if (m_rxRouter)
+        m_rxRouter->handleTxBackpressure(s.sessionId, s.rxPaused);
+}
+
+void QuicServer::finishStream(int handle) {
+    Stream &s = *m_streams[handle];
+
+    /* R comes off the poll set; a blocked queue finishes when W fires, a reset or the idle timer cuts it short */
+    s.finishing = true;
+    m_pollDirty = true;
+    if (!s.txBlocked)
+        flushStream(handle);
+}
+
+/* drops what is still queued: for a reset, bad input, a write error or a closing connection */
+void QuicServer::closeStream(int handle) {
+    Stream &s = *m_streams[handle];
+    if (!s.ssl)
+        return;
+
+    /* FIN after what was written; freeing an unfinished stream would reset it */
+    if (!SSL_stream_conclude(s.ssl, 0))
+        ERR_clear_error();
+    SSL_free(s.ssl);
+
+    if (s.rxPaused && m_rxRouter)
+        m_rxRouter->handleTxBackpressure(s.sessionId, false);
+
+    auto &streams = s.conn->streams;
+    streams.erase(std::remove(streams.begin(), streams.end(), handle), streams.end());
+
+    s.ssl = nullptr;
+    s.conn = nullptr;
+    s.rxBuffer = RxBuffer(0);
+    s.sessionId = 0;
+    s.rxPaused = false;
+    s.txBlocked = false;
+    s.finishing = false;
+    s.txQueue.clear();
+    s.txQueuedBytes = 0;
+
+    m_freeStreams.push_back(handle);
+    m_pollDirty = true;
+}
+
+void QuicServer::closeConnection(Connection &conn) {
+    if (conn.closing)
+        return;
+
+    conn.closing = true;
+    m_timers.cancel(conn);
+    m_pollDirty = true;
+
+    while (!conn.streams.empty())
+        closeStream(conn.streams.back());
+
+    /* sends CONNECTION_CLOSE; the object is freed once SSL_poll reports the close drained */
+    if (SSL_shutdown_ex(conn.ssl, SSL_SHUTDOWN_FLAG_NO_BLOCK, nullptr, 0) == 1)
+        freeConnection(conn);
+}
+
+void QuicServer::freeConnection(Connection &conn) {
+    if (!conn.closing) {
+        conn.closing = true;
+        m_timers.cancel(conn);
+        while (!conn.streams.empty())
+            closeStream(conn.streams.back());
+    }
+
+    SSL_free(conn.ssl);
+    conn.ssl = nullptr;
+    m_stats.closed.fetch_add(1, std::memory_order_relaxed);
+
+    /* swap-remove; the object itself lives until the end of the pass, poll targets may still point at it */
+    const size_t idx = conn.idx;
+    std::swap(m_conns[idx], m_conns.back());
+    m_conns[idx]->idx = idx;
+    m_closedConns.push_back(std::move(m_conns.back()));
+    m_conns.pop_back();
+    m_pollDirty = true;
+}
+
+void QuicServer::handleIdleTimer(Connection &conn) {
+    if (conn.closing || !conn.ssl)
+        return;
+
+    const uint64_t idleMs = (uint64_t) m_config.idleTimeoutMs;
+    const uint64_t quietMs = m_nowMs - conn.lastRxMs;
+    if (quietMs < idleMs) {
+        m_timers.arm(conn, m_nowMs, idleMs - quietMs);
+        return;
+    }
+
+    m_stats.timeoutsIdle.fetch_add(1, std::memory_order_relaxed);
+    closeConnection(conn);
+}
+
+#else
+
+bool QuicServer::initContext(const std::string &, const std::string &) {
+    return false;
+}
+
+bool QuicServer::initListener() {
+    return false;
+}
+
+void QuicServer::deinit() {
+    if (m_epFd >= 0) close(m_epFd);
+    if (m_sockFd >= 0) close(m_sockFd);
+    if (m_stopEventFd >= 0) close(m_stopEventFd);
+    if (m_txEventFd >= 0) close(m_txEventFd);
+    m_epFd = m_sockFd = m_stopEventFd = m_txEventFd = -1;
+}
+
+void QuicServer::start() {
+}
+
+#endif
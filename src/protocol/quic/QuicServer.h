@@ -0,0 +1,229 @@
+#pragma once
+
+#include "protocol/quic/QuicConfig.h"
+#include "util/RxBuffer.h"
+#include "util/TimerWheel.h"
+
+#include <openssl/ssl.h>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/epoll.h>
+
+/* the QUIC server API (SSL_new_listener, SSL_accept_connection, SSL_poll) came with OpenSSL 3.5 */
+#if OPENSSL_VERSION_NUMBER >= 0x30500000L && !defined(OPENSSL_NO_QUIC)
+#define NF_QUIC_SERVER 1
+#else
+#define NF_QUIC_SERVER 0
+#endif
+
+class RxRouter;
+
+class Packet;
+
+struct QuicStats {
+    std::atomic<uint64_t> accepted{0};        // connections handed out by SSL_accept_connection
+    std::atomic<uint64_t> refused{0};         // closed right away, maxConnections reached
+    std::atomic<uint64_t> closed{0};
+    std::atomic<uint64_t> timeoutsIdle{0};
+    std::atomic<uint64_t> streams{0};         // client streams accepted
+    std::atomic<uint64_t> streamsRefused{0};  // over maxStreamsPerConnection, reset on accept
+    std::atomic<uint64_t> rxFrames{0};
+    std::atomic<uint64_t> rxBytes{0};
+    std::atomic<uint64_t> txFrames{0};
+    std::atomic<uint64_t> txBytes{0};
+    std::atomic<uint64_t> txBlocked{0};       // SSL_write stopped short, stream flow control or send buffer full
+    std::atomic<uint64_t> txStale{0};         // tx for a stream that closed or whose handle was reused
+    std::atomic<uint64_t> rxPauses{0};
+    std::atomic<uint64_t> ticks{0};           // SSL_handle_events passes
+};
+
+/*
+ * QUIC listener, alongside the TLS-over-TCP path.
+ *
+ *  UDP socket -> QUIC listener -> connection -> bidi stream -> CommonPacketHeader frames -> RxRouter
+ *
+ * Every client-opened bidirectional stream is a frame stream of its own, framed
+ * exactly like a TLS connection, so the layers above only see one more
+ * protocol. A stream gets a handle (Packet fd) and a generation (Packet
+ * connGen); replies go back on the stream the request came in on, tx for a
+ * handle that was reused since is dropped.
+ *
+ * One reactor thread owns the listener and everything under it. OpenSSL runs
+ * in explicit event handling mode: stream reads and writes only move bytes
+ * between buffers, and one SSL_handle_events per loop pass does the packet I/O
+ * and timers for all connections, so writes made in the same pass leave in
+ * shared datagrams. Frames are handed to RxRouter on the reactor, in stream
+ * order.
+ */
+class QuicServer {
+public:
+    QuicServer(int port,
+               const std::string &certPath,
+               const std::string &keyPath,
+               RxRouter *rxRouter,
+               const QuicConfig &config);
+
+    ~QuicServer();
+
+    /* false when init failed or OpenSSL lacks the QUIC server API; start() then returns at once */
+    bool isReady() const;
+
+    void start();
+
+    void stopReact();
+
+    void enqueueTx(std::unique_ptr <Packet> packet);
+
+    void dumpStats();
+
+private:
+    /* One accepted QUIC connection, reactor only. The TimerNode is its idle timer */
+    struct Connection : TimerNode {
+        SSL *ssl{nullptr};
+        size_t idx{0};                                 // position in m_conns
+        std::pair <sockaddr_in, sockaddr_in> addr{};   // local, peer; same order as TlsServer
+        std::vector<int> streams;                      // handles of the open streams
+        uint64_t lastRxMs{0};                          // last complete frame on any stream
+        bool closing{false};                           // shutdown started, freed once the close drained
+    };
+
+    /* One client-opened stream. Slots are reused; gen tells a reused handle apart */
+    struct Stream {
+        SSL *ssl{nullptr};
+        Connection *conn{nullptr};
+        uint32_t gen{0};
+        RxBuffer rxBuffer{0};
+        uint64_t sessionId{0};           // last non-zero sessionId seen in a frame header
+        bool rxPaused{false};            // not read while the tx queue is over the high watermark
+        bool txBlocked{false};           // SSL_write stopped short, retried when the stream turns writable
+        bool finishing{false};           // the peer sent FIN: no more reads, concluded once txQueue drains
+
+        std::deque <std::unique_ptr<Packet>> txQueue;   // packets are sent from their tx offset
+        size_t txQueuedBytes{0};
+    };
+
+    /* what a poll item points at */
+    enum class PollKind {
+        LISTENER,
+        CONNECTION,
+        STREAM,
+    };
+
+    struct PollTarget {
+        PollKind kind{PollKind::LISTENER};
+        Connection *conn{nullptr};
+        int stream{-1};
+        uint32_t gen{0};
+    };
+
+    bool init();
+
+    bool initSocket();
+
+    bool initContext(const std::string &certPath, const std::string &keyPath);
+
+    bool initListener();
+
+    void deinit();
+
+    void runReactor();
+
+    int nextTimeoutMs();
+
+    void handleStopEvent();
+
+    void handleTxEvent();
+
+    void updateInterest();
+
+    void pollObjects();
+
+    void rebuildPollSet();
+
+    void acceptConnections();
+
+    void acceptStreams(Connection &conn);
+
+    void readStream(int handle);
+
+    bool parseFrames(int handle);
+
+    void flushStream(int handle);
+
+    void flushAllPending();
+
+    void updateBackpressure(int handle);
+
+    void finishStream(int handle);
+
+    void closeStream(int handle);
+
+    void closeConnection(Connection &conn);
+
+    void freeConnection(Connection &conn);
+
+    void handleIdleTimer(Connection &conn);
+
+    int allocStream();
+
+    Stream *findStream(int handle, uint32_t gen);
+
+    static int selectAlpn(SSL *ssl, const unsigned char **out, unsigned char *outLen,
+                          const unsigned char *in, unsigned int inLen, void *arg);
+
+    void logOpenSslError(const char *msg);
+
+    void drainEventFd(int efd);
+
+    bool addToEpoll(int fd, uint32_t events);
+
+private:
+    int m_port;
+    sockaddr_in m_serverAddr{};
+
+    RxRouter *m_rxRouter;
+    QuicConfig m_config;
+
+    std::atomic<bool> m_running{false};
+    bool m_ready{false};
+
+    int m_sockFd{-1};
+    int m_epFd{-1};
+    int m_stopEventFd{-1};
+    int m_txEventFd{-1};
+    uint32_t m_sockInterest{0};
+
+    SSL_CTX *m_ctx{nullptr};
+    SSL *m_listener{nullptr};
+
+    std::vector <std::unique_ptr<Connection>> m_conns;
+    std::vector <std::unique_ptr<Connection>> m_closedConns;   // freed this pass, deleted at its end
+    std::vector <std::unique_ptr<Stream>> m_streams;
+    std::vector<int> m_freeStreams;
+    std::vector<int> m_txPendingStreams;   // streams with queued tx, flushed before the next tick
+
+    /* SSL_poll set, rebuilt when objects come and go or a stream's interest changes */
+    bool m_pollDirty{true};
+#if NF_QUIC_SERVER
+    std::vector <SSL_POLL_ITEM> m_pollItems;
+#endif
+    std::vector <PollTarget> m_pollTargets;
+
+    TimerWheel m_timers;
+    uint64_t m_nowMs{0};
+    bool m_wrote{false};   // a stream write this pass, the tail tick sends it
+
+    std::mutex m_txLock;
+    std::deque <std::unique_ptr<Packet>> m_txQueue;
+
+    QuicStats m_stats;
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+enum class TcpIoBackend {
+    EPOLL,      // level-triggered epoll + recv / sendmsg
+    IO_URING,   // multishot accept / recv on provided buffers, linked sendmsg; falls back to EPOLL
+};
+
+struct TcpConfig {
+    int reactorCount = 1;  // > 1 : one SO_REUSEPORT listen socket per reactor
+    TcpIoBackend ioBackend = TcpIoBackend::EPOLL;
+    bool edgeTriggered = false;  // EPOLLET connections, drained readBudget recv calls at a time
+    int readBudget = 4;          // recv calls per connection per loop iteration in edge-triggered mode
+    bool zeroCopy = false;                // MSG_ZEROCOPY for payloads >= zeroCopyThreshold
+    size_t zeroCopyThreshold = 16 * 1024; // below ~10 KB page pinning costs more than the copy
+    int zeroCopyLingerMs = 10 * 1000;     // a closed connection waits this long for zero-copy completions, then is reset
+    size_t txQuantum = 16 * 1024;         // deficit round robin credit per connection per round, bytes
+    size_t txHighWatermark = 4 * 1024 * 1024;  // queued tx bytes that pause reads from the connection, 0 disables
+    size_t txLowWatermark = 1024 * 1024;       // reads resume once the queue drains to this
+    int firstFrameTimeoutMs = 10 * 1000;   // accept until the first complete frame, 0 disables
+    int idleTimeoutMs = 120 * 1000;        // no complete frame for this long closes the connection, 0 disables
+    int acceptBudget = 64;                 // accept4 calls per listen wakeup, the rest waits for the next loop pass
+    size_t maxConnections = 0;             // open TCP and TLS connections across all reactors, 0 = unlimited
+    size_t maxConnectionsPerIp = 0;        // open connections per client address, 0 = unlimited
+    int tlsPort = 0;    // dedicated TLS listen port on reactor 0; the main port then skips sniffing. 0 = sniff
+};
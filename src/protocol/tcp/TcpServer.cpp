@@ -5,109 +5,702 @@
 #include "packet/Packet.h"
 #include "packet/ParsedPacketTypes.h"
 #include "protocol/tls/TlsServer.h"
+#include "util/IoUring.h"
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <climits>
 #include <arpa/inet.h>
+#include <endian.h>
 
 #include <cstring>
 #include <algorithm>
+#include <chrono>
 
 #define TCP_HEADER_SIZE        (sizeof(CommonPacketHeader)) // 8 Byte
 #define TCP_MAX_BODY_LEN       (64 * 1024) // 64 KB
 #define TCP_RECV_CHUNK_SIZE    (4096)
 #define TCP_MAX_RX_BUFFER_SIZE (TCP_HEADER_SIZE + TCP_MAX_BODY_LEN)
 #define TCP_MAX_EVENTS         (64)
+#define TCP_MAX_TX_IOV         (IOV_MAX)
+#define TCP_URING_ENTRIES      (1024)
+#define TCP_URING_BUF_COUNT    (256)  // provided recv buffers per reactor, TCP_RECV_CHUNK_SIZE each
+#define TCP_URING_BGID         (0)
+#define TCP_ACCEPT_BACKOFF_MS  (1000)  // a listen socket that hit ENOMEM / ENOBUFS rests this long
+#define TCP_ACCEPT_WARN_MS     (1000)  // at most one accept failure warning per reactor this often
+#define TCP_URING_MAX_LINKED   (8)    // sendmsg links per connection chain, TCP_MAX_TX_IOV packets each
+
+/* io_uring user_data: [ op:8 | gen:24 | fd:32 ], sends carry [ op:8 | seq:56 ] */
+enum class UringOp : uint8_t {
+    ACCEPT = 1,
+    EVENTFD,
+    POLL,
+    RECV,
+    SEND,
+    TIMEOUT,
+    CANCEL,
+};
+
+static uint64_t uringTag(UringOp op, uint32_t gen, int fd) {
+    return ((uint64_t) op << 56) | ((uint64_t) (gen & 0xFFFFFF) << 32) | (uint32_t) fd;
+}
+
+static UringOp uringOp(uint64_t userData) {
+    return (UringOp) (userData >> 56);
+}
+
+static uint32_t uringGen(uint64_t userData) {
+    return (uint32_t) (userData >> 32) & 0xFFFFFF;
+}
+
+static int uringFd(uint64_t userData) {
+    return (int) (uint32_t) userData;
+}
+
+static uint64_t monoNs() {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* upper bound in microseconds of the bucket holding quantile q of a log2 histogram */
+static uint64_t histQuantileUs(const std::atomic<uint64_t>* hist, size_t buckets, double q) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < buckets; ++i)
+        total += hist[i].load(std::memory_order_relaxed);
+    if (total == 0)
+        return 0;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets; ++i) {
+        seen += hist[i].load(std::memory_order_relaxed);
+        if ((double) seen >= q * (double) total)
+            return 1ULL << (i + 1);
+    }
+    return 1ULL << buckets;
+}
 
 
 TcpServer::TcpServer(int port,
                      RxRouter* rxRouter,
                      int workerCount,
                      ThreadManager* threadManager,
-                     std::shared_ptr<TlsServer> tlsServer)
+                     std::shared_ptr<TlsServer> tlsServer,
+                     const TcpConfig& config)
     : m_port(port),
       m_rxRouter(rxRouter),
       m_workerCount(workerCount),
       m_threadManager(threadManager),
-      m_tlsServer(std::move(tlsServer)) {
+      m_tlsServer(std::move(tlsServer)),
+      m_config(config) {
     init();
 }
 
 TcpServer::~TcpServer() {
+    if (m_tlsServer)
+        m_tlsServer->setAdmissionRelease(nullptr);
     deinit();
 }
 
 bool TcpServer::init() {
-    m_sockFd = socket(AF_INET, SOCK_STREAM, 0);
-    if (m_sockFd < 0)
-        return false;
+    m_zeroCopy = m_config.zeroCopy;
 
-    int opt = 1;
-    setsockopt(m_sockFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    setNonBlocking(m_sockFd);
+    if (m_config.txLowWatermark > m_config.txHighWatermark) {
+        LOG_WARN("TcpServer: txLowWatermark {} above txHighWatermark {}, clamped",
+                 m_config.txLowWatermark, m_config.txHighWatermark);
+        m_config.txLowWatermark = m_config.txHighWatermark;
+    }
 
     m_serverAddr.sin_family = AF_INET;
     m_serverAddr.sin_addr.s_addr = INADDR_ANY;
     m_serverAddr.sin_port = htons(m_port);
 
-    if (bind(m_sockFd, (sockaddr*)&m_serverAddr, sizeof(m_serverAddr)) != 0)
-        return false;
+    m_tlsAddr = m_serverAddr;
+    m_tlsAddr.sin_port = htons(m_config.tlsPort);
+    if (m_config.tlsPort > 0 && !m_tlsServer) {
+        LOG_WARN("TcpServer: tlsPort {} set without a TlsServer, ignored", m_config.tlsPort);
+        m_config.tlsPort = 0;
+    }
+
+    /* a TLS connection keeps the slot admitConnection gave it until TlsServer closes it */
+    if (m_tlsServer)
+        m_tlsServer->setAdmissionRelease([this](const sockaddr_in& peer) { releaseAdmission(peer); });
+
+    int reactorCount = std::max(1, m_config.reactorCount);
+    for (int i = 0; i < reactorCount; ++i) {
+        auto reactor = std::make_unique<Reactor>();
+        reactor->idx = i;
+
+        if (!initReactor(*reactor)) {
+            LOG_ERROR("TcpServer: reactor {} init failed errno={}", i, errno);
+            return false;
+        }
+        m_reactors.push_back(std::move(reactor));
+    }
 
-    if (listen(m_sockFd, SOMAXCONN) != 0)
+    LOG_INFO("TcpServer: {} reactor(s) listening on port {}", m_reactors.size(), m_port);
+    return true;
+}
+
+bool TcpServer::initReactor(Reactor& r) {
+    r.sockFd = openListenSocket(m_serverAddr);
+    if (r.sockFd < 0)
         return false;
 
-    m_epFd = epoll_create1(0);
-    if (m_epFd < 0)
+    /* ClientHellos go straight to TlsServer from here; one socket is enough for the login rate */
+    if (r.idx == 0 && m_config.tlsPort > 0) {
+        r.tlsSockFd = openListenSocket(m_tlsAddr);
+        if (r.tlsSockFd < 0)
+            return false;
+        LOG_INFO("TcpServer: dedicated TLS port {}", m_config.tlsPort);
+    }
+
+    r.epFd = epoll_create1(0);
+    if (r.epFd < 0)
         return false;
 
-    m_txEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
-    if (m_txEventFd < 0)
+    r.txEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (r.txEventFd < 0)
         return false;
 
-    addToEpoll(m_sockFd, EPOLLIN);
-    addToEpoll(m_txEventFd, EPOLLIN);
+    if (m_config.ioBackend == TcpIoBackend::IO_URING && !initUring(r))
+        LOG_WARN("TcpServer: reactor {} io_uring setup failed errno={}, fallback to epoll", r.idx, errno);
+
+    addToEpoll(r.epFd, r.sockFd, EPOLLIN);
+    addToEpoll(r.epFd, r.txEventFd, EPOLLIN);
+    if (r.tlsSockFd >= 0)
+        addToEpoll(r.epFd, r.tlsSockFd, EPOLLIN);
+
+    /* held back for accepting while out of fds, see onAcceptError */
+    r.reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
     return true;
 }
 
-void TcpServer::deinit() {
-    for (auto& kv : m_clients)
-        close(kv.first);
+int TcpServer::openListenSocket(const sockaddr_in& addr) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
 
-    m_clients.clear();
-    m_rxBuffer.clear();
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) != 0 ||
+        !setNonBlocking(fd) ||
+        bind(fd, (const sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
 
-    if (m_sockFd >= 0) close(m_sockFd);
-    if (m_epFd >= 0) close(m_epFd);
-    if (m_txEventFd >= 0) close(m_txEventFd);
+void TcpServer::deinit() {
+    m_conns.forEach([this](int fd, Connection& conn) {
+        if (conn.owner.exchange(-1) >= 0)
+            close(fd);
+        dropTxQueue(conn);
+    });
+
+    for (auto& r : m_reactors) {
+        if (r->sockFd >= 0) close(r->sockFd);
+        if (r->tlsSockFd >= 0) close(r->tlsSockFd);
+        if (r->epFd >= 0) close(r->epFd);
+        if (r->txEventFd >= 0) close(r->txEventFd);
+        if (r->reserveFd >= 0) close(r->reserveFd);
+    }
+    m_reactors.clear();
 }
 
 void TcpServer::start() {
     m_running = true;
     startWorkers();
+    startReactors();
+
+    if (!m_reactors.empty())
+        runReactor(*m_reactors[0]);
+}
+
+void TcpServer::startReactors() {
+    /* reactor 0 runs on the caller thread (tcp_reactor) */
+    for (size_t i = 1; i < m_reactors.size(); ++i) {
+        m_threadManager->addThread(
+            "tcp_reactor_" + std::to_string(i),
+            std::bind(&TcpServer::runReactor, this, std::ref(*m_reactors[i])),
+            std::bind(&TcpServer::stopReact, this));
+    }
+}
+
+void TcpServer::runReactor(Reactor& r) {
+    if (r.uring) {
+        runUringReactor(r);
+        return;
+    }
 
     epoll_event events[TCP_MAX_EVENTS];
 
     while (m_running) {
-        int n = epoll_wait(m_epFd, events, TCP_MAX_EVENTS, -1);
+        /* parked or backlogged connections still have work, so only peek at new events */
+        const bool busy = !r.rxReady.empty() || !r.txActive.empty();
+        int timeoutMs = busy ? 0 : r.timers.nextTimeoutMs(TimerWheel::nowMs());
+        const bool ticking = !r.zcGraves.empty() || !r.acceptPaused.empty();
+        if (ticking && (timeoutMs < 0 || timeoutMs > TIMER_WHEEL_DEFAULT_TICK_MS))
+            timeoutMs = TIMER_WHEEL_DEFAULT_TICK_MS;
+
+        int n = epoll_wait(r.epFd, events, TCP_MAX_EVENTS, timeoutMs);
+        m_stats.syscalls.fetch_add(1, std::memory_order_relaxed);
         if (n < 0) {
             if (errno == EINTR) continue;
             break;
         }
+        if (n > 0)
+            m_stats.wakeups.fetch_add(1, std::memory_order_relaxed);
 
+        r.nowMs = TimerWheel::nowMs();
         for (int i = 0; i < n; ++i)
-            handleEvent(events[i]);
+            handleEvent(r, events[i]);
+
+        serviceRxReady(r);
+        runTxRound(r);
+        expireTimers(r);
+        reapZeroCopy(r);
+        resumeAccept(r);
     }
 }
 
+bool TcpServer::initUring(Reactor& r) {
+    r.uring = std::make_unique<IoUring>();
+    if (!r.uring->init(TCP_URING_ENTRIES) ||
+        !r.uring->registerBufRing(TCP_URING_BGID, TCP_URING_BUF_COUNT, TCP_RECV_CHUNK_SIZE)) {
+        r.uring.reset();
+        return false;
+    }
+    return true;
+}
+
+void TcpServer::runUringReactor(Reactor& r) {
+    armUringAccept(r, r.sockFd);
+    if (r.tlsSockFd >= 0)
+        armUringAccept(r, r.tlsSockFd);
+    armUringEventFd(r);
+    if (m_config.firstFrameTimeoutMs > 0 || m_config.idleTimeoutMs > 0)
+        armUringTimeout(r);
+
+    while (m_running) {
+        int ret = r.uring->submitAndWait(1);
+        m_stats.syscalls.fetch_add(1, std::memory_order_relaxed);
+        if (ret < 0 && ret != -EINTR && ret != -EBUSY) {
+            LOG_ERROR("TcpServer: io_uring_enter failed err={}", -ret);
+            break;
+        }
+
+        r.nowMs = TimerWheel::nowMs();
+
+        while (io_uring_cqe* cqe = r.uring->peekCqe()) {
+            const uint64_t userData = cqe->user_data;
+            const int res = cqe->res;
+            const uint32_t flags = cqe->flags;
+            r.uring->cqeSeen();
+
+            handleUringCqe(r, userData, res, flags);
+        }
+
+        expireTimers(r);
+        resumeAccept(r);
+    }
+}
+
+void TcpServer::handleUringCqe(Reactor& r, uint64_t userData, int res, uint32_t flags) {
+    switch (uringOp(userData)) {
+        case UringOp::ACCEPT: {
+            const int listenFd = uringFd(userData);
+            if (res >= 0) {
+                sockaddr_in clientAddr{};
+                socklen_t len = sizeof(clientAddr);
+                getpeername(res, (sockaddr*)&clientAddr, &len);
+                m_stats.syscalls.fetch_add(1, std::memory_order_relaxed);
+                if (listenFd != r.tlsSockFd)
+                    onUringAccept(r, res, clientAddr);
+                else if (admitConnection(clientAddr))
+                    m_tlsServer->handleTlsConnection(res, {m_tlsAddr, clientAddr});
+                else
+                    close(res);
+            }
+
+            /* an error ends the multishot; a socket onAcceptError paused is re-armed by resumeAccept */
+            const bool more = flags & IORING_CQE_F_MORE;
+            if (!more && (res == -EMFILE || res == -ENFILE || res == -ENOBUFS || res == -ENOMEM))
+                onAcceptError(r, listenFd, -res);
+            if (!more && m_running &&
+                std::find(r.acceptPaused.begin(), r.acceptPaused.end(), listenFd) == r.acceptPaused.end())
+                armUringAccept(r, listenFd);
+            break;
+        }
+
+        case UringOp::EVENTFD:
+            if (!m_running)
+                break;
+            armUringEventFd(r);
+            flushUringPending(r);
+            break;
+
+        case UringOp::POLL: {
+            /* first readable event: sniff for a TLS ClientHello before any byte is consumed */
+            int fd = uringFd(userData);
+            Connection* conn = findOwned(r, fd);
+            if (!conn || (conn->gen.load(std::memory_order_relaxed) & 0xFFFFFF) != uringGen(userData))
+                break;
+
+            conn->proto = sniffProtocol(fd);
+            if (conn->proto == ConnProto::TLS) {
+                handoverToTls(r, fd);
+                break;
+            }
+            if (conn->proto == ConnProto::UNKNOWN) {
+                armUringPoll(r, fd, uringGen(userData));
+                break;
+            }
+
+            /* updateBackpressure arms it on resume */
+            if (!conn->rxPaused)
+                armUringRecv(r, fd, uringGen(userData));
+            break;
+        }
+
+        case UringOp::RECV:
+            onUringRecv(r, uringFd(userData), uringGen(userData), res, flags);
+            break;
+
+        case UringOp::SEND:
+            onUringSend(r, userData & ((1ULL << 56) - 1), res);
+            break;
+
+        case UringOp::TIMEOUT:
+            /* nothing to do here, the loop advances the wheel after every batch of completions */
+            if (m_running && (m_config.firstFrameTimeoutMs > 0 || m_config.idleTimeoutMs > 0 || !r.acceptPaused.empty()))
+                armUringTimeout(r);
+            break;
+
+        case UringOp::CANCEL:
+            /* the cancelled recv reports itself with -ECANCELED */
+            break;
+    }
+}
+
+void TcpServer::armUringAccept(Reactor& r, int listenFd) {
+    io_uring_sqe* sqe = r.uring->getSqe();
+    if (!sqe) {
+        LOG_ERROR("TcpServer: io_uring sq full, accept not armed");
+        return;
+    }
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenFd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = uringTag(UringOp::ACCEPT, 0, listenFd);
+}
+
+void TcpServer::armUringEventFd(Reactor& r) {
+    io_uring_sqe* sqe = r.uring->getSqe();
+    if (!sqe) {
+        LOG_ERROR("TcpServer: io_uring sq full, tx eventfd not armed");
+        return;
+    }
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = r.txEventFd;
+    sqe->addr = (uint64_t)&r.uringEventValue;
+    sqe->len = sizeof(r.uringEventValue);
+    sqe->user_data = uringTag(UringOp::EVENTFD, 0, r.txEventFd);
+}
+
+void TcpServer::armUringTimeout(Reactor& r) {
+    io_uring_sqe* sqe = r.uring->getSqe();
+    if (!sqe) {
+        LOG_ERROR("TcpServer: io_uring sq full, timer tick not armed");
+        return;
+    }
+
+    r.uringTick.tv_sec = 0;
+    r.uringTick.tv_nsec = (long long)TIMER_WHEEL_DEFAULT_TICK_MS * 1000 * 1000;
+
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)&r.uringTick;
+    sqe->len = 1;
+    sqe->off = 0;
+    sqe->user_data = uringTag(UringOp::TIMEOUT, 0, 0);
+}
+
+void TcpServer::armUringPoll(Reactor& r, int fd, uint32_t gen) {
+    io_uring_sqe* sqe = r.uring->getSqe();
+    if (!sqe) {
+        closeConnection(r, fd);
+        return;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN | POLLRDHUP;
+    sqe->user_data = uringTag(UringOp::POLL, gen, fd);
+}
+
+void TcpServer::armUringRecv(Reactor& r, int fd, uint32_t gen) {
+    io_uring_sqe* sqe = r.uring->getSqe();
+    if (!sqe) {
+        closeConnection(r, fd);
+        return;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = TCP_URING_BGID;
+    sqe->user_data = uringTag(UringOp::RECV, gen, fd);
+
+    if (Connection* conn = findOwned(r, fd))
+        conn->uring.recvArmed = true;
+}
+
+void TcpServer::cancelUringRecv(Reactor& r, Connection& conn) {
+    io_uring_sqe* sqe = r.uring->getSqe();
+    if (!sqe) {
+        LOG_ERROR("TcpServer: io_uring sq full, recv not paused fd={}", conn.fd);
+        return;
+    }
+
+    const uint32_t gen = conn.gen.load(std::memory_order_relaxed) & 0xFFFFFF;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = uringTag(UringOp::RECV, gen, conn.fd);
+    sqe->user_data = uringTag(UringOp::CANCEL, gen, conn.fd);
+}
+
+void TcpServer::onUringAccept(Reactor& r, int fd, sockaddr_in clientAddr) {
+    Connection* conn = openConnection(r, fd, clientAddr);
+    if (!conn)
+        return;
+
+    /* only an unsniffed connection needs the first-readable poll */
+    const uint32_t gen = conn->gen.load(std::memory_order_relaxed) & 0xFFFFFF;
+    if (conn->proto == ConnProto::UNKNOWN)
+        armUringPoll(r, fd, gen);
+    else
+        armUringRecv(r, fd, gen);
+}
+
+void TcpServer::onUringRecv(Reactor& r, int fd, uint32_t gen, int res, uint32_t flags) {
+    const bool hasBuf = flags & IORING_CQE_F_BUFFER;
+    const uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+
+    /* a completion for an earlier connection on a reused fd only returns its buffer */
+    Connection* conn = findOwned(r, fd);
+    if (!conn || (conn->gen.load(std::memory_order_relaxed) & 0xFFFFFF) != gen) {
+        if (hasBuf) r.uring->recycleBuf(bid);
+        return;
+    }
+
+    if (res > 0 && hasBuf) {
+        auto& rxBuffer = conn->rxBuffer;
+        uint8_t* dst = rxBuffer.prepare((size_t)res);
+        if (dst)
+            std::memcpy(dst, r.uring->bufAddr(bid), (size_t)res);
+        r.uring->recycleBuf(bid);
+
+        if (!dst) {
+            LOG_WARN("TCP Rx Buffer overflow fd={}", fd);
+            closeConnection(r, fd);
+            return;
+        }
+
+        rxBuffer.commit((size_t)res);
+        const bool more = flags & IORING_CQE_F_MORE;
+        if (!more)
+            conn->uring.recvArmed = false;
+        if (drainFrames(r, fd, *conn) && !more && !conn->rxPaused)
+            armUringRecv(r, fd, gen);
+        return;
+    }
+
+    if (hasBuf)
+        r.uring->recycleBuf(bid);
+
+    /* the provided buffer ring ran dry (buffers are back now), or a tx backpressure pause
+     * cancelled the recv; re-arm unless reads are paused, updateBackpressure re-arms on resume */
+    if (res == -ENOBUFS || res == -ECANCELED) {
+        if (!(flags & IORING_CQE_F_MORE)) {
+            conn->uring.recvArmed = false;
+            if (!conn->rxPaused)
+                armUringRecv(r, fd, gen);
+        }
+        return;
+    }
+
+    closeConnection(r, fd);
+}
+
+void TcpServer::flushUringPending(Reactor& r) {
+    r.txReady.beginDrain();
+
+    while (Connection* conn = r.txReady.pop()) {
+        /* fd was closed and accepted again by another reactor since it was scheduled */
+        if (conn->owner.load(std::memory_order_acquire) != r.idx) {
+            scheduleTx(*conn);
+            continue;
+        }
+
+        updateBackpressure(r, *conn);
+
+        /* a chain in flight picks the rest up when it completes */
+        if (conn->uring.sendsInFlight == 0)
+            submitUringSends(r, conn->fd, *conn);
+    }
+
+    if (!r.txReady.empty())
+        kickTx(r);
+}
+
+void TcpServer::submitUringSends(Reactor& r, int fd, Connection& conn) {
+    /* one chain per connection: links run in order, MSG_WAITALL makes the kernel finish each one */
+    std::vector<std::unique_ptr<UringSend>> chain;
+    bool more = true;
+    while (more && chain.size() < TCP_URING_MAX_LINKED) {
+        auto op = std::make_unique<UringSend>();
+        while (op->packets.size() < (size_t)TCP_MAX_TX_IOV) {
+            auto pkt = popTx(conn);
+            if (!pkt) {
+                more = false;
+                break;
+            }
+            op->packets.push_back(std::move(pkt));
+        }
+        if (op->packets.empty())
+            break;
+        chain.push_back(std::move(op));
+    }
+
+    for (size_t i = 0; i < chain.size(); ++i) {
+        auto& op = chain[i];
+        op->seq = r.uringSendSeq++;
+        op->fd = fd;
+        op->gen = conn.gen.load(std::memory_order_relaxed);
+
+        for (auto& pkt : op->packets) {
+            const auto& payload = pkt->getPayload();
+            iovec iov{};
+            iov.iov_base = const_cast<uint8_t*>(payload.data()) + pkt->getTxOffset();
+            iov.iov_len = payload.size() - pkt->getTxOffset();
+            op->total += iov.iov_len;
+            op->iov.push_back(iov);
+        }
+        op->msg.msg_iov = op->iov.data();
+        op->msg.msg_iovlen = op->iov.size();
+
+        io_uring_sqe* sqe = r.uring->getSqe();
+        if (!sqe) {
+            /* sq full: the rest of the chain goes back in front of the queue */
+            for (size_t j = chain.size(); j > i; --j)
+                for (size_t k = chain[j - 1]->packets.size(); k > 0; --k)
+                    retryTx(conn, std::move(chain[j - 1]->packets[k - 1]));
+            break;
+        }
+
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)&op->msg;
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        sqe->flags = (i + 1 < chain.size()) ? IOSQE_IO_LINK : 0;
+        sqe->user_data = ((uint64_t)UringOp::SEND << 56) | (op->seq & ((1ULL << 56) - 1));
+
+        conn.uring.sendsInFlight++;
+        r.uringSends.emplace(op->seq, std::move(op));
+    }
+}
+
+void TcpServer::onUringSend(Reactor& r, uint64_t seq, int res) {
+    auto it = r.uringSends.find(seq);
+    if (it == r.uringSends.end())
+        return;
+
+    auto op = std::move(it->second);
+    r.uringSends.erase(it);
+
+    const int fd = op->fd;
+    Connection* conn = findOwned(r, fd);
+    if (!conn || conn->gen.load(std::memory_order_relaxed) != op->gen)
+        return;
+
+    op->res = res;
+    conn->uring.sendsDone.push_back(std::move(op));
+
+    if (--conn->uring.sendsInFlight == 0)
+        finishUringSends(r, fd, *conn);
+}
+
+void TcpServer::finishUringSends(Reactor& r, int fd, Connection& conn) {
+    /* walk the chain in submission order, a failed link cancels the ones after it */
+    auto& done = conn.uring.sendsDone;
+    std::sort(done.begin(), done.end(),
+              [](const auto& a, const auto& b) { return a->seq < b->seq; });
+
+    bool failed = false;
+    std::vector<std::unique_ptr<Packet>> unsent;
+    for (auto& op : done) {
+        size_t sent = op->res > 0 ? (size_t)op->res : 0;
+        size_t done = 0;
+        for (auto& pkt : op->packets) {
+            size_t left = pkt->getPayload().size() - pkt->getTxOffset();
+            if (sent < left) {
+                pkt->updateTxOffset(sent);
+                break;
+            }
+            sent -= left;
+            done++;
+        }
+
+        const uint64_t now = monoNs();
+        for (size_t i = 0; i < done; ++i)
+            recordResidency(conn, *op->packets[i], now);
+
+        for (size_t i = done; i < op->packets.size(); ++i)
+            unsent.push_back(std::move(op->packets[i]));
+
+        if (op->res > 0) {
+            m_stats.txCalls.fetch_add(1, std::memory_order_relaxed);
+            m_stats.txFrames.fetch_add(done, std::memory_order_relaxed);
+            m_stats.txBytes.fetch_add(op->res, std::memory_order_relaxed);
+        }
+        if (op->res < 0 && op->res != -ECANCELED)
+            failed = true;
+    }
+    done.clear();
+
+    if (failed) {
+        closeConnection(r, fd);
+        return;
+    }
+
+    for (size_t i = unsent.size(); i > 0; --i)
+        retryTx(conn, std::move(unsent[i - 1]));
+
+    updateBackpressure(r, conn);
+
+    if (hasPendingTx(r, fd))
+        submitUringSends(r, fd, conn);
+}
+
 void TcpServer::stopReact() {
     m_running = false;
     m_cv.notify_all();
 
     uint64_t v = 1;
-    write(m_txEventFd, &v, sizeof(v));
+    for (auto& r : m_reactors)
+        write(r->txEventFd, &v, sizeof(v));
 }
 
 void TcpServer::startWorkers() {
@@ -141,240 +734,1021 @@ void TcpServer::processPacket() {
     }
 }
 
-void TcpServer::handleEvent(const epoll_event& ev) {
+void TcpServer::handleEvent(Reactor& r, const epoll_event& ev) {
     int fd = ev.data.fd;
 
-    if (fd == m_txEventFd) {
-        drainEventFd(m_txEventFd);
-        flushAllPending(256);
+    if (fd == r.txEventFd) {
+        drainEventFd(r.txEventFd);
+        m_stats.syscalls.fetch_add(1, std::memory_order_relaxed);
+        flushAllPending(r);
         return;
     }
 
-    if (ev.events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
-        closeConnection(fd);
+    uint32_t events = ev.events;
+
+    /* EPOLLERR also means zero-copy completions are waiting on the error queue */
+    if ((events & EPOLLERR) && fd != r.sockFd && fd != r.tlsSockFd && drainZeroCopyCompletions(r, fd))
+        events &= ~EPOLLERR;
+
+    if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+        closeConnection(r, fd);
         return;
     }
 
-    if (fd == m_sockFd) {
-        acceptConnection();
+    if (fd == r.sockFd || fd == r.tlsSockFd) {
+        acceptConnection(r, fd);
+        return;
+    }
+
+    /* writable again: back into the round robin, the data goes out at the end of this iteration */
+    if (events & EPOLLOUT) {
+        Connection* conn = findOwned(r, fd);
+        if (conn && conn->txBlocked) {
+            conn->txBlocked = false;
+            setInterest(r, fd, false);
+            activateTx(r, *conn);
+        }
+    }
+
+    if (events & EPOLLIN) {
+        /* paused earlier in this batch; the data waits in the socket until the tx queue drains */
+        Connection* conn = findOwned(r, fd);
+        if (conn && conn->rxPaused)
+            return;
+
+        if (!m_config.edgeTriggered) {
+            receivePacket(r, fd, SIZE_MAX);
+        } else {
+            if (conn && !conn->rxReady && receivePacket(r, fd, m_config.readBudget))
+                markRxReady(r, fd);
+        }
+    }
+}
+
+void TcpServer::markRxReady(Reactor& r, int fd) {
+    Connection* conn = findOwned(r, fd);
+    if (!conn)
         return;
+
+    m_stats.rxBudgetHits.fetch_add(1, std::memory_order_relaxed);
+    if (!conn->rxReady) {
+        conn->rxReady = true;
+        r.rxReady.push_back(fd);
     }
+}
+
+void TcpServer::serviceRxReady(Reactor& r) {
+    /* one budget per parked connection per iteration, round robin; new arrivals wait for the next round */
+    size_t n = r.rxReady.size();
+    while (n-- > 0) {
+        int fd = r.rxReady.front();
+        r.rxReady.pop_front();
+
+        /* entries of connections closed since they were parked are skipped */
+        Connection* conn = findOwned(r, fd);
+        if (!conn || !conn->rxReady)
+            continue;
+        conn->rxReady = false;
 
-    if (ev.events & EPOLLOUT)
-        flushPendingForFd(fd, 256);
+        /* backpressured: parked again when reads resume */
+        if (conn->rxPaused)
+            continue;
 
-    if (ev.events & EPOLLIN)
-        receivePacket(fd);
+        if (receivePacket(r, fd, m_config.readBudget))
+            markRxReady(r, fd);
+    }
 }
 
-void TcpServer::acceptConnection() {
-    while (true) {
+void TcpServer::acceptConnection(Reactor& r, int listenFd) {
+    /* bounded per wakeup so a storm cannot starve established clients; the listen socket is level-triggered */
+    for (int i = 0; i < m_config.acceptBudget; ++i) {
         sockaddr_in clientAddr{};
         socklen_t len = sizeof(clientAddr);
 
-        int fd = accept(m_sockFd, (sockaddr*)&clientAddr, &len);
+        int fd = accept4(listenFd, (sockaddr*)&clientAddr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        m_stats.syscalls.fetch_add(1, std::memory_order_relaxed);
         if (fd < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK)
-                break;
+                return;
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            if (onAcceptError(r, listenFd, errno))
+                continue;
+            return;
+        }
+
+        /* same caps as the main port; the slot travels with the fd to TlsServer */
+        if (listenFd == r.tlsSockFd) {
+            if (admitConnection(clientAddr))
+                m_tlsServer->handleTlsConnection(fd, {m_tlsAddr, clientAddr});
+            else
+                close(fd);
+            continue;
+        }
+
+        Connection* conn = openConnection(r, fd, clientAddr);
+        if (!conn)
             continue;
+
+        conn->interest = m_config.edgeTriggered ? (EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET)
+                                                : (EPOLLIN | EPOLLRDHUP);
+        addToEpoll(r.epFd, fd, conn->interest);
+
+        if (m_zeroCopy.load(std::memory_order_relaxed)) {
+            int on = 1;
+            if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0) {
+                conn->zeroCopy = std::make_unique<ZeroCopyState>();
+            } else if (m_zeroCopy.exchange(false)) {
+                LOG_WARN("TcpServer: SO_ZEROCOPY not supported errno={}, fallback to copy send", errno);
+            }
         }
+    }
 
-        setNonBlocking(fd);
-        addToEpoll(fd, EPOLLIN | EPOLLRDHUP);
+    m_stats.acceptBudgetHits.fetch_add(1, std::memory_order_relaxed);
+}
 
-        m_clients.emplace(fd, clientAddr);
-        m_rxBuffer.emplace(fd, std::vector<uint8_t>{});
+bool TcpServer::onAcceptError(Reactor& r, int listenFd, int err) {
+    m_stats.acceptErrors.fetch_add(1, std::memory_order_relaxed);
+    if (r.nowMs >= r.acceptWarnAtMs) {
+        LOG_WARN("TcpServer: accept4 failed errno={}, {} more since the last warning", err, r.acceptWarnSuppressed);
+        r.acceptWarnAtMs = r.nowMs + TCP_ACCEPT_WARN_MS;
+        r.acceptWarnSuppressed = 0;
+    } else {
+        r.acceptWarnSuppressed++;
     }
+
+    /* out of fds: the pending client would keep the listen fd readable forever. Give up the reserve,
+     * take the client and close it, so it sees a reset instead of a hang and the backlog drains */
+    if ((err == EMFILE || err == ENFILE) && r.reserveFd >= 0) {
+        close(r.reserveFd);
+        const int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        const int acceptErr = errno;
+        m_stats.syscalls.fetch_add(1, std::memory_order_relaxed);
+        if (fd >= 0) {
+            close(fd);
+            m_stats.acceptShed.fetch_add(1, std::memory_order_relaxed);
+        }
+        r.reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+        if (fd >= 0)
+            return true;
+        if (acceptErr == EAGAIN || acceptErr == EWOULDBLOCK)
+            return false;
+    }
+
+    /* out of memory, or the reserve is gone too: nothing to gain from retrying right away */
+    if (std::find(r.acceptPaused.begin(), r.acceptPaused.end(), listenFd) != r.acceptPaused.end())
+        return false;
+
+    m_stats.acceptPauses.fetch_add(1, std::memory_order_relaxed);
+    if (r.uring) {
+        /* the multishot has ended; with no idle timers the tick is not running yet */
+        if (r.acceptPaused.empty() && m_config.firstFrameTimeoutMs <= 0 && m_config.idleTimeoutMs <= 0)
+            armUringTimeout(r);
+    } else {
+        modEpoll(r.epFd, listenFd, 0);
+    }
+    r.acceptPaused.push_back(listenFd);
+    r.acceptResumeAtMs = r.nowMs + TCP_ACCEPT_BACKOFF_MS;
+    return false;
 }
 
-void TcpServer::receivePacket(int fd) {
-    if (isTlsClientHello(fd) && handoverToTls(fd))
+void TcpServer::resumeAccept(Reactor& r) {
+    if (r.acceptPaused.empty() || r.nowMs < r.acceptResumeAtMs || !m_running)
         return;
 
-    auto it = m_clients.find(fd);
-    if (it == m_clients.end())
-        return;
+    if (r.reserveFd < 0)
+        r.reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
 
-    auto& rxBuffer = m_rxBuffer[fd];
+    for (int listenFd : r.acceptPaused) {
+        if (r.uring)
+            armUringAccept(r, listenFd);
+        else
+            modEpoll(r.epFd, listenFd, EPOLLIN);
+    }
+    r.acceptPaused.clear();
+}
 
-    while (true) {
-        size_t oldSize = rxBuffer.size();
-        rxBuffer.resize(oldSize + TCP_RECV_CHUNK_SIZE);
+bool TcpServer::admitConnection(const sockaddr_in& clientAddr) {
+    /* reserve first, then check: concurrent reactors can never overshoot the cap */
+    const size_t open = m_connCount.fetch_add(1, std::memory_order_relaxed);
+    if (m_config.maxConnections > 0 && open >= m_config.maxConnections) {
+        m_connCount.fetch_sub(1, std::memory_order_relaxed);
+        m_stats.rejectedGlobal.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
 
-        ssize_t n = recv(fd, rxBuffer.data() + oldSize, TCP_RECV_CHUNK_SIZE, 0);
-        if (n > 0) {
-            rxBuffer.resize(oldSize + (size_t)n);
+    if (m_config.maxConnectionsPerIp > 0) {
+        std::lock_guard<std::mutex> lock(m_ipLock);
+        size_t& n = m_ipConns[clientAddr.sin_addr.s_addr];
+        if (n >= m_config.maxConnectionsPerIp) {
+            m_connCount.fetch_sub(1, std::memory_order_relaxed);
+            m_stats.rejectedPerIp.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        n++;
+    }
 
-            if (rxBuffer.size() > TCP_MAX_RX_BUFFER_SIZE) {
-                LOG_WARN("TCP Rx Buffer overflow fd={}", fd);
-                closeConnection(fd);
-                return;
-            }
+    m_stats.accepted.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
 
-            while (true) {
-                if (rxBuffer.size() < TCP_HEADER_SIZE)
-                    break;
+void TcpServer::releaseAdmission(const sockaddr_in& clientAddr) {
+    m_connCount.fetch_sub(1, std::memory_order_relaxed);
 
-                CommonPacketHeader hdr{};
-                std::memcpy(&hdr, rxBuffer.data(), TCP_HEADER_SIZE);
+    if (m_config.maxConnectionsPerIp > 0) {
+        std::lock_guard<std::mutex> lock(m_ipLock);
+        auto it = m_ipConns.find(clientAddr.sin_addr.s_addr);
+        if (it != m_ipConns.end() && --it->second == 0)
+            m_ipConns.erase(it);
+    }
+}
 
-                uint16_t bodyLen = ntohs(hdr.bodyLen);
-                if (bodyLen > TCP_MAX_BODY_LEN) {
-                    LOG_WARN("TCP framing: bodyLen too large ({}) fd={}", bodyLen, fd);
-                    closeConnection(fd);
-                    return;
-                }
+bool TcpServer::receivePacket(Reactor& r, int fd, size_t budget) {
+    Connection* conn = findOwned(r, fd);
+    if (!conn)
+        return false;
 
-                size_t frameLen = TCP_HEADER_SIZE + bodyLen;
-                if (rxBuffer.size() < frameLen)
-                    break;
+    /* decided once on the first readable bytes; an established TCP connection never peeks again */
+    if (conn->proto == ConnProto::UNKNOWN) {
+        conn->proto = sniffProtocol(fd);
+        if (conn->proto == ConnProto::TLS) {
+            handoverToTls(r, fd);
+            return false;
+        }
+        if (conn->proto == ConnProto::UNKNOWN)
+            return false;
+    }
 
-                std::vector<uint8_t> payload(
-                    rxBuffer.begin(), rxBuffer.begin() + frameLen);
+    auto& rxBuffer = conn->rxBuffer;
 
-                /* Need to be optimize */
-                rxBuffer.erase(rxBuffer.begin(), rxBuffer.begin() + frameLen);
+    /* returns true when the budget ran out before EAGAIN, i.e. the socket may still hold data */
+    for (size_t reads = 0; reads < budget; ++reads) {
+        uint8_t* dst = rxBuffer.prepare(TCP_RECV_CHUNK_SIZE);
+        if (!dst) {
+            LOG_WARN("TCP Rx Buffer overflow fd={}", fd);
+            closeConnection(r, fd);
+            return false;
+        }
 
-                auto pkt = std::make_unique<Packet>(
-                        fd, Protocol::TCP, std::move(payload), it->second, m_serverAddr);
+        ssize_t n = recv(fd, dst, rxBuffer.writable(), 0);
+        m_stats.syscalls.fetch_add(1, std::memory_order_relaxed);
+        if (n > 0) {
+            rxBuffer.commit((size_t)n);
 
-                {
-                    std::lock_guard<std::mutex> lock(m_rxLock);
-                    m_rxQueue.push(std::move(pkt));
-                }
-                m_cv.notify_one();
-            }
+            if (!drainFrames(r, fd, *conn))
+                return false;
         } else {
-            rxBuffer.resize(oldSize);
-
             if (n == 0) {
-                closeConnection(fd);
-                return;
+                closeConnection(r, fd);
+                return false;
             }
             if (errno == EAGAIN || errno == EWOULDBLOCK)
-                return;
+                return false;
 
-            closeConnection(fd);
-            return;
+            closeConnection(r, fd);
+            return false;
         }
     }
+
+    return true;
+}
+
+bool TcpServer::drainFrames(Reactor& r, int fd, Connection& conn) {
+    auto& rxBuffer = conn.rxBuffer;
+
+    while (true) {
+        if (rxBuffer.size() < TCP_HEADER_SIZE)
+            return true;
+
+        const uint8_t* frame = rxBuffer.data();
+
+        CommonPacketHeader hdr{};
+        std::memcpy(&hdr, frame, TCP_HEADER_SIZE);
+
+        uint16_t bodyLen = ntohs(hdr.bodyLen);
+        if (bodyLen > TCP_MAX_BODY_LEN) {
+            LOG_WARN("TCP framing: bodyLen too large ({}) fd={}", bodyLen, fd);
+            closeConnection(r, fd);
+            return false;
+        }
+
+        size_t frameLen = TCP_HEADER_SIZE + bodyLen;
+        if (rxBuffer.size() < frameLen)
+            return true;
+
+        if (hdr.sessionId != 0)
+            conn.sessionId = be64toh(hdr.sessionId);
+
+        /* the idle timer is not touched per frame, it checks lastRxMs when it fires */
+        conn.lastRxMs = r.nowMs;
+        if (!conn.framed) {
+            conn.framed = true;
+            armConnTimer(r, conn);
+        }
+
+        std::vector<uint8_t> payload(frame, frame + frameLen);
+        rxBuffer.consume(frameLen);
+
+        auto pkt = std::make_unique<Packet>(
+                fd, Protocol::TCP, std::move(payload), conn.addr, m_serverAddr);
+        pkt->setConnGen(conn.gen.load(std::memory_order_relaxed));
+
+        {
+            std::lock_guard<std::mutex> lock(m_rxLock);
+            m_rxQueue.push(std::move(pkt));
+        }
+        m_cv.notify_one();
+        m_stats.rxFrames.fetch_add(1, std::memory_order_relaxed);
+    }
 }
 
 void TcpServer::enqueueTx(std::unique_ptr<Packet> packet) {
-    if (!packet) return;
+    if (Connection* conn = pushTx(std::move(packet)))
+        scheduleTx(*conn);
+}
+
+void TcpServer::enqueueTxBatch(std::vector<std::unique_ptr<Packet>>& packets) {
+    if (packets.empty())
+        return;
+    m_stats.txBatches.fetch_add(1, std::memory_order_relaxed);
+
+    /* queue everything first so each reactor drains the whole batch on a single wakeup */
+    std::vector<Connection*> conns;
+    conns.reserve(packets.size());
+    for (auto& pkt : packets) {
+        if (Connection* conn = pushTx(std::move(pkt)))
+            conns.push_back(conn);
+    }
+    packets.clear();
+
+    std::vector<bool> kick(m_reactors.size(), false);
+    for (Connection* conn : conns) {
+        if (Reactor* r = linkTx(*conn))
+            kick[r->idx] = true;
+    }
+
+    for (size_t i = 0; i < kick.size(); ++i) {
+        if (kick[i])
+            kickTx(*m_reactors[i]);
+    }
+}
+
+TcpServer::Connection* TcpServer::pushTx(std::unique_ptr<Packet> packet) {
+    if (!packet) return nullptr;
 
     int fd = packet->getFd();
-    {
-        std::lock_guard<std::mutex> lock(m_txLock);
-        m_txQueue[fd].push_back(std::move(packet));
+    uint32_t gen = packet->getConnGen();
+
+    Connection* conn = m_conns.find(fd);
+    if (!conn || !getOwner(*conn)) {
+        LOG_WARN("TcpServer: drop tx, fd={} has no owner reactor", fd);
+        return nullptr;
+    }
+
+    if (gen != 0 && conn->gen.load(std::memory_order_acquire) != gen) {
+        m_stats.txStale.fetch_add(1, std::memory_order_relaxed);
+        LOG_WARN("TcpServer: drop stale tx, fd={} gen={} now gen={}",
+                 fd, gen, conn->gen.load(std::memory_order_relaxed));
+        return nullptr;
     }
 
+    /* no lock: a close racing with this push is caught by the gen check in popTx */
+    packet->setQueuedAt(monoNs());
+    conn->txQueuedBytes.fetch_add(packet->getPayload().size(), std::memory_order_relaxed);
+    conn->txQueue.push(packet.release());
+    m_stats.txEnqueued.fetch_add(1, std::memory_order_relaxed);
+    return conn;
+}
+
+TcpServer::Reactor* TcpServer::linkTx(Connection& conn) {
+    /* the first producer since the last drain links the connection, the rest only queue */
+    if (!TxHandoff<Connection>::claim(conn))
+        return nullptr;
+
+    Reactor* r = getOwner(conn);
+    if (!r) {
+        TxHandoff<Connection>::unclaim(conn);
+        return nullptr;
+    }
+
+    r->txReady.link(conn);
+    return r;
+}
+
+void TcpServer::scheduleTx(Connection& conn) {
+    if (Reactor* r = linkTx(conn))
+        kickTx(*r);
+}
+
+void TcpServer::kickTx(Reactor& r) {
+    if (!r.txReady.kick())
+        return;
+
     uint64_t v = 1;
-    write(m_txEventFd, &v, sizeof(v));
+    write(r.txEventFd, &v, sizeof(v));
+    m_stats.txKicks.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::unique_ptr<Packet> TcpServer::popTx(Connection& conn) {
+    /* queued bytes count whole payloads from enqueue (or retryTx) until they are popped again */
+    if (!conn.txRetry.empty()) {
+        auto pkt = std::move(conn.txRetry.front());
+        conn.txRetry.pop_front();
+        conn.txQueuedBytes.fetch_sub(pkt->getPayload().size(), std::memory_order_relaxed);
+        return pkt;
+    }
+
+    while (Packet* p = conn.txQueue.pop()) {
+        std::unique_ptr<Packet> pkt(p);
+        conn.txQueuedBytes.fetch_sub(pkt->getPayload().size(), std::memory_order_relaxed);
+
+        const uint32_t gen = pkt->getConnGen();
+        if (gen == 0 || gen == conn.gen.load(std::memory_order_relaxed))
+            return pkt;
+
+        m_stats.txStale.fetch_add(1, std::memory_order_relaxed);
+    }
+    return nullptr;
+}
+
+void TcpServer::retryTx(Connection& conn, std::unique_ptr<Packet> pkt) {
+    conn.txQueuedBytes.fetch_add(pkt->getPayload().size(), std::memory_order_relaxed);
+    conn.txRetry.push_front(std::move(pkt));
 }
 
-void TcpServer::flushAllPending(size_t budget) {
-    std::vector<int> fds;
-    {
-        std::lock_guard<std::mutex> lock(m_txLock);
-        for (auto& kv : m_txQueue)
-            if (!kv.second.empty())
-                fds.push_back(kv.first);
+void TcpServer::dropTxQueue(Connection& conn) {
+    while (auto pkt = popTx(conn)) {}
+}
+
+void TcpServer::updateBackpressure(Reactor& r, Connection& conn) {
+    if (m_config.txHighWatermark == 0)
+        return;
+
+    const size_t queued = conn.txQueuedBytes.load(std::memory_order_relaxed);
+    if (!conn.rxPaused && queued >= m_config.txHighWatermark) {
+        conn.rxPaused = true;
+        m_stats.rxPauses.fetch_add(1, std::memory_order_relaxed);
+    } else if (conn.rxPaused && queued <= m_config.txLowWatermark) {
+        conn.rxPaused = false;
+        m_stats.rxResumes.fetch_add(1, std::memory_order_relaxed);
+
+        /* no new edge comes for data that arrived while paused, so go read it */
+        if (m_config.edgeTriggered && !conn.rxReady) {
+            conn.rxReady = true;
+            r.rxReady.push_back(conn.fd);
+        }
+    } else {
+        return;
+    }
+
+    /* the session's shard holds its output while paused; reads alone only stop new requests */
+    m_rxRouter->handleTxBackpressure(conn.sessionId, conn.rxPaused);
+
+    if (!r.uring) {
+        setInterest(r, conn.fd, conn.txBlocked);
+        return;
     }
 
-    size_t used = 0;
-    for (int fd : fds) {
-        if (used >= budget) break;
-        used += flushPendingForFd(fd, budget - used);
+    /* io_uring has no read interest to drop: cancel the multishot recv and re-arm it on resume.
+     * An unsniffed connection waits on a poll instead; its completion leaves the recv to us while paused */
+    if (conn.proto != ConnProto::TCP)
+        return;
+    if (conn.rxPaused && conn.uring.recvArmed)
+        cancelUringRecv(r, conn);
+    else if (!conn.rxPaused && !conn.uring.recvArmed)
+        armUringRecv(r, conn.fd, conn.gen.load(std::memory_order_relaxed) & 0xFFFFFF);
+}
+
+void TcpServer::flushAllPending(Reactor& r) {
+    r.txReady.beginDrain();
+
+    while (Connection* conn = r.txReady.pop()) {
+        /* fd was closed and accepted again by another reactor since it was scheduled */
+        if (conn->owner.load(std::memory_order_acquire) != r.idx) {
+            scheduleTx(*conn);
+            continue;
+        }
+
+        updateBackpressure(r, *conn);
+        activateTx(r, *conn);
     }
 }
 
-size_t TcpServer::flushPendingForFd(int fd, size_t budget) {
-    size_t used = 0;
+void TcpServer::activateTx(Reactor& r, Connection& conn) {
+    /* a blocked connection rejoins on EPOLLOUT */
+    if (conn.txActive || conn.txBlocked)
+        return;
 
-    while (used < budget) {
-        std::unique_ptr<Packet> pkt;
-        {
-            std::lock_guard<std::mutex> lock(m_txLock);
-            auto it = m_txQueue.find(fd);
-            if (it == m_txQueue.end() || it->second.empty()) {
-                setInterest(fd, false);
-                return used;
+    conn.txActive = true;
+    r.txActive.emplace_back(&conn, conn.gen.load(std::memory_order_relaxed));
+}
+
+void TcpServer::runTxRound(Reactor& r) {
+    /* one deficit round robin pass: each backlogged connection gets txQuantum bytes of credit */
+    size_t n = r.txActive.size();
+    if (n == 0)
+        return;
+    m_stats.txRounds.fetch_add(1, std::memory_order_relaxed);
+
+    while (n-- > 0) {
+        auto [conn, gen] = r.txActive.front();
+        r.txActive.pop_front();
+
+        /* closed (and maybe reused) since it was activated */
+        if (!conn->txActive || conn->gen.load(std::memory_order_relaxed) != gen ||
+            conn->owner.load(std::memory_order_relaxed) != r.idx)
+            continue;
+
+        conn->txDeficit += m_config.txQuantum;
+
+        switch (flushPendingForFd(r, *conn)) {
+            case TxState::BACKLOGGED:
+                r.txActive.emplace_back(conn, gen);
+                break;
+
+            case TxState::IDLE:
+                conn->txActive = false;
+                conn->txDeficit = 0;
+                break;
+
+            case TxState::BLOCKED:
+                conn->txActive = false;
+                conn->txBlocked = true;
+                break;
+
+            case TxState::CLOSED:
+                continue;
+        }
+
+        updateBackpressure(r, *conn);
+    }
+}
+
+TcpServer::TxState TcpServer::flushPendingForFd(Reactor& r, Connection& conn) {
+    const int fd = conn.fd;
+
+    while (true) {
+        bool zeroCopy = false;
+        size_t total = 0;
+
+        /* gather what the deficit covers, up to TCP_MAX_TX_IOV packets, into one sendmsg */
+        while (r.txBatch.size() < (size_t)TCP_MAX_TX_IOV) {
+            auto pkt = popTx(conn);
+            if (!pkt)
+                break;
+
+            /* a large packet goes out alone with MSG_ZEROCOPY, small ones are gathered up to it */
+            const size_t left = pkt->getPayload().size() - pkt->getTxOffset();
+            const bool candidate = isZeroCopyCandidate(conn, *pkt);
+            if (total + left > conn.txDeficit || (candidate && !r.txBatch.empty())) {
+                retryTx(conn, std::move(pkt));
+                break;
+            }
+
+            total += left;
+            r.txBatch.push_back(std::move(pkt));
+            if (candidate) {
+                zeroCopy = true;
+                break;
             }
-            pkt = std::move(it->second.front());
-            it->second.pop_front();
         }
 
-        const auto& payload = pkt->getPayload();
+        /* nothing fits: either drained, or the head packet needs more credit next round */
+        if (r.txBatch.empty())
+            return hasPendingTx(r, fd) ? TxState::BACKLOGGED : TxState::IDLE;
+
+        r.txIov.clear();
+        for (auto& pkt : r.txBatch) {
+            const auto& payload = pkt->getPayload();
+            iovec iov{};
+            iov.iov_base = const_cast<uint8_t*>(payload.data()) + pkt->getTxOffset();
+            iov.iov_len = payload.size() - pkt->getTxOffset();
+            r.txIov.push_back(iov);
+        }
 
-        while (pkt->getTxOffset() < payload.size()) {
-            const uint8_t* p = payload.data() + pkt->getTxOffset();
-            size_t bytes = payload.size() - pkt->getTxOffset();
+        msghdr msg{};
+        msg.msg_iov = r.txIov.data();
+        msg.msg_iovlen = r.txIov.size();
+
+        /* iov limit hit with credit and data left: another sendmsg follows right away, let the kernel pack across it */
+        const bool more = !zeroCopy && r.txBatch.size() == (size_t)TCP_MAX_TX_IOV && total < conn.txDeficit &&
+                          (!conn.txRetry.empty() || !conn.txQueue.empty());
+        const int flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+        if (more)
+            m_stats.txMore.fetch_add(1, std::memory_order_relaxed);
+
+        bool pinned = zeroCopy;
+        ssize_t ret = sendmsg(fd, &msg, flags | (pinned ? MSG_ZEROCOPY : 0));
+        m_stats.syscalls.fetch_add(1, std::memory_order_relaxed);
+        if (ret < 0 && pinned && errno == ENOBUFS) {
+            /* optmem limit hit by pinned pages, this part goes out as a plain copy */
+            pinned = false;
+            ret = sendmsg(fd, &msg, flags);
+        }
 
-            ssize_t ret = send(fd, p, bytes, MSG_NOSIGNAL);
-            if (ret > 0) {
-                pkt->updateTxOffset(ret);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                requeueTx(r, fd, 0);
                 continue;
             }
 
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                std::lock_guard<std::mutex> lock(m_txLock);
-                m_txQueue[fd].push_front(std::move(pkt));
-                setInterest(fd, true);
-                return used + 1;
+                requeueTx(r, fd, 0);
+                setInterest(r, fd, true);
+                return TxState::BLOCKED;
             }
 
-            closeConnection(fd);
-            return used + 1;
+            r.txBatch.clear();
+            closeConnection(r, fd);
+            return TxState::CLOSED;
+        }
+
+        size_t frames = zeroCopy ? completeZeroCopySend(r, conn, fd, (size_t)ret, pinned)
+                                 : requeueTx(r, fd, (size_t)ret);
+        conn.txDeficit -= (size_t)ret;
+
+        m_stats.txCalls.fetch_add(1, std::memory_order_relaxed);
+        m_stats.txFrames.fetch_add(frames, std::memory_order_relaxed);
+        m_stats.txBytes.fetch_add(ret, std::memory_order_relaxed);
+
+        /* short write: the socket buffer is full, wait for EPOLLOUT */
+        if ((size_t)ret < total) {
+            m_stats.txPartial.fetch_add(1, std::memory_order_relaxed);
+            setInterest(r, fd, true);
+            return TxState::BLOCKED;
+        }
+    }
+}
+
+void TcpServer::recordResidency(Connection& conn, const Packet& pkt, uint64_t nowNs) {
+    const uint64_t us = (nowNs - pkt.getQueuedAt()) / 1000;
+
+    size_t bucket = 0;
+    while (bucket + 1 < TCP_RESIDENCY_BUCKETS && (us >> (bucket + 1)) != 0)
+        bucket++;
+    m_stats.residencyUs[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    /* single writer (the owner reactor), relaxed load/store is enough */
+    if (us > conn.residencyMaxUs.load(std::memory_order_relaxed))
+        conn.residencyMaxUs.store(us, std::memory_order_relaxed);
+    conn.residencySumUs.store(conn.residencySumUs.load(std::memory_order_relaxed) + us,
+                              std::memory_order_relaxed);
+    conn.residencyCount.store(conn.residencyCount.load(std::memory_order_relaxed) + 1,
+                              std::memory_order_relaxed);
+}
+
+size_t TcpServer::requeueTx(Reactor& r, int fd, size_t sent) {
+    /* advance tx offsets across the batch, then put the unsent tail back in front of the queue */
+    size_t done = 0;
+    for (auto& pkt : r.txBatch) {
+        size_t left = pkt->getPayload().size() - pkt->getTxOffset();
+        if (sent < left) {
+            pkt->updateTxOffset(sent);
+            break;
         }
+        sent -= left;
+        done++;
+    }
 
-        used++;
+    Connection* conn = findOwned(r, fd);
+    if (conn && done > 0) {
+        const uint64_t now = monoNs();
+        for (size_t i = 0; i < done; ++i)
+            recordResidency(*conn, *r.txBatch[i], now);
     }
 
-    setInterest(fd, hasPendingTx(fd));
-    return used;
+    if (conn && done < r.txBatch.size()) {
+        for (size_t i = r.txBatch.size(); i > done; --i)
+            retryTx(*conn, std::move(r.txBatch[i - 1]));
+    }
+
+    r.txBatch.clear();
+    return done;
 }
 
-bool TcpServer::hasPendingTx(int fd) {
-    std::lock_guard<std::mutex> lock(m_txLock);
-    auto it = m_txQueue.find(fd);
-    return it != m_txQueue.end() && !it->second.empty();
+bool TcpServer::isZeroCopyCandidate(const Connection& conn, const Packet& pkt) {
+    if (!conn.zeroCopy)
+        return false;
+
+    /* decided on the whole payload so a half sent packet keeps going through this path */
+    return pkt.getPayload().size() >= m_config.zeroCopyThreshold;
 }
 
-void TcpServer::closeConnection(int fd) {
-    epoll_ctl(m_epFd, EPOLL_CTL_DEL, fd, nullptr);
-    close(fd);
+size_t TcpServer::completeZeroCopySend(Reactor& r, Connection& conn, int fd, size_t sent, bool pinned) {
+    auto& zc = *conn.zeroCopy;
+    auto& pkt = r.txBatch.front();
+
+    /* every successful MSG_ZEROCOPY call consumes one notification id, even a short one */
+    if (pinned) {
+        zc.nextId++;
+        m_stats.zcBytes.fetch_add(sent, std::memory_order_relaxed);
+    } else if (pkt->getTxOffset() == 0) {
+        return requeueTx(r, fd, sent);
+    }
+
+    if (sent < pkt->getPayload().size() - pkt->getTxOffset())
+        return requeueTx(r, fd, sent);
+
+    /* fully queued, but the kernel still reads the payload pages until the last id completes */
+    pkt->updateTxOffset(sent);
+    recordResidency(conn, *pkt, monoNs());
+    zc.pending.emplace_back(zc.nextId - 1, std::move(pkt));
+    r.txBatch.clear();
+    return 1;
+}
+
+bool TcpServer::drainZeroCopyCompletions(Reactor& r, int fd) {
+    Connection* conn = findOwned(r, fd);
+    if (!conn || !conn->zeroCopy)
+        return false;
+
+    countZeroCopy(conn->zeroCopy->drain(fd));
+
+    /* only completions were queued: the connection itself is fine */
+    int err = 0;
+    socklen_t len = sizeof(err);
+    return getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0;
+}
+
+void TcpServer::reapZeroCopy(Reactor& r) {
+    if (r.zcGraves.empty() || r.nowMs < r.zcReapAtMs)
+        return;
+    r.zcReapAtMs = r.nowMs + TIMER_WHEEL_DEFAULT_TICK_MS;
+
+    const ZeroCopyCounts counts = r.zcGraves.reap(r.nowMs);
+    countZeroCopy(counts);
+    if (counts.aborted > 0)
+        LOG_WARN("TcpServer: reset {} closed connection(s) with zero-copy sends unacked after {} ms",
+                 counts.aborted, m_config.zeroCopyLingerMs);
+}
+
+void TcpServer::countZeroCopy(const ZeroCopyCounts& counts) {
+    m_stats.zcCompletions.fetch_add(counts.completions, std::memory_order_relaxed);
+    m_stats.zcDeferredCopies.fetch_add(counts.deferredCopies, std::memory_order_relaxed);
+    m_stats.zcAborted.fetch_add(counts.aborted, std::memory_order_relaxed);
+}
+
+void TcpServer::dumpStats() {
+    const uint64_t calls = m_stats.txCalls.load(std::memory_order_relaxed);
+    const uint64_t frames = m_stats.txFrames.load(std::memory_order_relaxed);
+
+    const uint64_t bytes = m_stats.txBytes.load(std::memory_order_relaxed);
+    const uint64_t zcBytes = m_stats.zcBytes.load(std::memory_order_relaxed);
+
+    const uint64_t syscalls = m_stats.syscalls.load(std::memory_order_relaxed);
+    const uint64_t rxFrames = m_stats.rxFrames.load(std::memory_order_relaxed);
+
+    LOG_TRACE("TcpServer io({}{}): syscalls={} rxFrames={} txFrames={} syscallsPerFrame={:.2f} "
+              "wakeups={} rxBudgetHits={} sniffs={}",
+              m_config.ioBackend == TcpIoBackend::IO_URING ? "io_uring" : "epoll",
+              m_config.edgeTriggered ? ",et" : "",
+              syscalls, rxFrames, frames,
+              (rxFrames + frames) ? (double)syscalls / (double)(rxFrames + frames) : 0.0,
+              m_stats.wakeups.load(std::memory_order_relaxed),
+              m_stats.rxBudgetHits.load(std::memory_order_relaxed),
+              m_stats.sniffs.load(std::memory_order_relaxed));
+
+    const uint64_t enqueued = m_stats.txEnqueued.load(std::memory_order_relaxed);
+    const uint64_t kicks = m_stats.txKicks.load(std::memory_order_relaxed);
+
+    LOG_TRACE("TcpServer tx: calls={} frames={} avgFrames={:.2f} bytes={} partial={} stale={} "
+              "enqueued={} kicks={} enqueuedPerKick={:.2f} batches={} more={} | "
+              "zerocopy: bytes={} copiedBytes={} completions={} deferredCopies={} parked={} aborted={}",
+              calls, frames, calls ? (double)frames / (double)calls : 0.0,
+              bytes, m_stats.txPartial.load(std::memory_order_relaxed),
+              m_stats.txStale.load(std::memory_order_relaxed),
+              enqueued, kicks, kicks ? (double)enqueued / (double)kicks : 0.0,
+              m_stats.txBatches.load(std::memory_order_relaxed),
+              m_stats.txMore.load(std::memory_order_relaxed),
+              zcBytes, bytes - zcBytes,
+              m_stats.zcCompletions.load(std::memory_order_relaxed),
+              m_stats.zcDeferredCopies.load(std::memory_order_relaxed),
+              m_stats.zcParked.load(std::memory_order_relaxed),
+              m_stats.zcAborted.load(std::memory_order_relaxed));
+
+    /* worst open connection by peak residency; slots are never freed, so the walk is safe */
+    int worstFd = -1;
+    uint64_t worstMax = 0, worstSum = 0, worstCount = 0;
+    size_t queuedBytes = 0, queuedPeak = 0;
+    m_conns.forEach([&](int fd, Connection& conn) {
+        if (conn.owner.load(std::memory_order_relaxed) < 0)
+            return;
+        const size_t queued = conn.txQueuedBytes.load(std::memory_order_relaxed);
+        queuedBytes += queued;
+        queuedPeak = std::max(queuedPeak, queued);
+
+        const uint64_t max = conn.residencyMaxUs.load(std::memory_order_relaxed);
+        if (worstFd < 0 || max > worstMax) {
+            worstFd = fd;
+            worstMax = max;
+            worstSum = conn.residencySumUs.load(std::memory_order_relaxed);
+            worstCount = conn.residencyCount.load(std::memory_order_relaxed);
+        }
+    });
+
+    LOG_TRACE("TcpServer drr(quantum={}): rounds={} residencyUs p50<={} p99<={} p999<={} | "
+              "worst fd={} avgUs={:.1f} maxUs={}",
+              m_config.txQuantum, m_stats.txRounds.load(std::memory_order_relaxed),
+              histQuantileUs(m_stats.residencyUs, TCP_RESIDENCY_BUCKETS, 0.50),
+              histQuantileUs(m_stats.residencyUs, TCP_RESIDENCY_BUCKETS, 0.99),
+              histQuantileUs(m_stats.residencyUs, TCP_RESIDENCY_BUCKETS, 0.999),
+              worstFd, worstCount ? (double)worstSum / (double)worstCount : 0.0, worstMax);
+
+    LOG_TRACE("TcpServer backpressure(high={} low={}): pauses={} resumes={} queuedBytes={} maxConnQueuedBytes={}",
+              m_config.txHighWatermark, m_config.txLowWatermark,
+              m_stats.rxPauses.load(std::memory_order_relaxed),
+              m_stats.rxResumes.load(std::memory_order_relaxed),
+              queuedBytes, queuedPeak);
+
+    LOG_TRACE("TcpServer timeouts(firstFrame={}ms idle={}ms): firstFrame={} idle={}",
+              m_config.firstFrameTimeoutMs, m_config.idleTimeoutMs,
+              m_stats.timeoutsFirstFrame.load(std::memory_order_relaxed),
+              m_stats.timeoutsIdle.load(std::memory_order_relaxed));
+
+    /* dumpStats runs on one thread (Core), so the previous sample needs no lock */
+    const uint64_t now = monoNs();
+    const uint64_t accepted = m_stats.accepted.load(std::memory_order_relaxed);
+    const double secs = m_statsAtNs ? (double)(now - m_statsAtNs) / 1e9 : 0.0;
+
+    LOG_TRACE("TcpServer accept(budget={} max={} perIp={}): open={} accepted={} ratePerSec={:.1f} "
+              "budgetHits={} errors={} shed={} pauses={} rejectedGlobal={} rejectedPerIp={}",
+              m_config.acceptBudget, m_config.maxConnections, m_config.maxConnectionsPerIp,
+              m_connCount.load(std::memory_order_relaxed), accepted,
+              secs > 0.0 ? (double)(accepted - m_statsAccepted) / secs : 0.0,
+              m_stats.acceptBudgetHits.load(std::memory_order_relaxed),
+              m_stats.acceptErrors.load(std::memory_order_relaxed),
+              m_stats.acceptShed.load(std::memory_order_relaxed),
+              m_stats.acceptPauses.load(std::memory_order_relaxed),
+              m_stats.rejectedGlobal.load(std::memory_order_relaxed),
+              m_stats.rejectedPerIp.load(std::memory_order_relaxed));
+
+    m_statsAccepted = accepted;
+    m_statsAtNs = now;
+}
+
+bool TcpServer::hasPendingTx(Reactor& r, int fd) {
+    Connection* conn = findOwned(r, fd);
+    return conn && (!conn->txRetry.empty() || !conn->txQueue.empty());
+}
+
+void TcpServer::closeConnection(Reactor& r, int fd) {
+    Connection* conn = findOwned(r, fd);
+    if (!conn)
+        return;
+
+    epoll_ctl(r.epFd, EPOLL_CTL_DEL, fd, nullptr);
+
+    /* in-flight io_uring requests pin the socket, shutdown makes them complete */
+    if (r.uring)
+        shutdown(fd, SHUT_RDWR);
+
+    /* the kernel may still read the pages of unacked zero-copy sends, they outlive the connection */
+    std::unique_ptr<ZeroCopyState> zc = std::move(conn->zeroCopy);
+
+    /* release before close: once the fd number is free another reactor may accept it */
+    releaseAdmission(conn->addr);
+    releaseConnection(r, *conn);
+
+    if (!zc) {
+        close(fd);
+        return;
+    }
+
+    const ZeroCopyCounts counts = r.zcGraves.park(fd, std::move(zc), r.nowMs + (uint64_t)m_config.zeroCopyLingerMs);
+    countZeroCopy(counts);
+    if (counts.closed == 0)
+        m_stats.zcParked.fetch_add(1, std::memory_order_relaxed);
+}
+
+TcpServer::Connection* TcpServer::openConnection(Reactor& r, int fd, const sockaddr_in& clientAddr) {
+    /* past a cap the socket is closed before any state is set up */
+    if (!admitConnection(clientAddr)) {
+        close(fd);
+        return nullptr;
+    }
+
+    Connection* conn = m_conns.acquire(fd);
+    if (!conn) {
+        LOG_WARN("TcpServer: fd={} exceeds connection table size {}", fd, m_conns.capacity());
+        releaseAdmission(clientAddr);
+        close(fd);
+        return nullptr;
+    }
 
-    m_clients.erase(fd);
-    m_rxBuffer.erase(fd);
+    conn->fd = fd;
+    conn->addr = clientAddr;
+    conn->rxBuffer = RxBuffer(TCP_MAX_RX_BUFFER_SIZE);
 
-    std::lock_guard<std::mutex> lock(m_txLock);
-    m_txQueue.erase(fd);
+    /* this reactor is the queue's consumer now; pushes that raced the last close are dropped */
+    dropTxQueue(*conn);
+    conn->gen.fetch_add(1, std::memory_order_acq_rel);
+    conn->owner.store(r.idx, std::memory_order_release);
+
+    conn->proto = m_config.tlsPort > 0 ? ConnProto::TCP : ConnProto::UNKNOWN;
+    conn->lastRxMs = r.nowMs;
+    armConnTimer(r, *conn);
+    return conn;
+}
+
+void TcpServer::releaseConnection(Reactor& r, Connection& conn) {
+    if (conn.rxPaused)
+        m_rxRouter->handleTxBackpressure(conn.sessionId, false);
+
+    conn.addr = sockaddr_in{};
+    conn.rxBuffer = RxBuffer(0);
+    conn.interest = 0;
+    conn.sessionId = 0;
+    conn.proto = ConnProto::UNKNOWN;
+    conn.rxReady = false;
+    conn.zeroCopy.reset();
+    conn.uring = UringConn{};
+    conn.txDeficit = 0;
+    conn.txActive = false;
+    conn.txBlocked = false;
+    conn.rxPaused = false;
+    conn.framed = false;
+    conn.lastRxMs = 0;
+    r.timers.cancel(conn);
+    conn.residencyMaxUs.store(0, std::memory_order_relaxed);
+    conn.residencySumUs.store(0, std::memory_order_relaxed);
+    conn.residencyCount.store(0, std::memory_order_relaxed);
+
+    /* queued packets go with the connection; a txReady entry left behind is skipped by owner */
+    conn.owner.store(-1, std::memory_order_release);
+    dropTxQueue(conn);
+}
+
+void TcpServer::armConnTimer(Reactor& r, Connection& conn) {
+    /* one timer per connection: the first-frame deadline until a frame arrives, the idle deadline after */
+    const int ms = conn.framed ? m_config.idleTimeoutMs : m_config.firstFrameTimeoutMs;
+    if (ms > 0)
+        r.timers.arm(conn, r.nowMs, (uint64_t)ms);
+    else
+        r.timers.cancel(conn);
+}
+
+void TcpServer::onConnTimer(Reactor& r, Connection& conn) {
+    const int fd = conn.fd;
+
+    if (!conn.framed) {
+        m_stats.timeoutsFirstFrame.fetch_add(1, std::memory_order_relaxed);
+        LOG_DEBUG("TcpServer: first frame timeout fd={}", fd);
+        closeConnection(r, fd);
+        return;
+    }
+
+    /* frames since arming pushed the deadline out; a backpressured connection is not reading, so it is not idle */
+    const uint64_t idleMs = (uint64_t)m_config.idleTimeoutMs;
+    if (conn.rxPaused || r.nowMs - conn.lastRxMs < idleMs) {
+        r.timers.arm(conn, conn.rxPaused ? r.nowMs : conn.lastRxMs, idleMs);
+        return;
+    }
+
+    m_stats.timeoutsIdle.fetch_add(1, std::memory_order_relaxed);
+    LOG_DEBUG("TcpServer: idle timeout fd={} sessionId={}", fd, conn.sessionId);
+    closeConnection(r, fd);
 }
 
-bool TcpServer::isTlsClientHello(int fd) {
-    uint8_t buf[5];
+void TcpServer::expireTimers(Reactor& r) {
+    r.timers.advance(r.nowMs, [this, &r](TimerNode& node) {
+        onConnTimer(r, static_cast<Connection&>(node));
+    });
+}
+
+TcpServer::ConnProto TcpServer::sniffProtocol(int fd) {
+    /* a TLS record opens with content type handshake (0x16) and major version 3; a frame opens with PacketVersion */
+    uint8_t buf[2];
     ssize_t n = recv(fd, buf, sizeof(buf), MSG_PEEK);
-    if (n < 5) return false;
-    return buf[0] == 0x16 && buf[1] == 0x03;
+    m_stats.syscalls.fetch_add(1, std::memory_order_relaxed);
+    m_stats.sniffs.fetch_add(1, std::memory_order_relaxed);
+
+    /* spurious wakeup, nothing to look at yet */
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return ConnProto::UNKNOWN;
+
+    /* EOF and errors count as TCP: the recv that follows sees them and closes */
+    return (n == 2 && buf[0] == 0x16 && buf[1] == 0x03) ? ConnProto::TLS : ConnProto::TCP;
 }
 
-bool TcpServer::handoverToTls(int fd) {
-    epoll_ctl(m_epFd, EPOLL_CTL_DEL, fd, nullptr);
+bool TcpServer::handoverToTls(Reactor& r, int fd) {
+    epoll_ctl(r.epFd, EPOLL_CTL_DEL, fd, nullptr);
 
-    auto it = m_clients.find(fd);
-    if (it == m_clients.end())
+    Connection* conn = findOwned(r, fd);
+    if (!conn)
         return false;
 
-    sockaddr_in clientAddr = it->second;
-    m_clients.erase(it);
-    m_rxBuffer.erase(fd);
+    /* the admission slot is not released here: TlsServer gives it back when the connection closes */
+    sockaddr_in clientAddr = conn->addr;
+    releaseConnection(r, *conn);
 
     if (m_tlsServer) {
         m_tlsServer->handleTlsConnection(fd, {m_serverAddr, clientAddr});
         return true;
     }
 
+    releaseAdmission(clientAddr);
     close(fd);
     return false;
 }
@@ -390,23 +1764,51 @@ void TcpServer::drainEventFd(int efd) {
     while (read(efd, &v, sizeof(v)) > 0) {}
 }
 
-bool TcpServer::addToEpoll(int fd, uint32_t events) {
+bool TcpServer::addToEpoll(int epFd, int fd, uint32_t events) {
     epoll_event ev{};
     ev.events = events;
     ev.data.fd = fd;
-    return epoll_ctl(m_epFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+    return epoll_ctl(epFd, EPOLL_CTL_ADD, fd, &ev) == 0;
 }
 
-bool TcpServer::modEpoll(int fd, uint32_t events) {
+bool TcpServer::modEpoll(int epFd, int fd, uint32_t events) {
     epoll_event ev{};
     ev.events = events;
     ev.data.fd = fd;
-    return epoll_ctl(m_epFd, EPOLL_CTL_MOD, fd, &ev) == 0;
+    return epoll_ctl(epFd, EPOLL_CTL_MOD, fd, &ev) == 0;
 }
 
-void TcpServer::setInterest(int fd, bool wantOut) {
-    uint32_t ev = EPOLLIN | EPOLLRDHUP;
+void TcpServer::setInterest(Reactor& r, int fd, bool wantOut) {
+    /* edge-triggered connections keep EPOLLOUT armed, an edge only fires when the socket drains */
+    if (m_config.edgeTriggered)
+        return;
+
+    Connection* conn = findOwned(r, fd);
+    if (!conn)
+        return;
+
+    uint32_t ev = EPOLLRDHUP;
+    if (!conn->rxPaused) ev |= EPOLLIN;
     if (wantOut) ev |= EPOLLOUT;
-    modEpoll(fd, ev);
+    if (ev == conn->interest)
+        return;
+
+    modEpoll(r.epFd, fd, ev);
+    conn->interest = ev;
+    m_stats.syscalls.fetch_add(1, std::memory_order_relaxed);
 }
 
+TcpServer::Connection* TcpServer::findOwned(Reactor& r, int fd) {
+    Connection* conn = m_conns.find(fd);
+    if (!conn || conn->owner.load(std::memory_order_relaxed) != r.idx)
+        return nullptr;
+    return conn;
+}
+
+TcpServer::Reactor* TcpServer::getOwner(const Connection& conn) {
+    int idx = conn.owner.load(std::memory_order_acquire);
+    if (idx < 0 || (size_t)idx >= m_reactors.size())
+        return nullptr;
+
+    return m_reactors[idx].get();
+}
@@ -1,5 +1,13 @@
 #pragma once
 
+#include "protocol/tcp/TcpConfig.h"
+#include "protocol/tcp/ZeroCopy.h"
+#include "util/FdSlab.h"
+#include "util/MpscQueue.h"
+#include "util/RxBuffer.h"
+#include "util/TimerWheel.h"
+#include "util/TxHandoff.h"
+
 #include <atomic>
 #include <condition_variable>
 #include <deque>
@@ -9,8 +17,10 @@
 #include <vector>
 #include <memory>
 
+#include <linux/time_types.h>
 #include <netinet/in.h>
 #include <sys/epoll.h>
+#include <sys/uio.h>
 
 class RxRouter;
 
@@ -20,13 +30,61 @@ class Packet;
 
 class TlsServer;
 
+class IoUring;
+
+#define TCP_RESIDENCY_BUCKETS (24)    // log2 microsecond buckets, the last one is open ended
+
+struct TcpIoStats {
+    std::atomic<uint64_t> syscalls{0};     // reactor syscalls on the data path (wait, recv, send, ctl)
+    std::atomic<uint64_t> rxFrames{0};
+    std::atomic<uint64_t> wakeups{0};      // epoll_wait returns with at least one event
+    std::atomic<uint64_t> rxBudgetHits{0}; // connections parked on the ready list with data left
+    std::atomic<uint64_t> sniffs{0};       // MSG_PEEK protocol sniffs, at most one per connection
+
+    std::atomic<uint64_t> txCalls{0};      // sendmsg calls that wrote something
+    std::atomic<uint64_t> txFrames{0};     // packets completed by those calls
+    std::atomic<uint64_t> txBytes{0};
+    std::atomic<uint64_t> txPartial{0};    // short writes that left a packet half sent
+
+    std::atomic<uint64_t> zcBytes{0};      // bytes handed to the kernel with MSG_ZEROCOPY
+    std::atomic<uint64_t> zcCompletions{0};
+    std::atomic<uint64_t> zcDeferredCopies{0};  // completions where the kernel fell back to copying
+    std::atomic<uint64_t> zcParked{0};     // closed with zero-copy sends in flight, fd kept until they complete
+    std::atomic<uint64_t> zcAborted{0};    // parked past zeroCopyLingerMs and reset
+
+    std::atomic<uint64_t> txStale{0};      // packets dropped because their fd now belongs to a newer connection
+    std::atomic<uint64_t> txEnqueued{0};
+    std::atomic<uint64_t> txKicks{0};      // tx eventfd writes, at most one per reactor drain
+    std::atomic<uint64_t> txRounds{0};     // deficit round robin rounds over the active ring
+    std::atomic<uint64_t> txBatches{0};    // enqueueTxBatch calls, one per shard loop pass with output
+    std::atomic<uint64_t> txMore{0};       // sendmsg calls flagged MSG_MORE
+
+    std::atomic<uint64_t> rxPauses{0};     // connections that crossed the tx high watermark
+    std::atomic<uint64_t> rxResumes{0};
+
+    std::atomic<uint64_t> timeoutsFirstFrame{0};  // closed before a complete frame arrived
+    std::atomic<uint64_t> timeoutsIdle{0};
+
+    std::atomic<uint64_t> accepted{0};
+    std::atomic<uint64_t> acceptBudgetHits{0};   // listen wakeups that left connections in the backlog
+    std::atomic<uint64_t> acceptErrors{0};       // EMFILE / ENFILE / ENOBUFS / ENOMEM
+    std::atomic<uint64_t> acceptShed{0};         // out of fds: accepted on the reserve fd and closed at once
+    std::atomic<uint64_t> acceptPauses{0};       // listen sockets taken off the poll set for TCP_ACCEPT_BACKOFF_MS
+    std::atomic<uint64_t> rejectedGlobal{0};     // closed at once, maxConnections reached
+    std::atomic<uint64_t> rejectedPerIp{0};      // closed at once, maxConnectionsPerIp reached
+
+    /* tx queue residency: enqueueTx until the kernel took the last byte */
+    std::atomic<uint64_t> residencyUs[TCP_RESIDENCY_BUCKETS]{};
+};
+
 class TcpServer {
 public:
     TcpServer(int port,
               RxRouter *rxRouter,
               int workerCount,
               ThreadManager *threadManager,
-              std::shared_ptr <TlsServer> tlsServer);
+              std::shared_ptr <TlsServer> tlsServer,
+              const TcpConfig &config);
 
     ~TcpServer();
 
@@ -36,70 +94,304 @@ public:
 
     void enqueueTx(std::unique_ptr <Packet> packet);
 
+    /* enqueueTx for a whole batch, with one eventfd write per reactor at the end */
+    void enqueueTxBatch(std::vector <std::unique_ptr<Packet>> &packets);
+
+    void dumpStats();
+
 private:
+    /* One sendmsg in a linked chain. Owned by the reactor until its completion arrives */
+    struct UringSend {
+        uint64_t seq{0};
+        int fd{-1};
+        uint32_t gen{0};
+        int res{0};
+        size_t total{0};
+        msghdr msg{};
+        std::vector <iovec> iov;
+        std::vector <std::unique_ptr<Packet>> packets;
+    };
+
+    /* io_uring state of one connection */
+    struct UringConn {
+        size_t sendsInFlight{0};
+        bool recvArmed{false};          // a multishot recv is outstanding; cancelled while rxPaused
+        std::vector <std::unique_ptr<UringSend>> sendsDone;   // completed links of the chain in flight
+    };
+
+    /* what the first bytes of a connection said; sniffed once, then fixed */
+    enum class ConnProto : uint8_t {
+        UNKNOWN,
+        TCP,
+        TLS,
+    };
+
+    /*
+     * One slot of m_conns, reused with the fd. Shard workers push into txQueue and put the
+     * connection on its owner's txReady list (MpscNode); everything else belongs to the owner
+     * reactor. Packets whose gen no longer matches are dropped, so a reused fd never sends
+     * what was queued for the previous connection. The TimerNode sits on the owner's wheel.
+     */
+    struct Connection : MpscNode, TimerNode {
+        int fd{-1};
+        std::atomic<uint32_t> gen{0};   // bumped on every accept of this fd
+        std::atomic<int> owner{-1};     // reactor index, -1 when closed
+
+        sockaddr_in addr{};
+        RxBuffer rxBuffer{0};
+        uint32_t interest{0};           // epoll mask currently registered
+        uint64_t sessionId{0};          // last non-zero sessionId seen in a frame header
+        ConnProto proto{ConnProto::UNKNOWN};
+        bool rxReady{false};            // parked on the reactor's rxReady list
+        bool framed{false};             // a complete frame arrived: the timer is an idle timer now
+        uint64_t lastRxMs{0};           // last complete frame, checked when the idle timer fires
+
+        std::unique_ptr <ZeroCopyState> zeroCopy;   // null unless SO_ZEROCOPY is on
+        UringConn uring;
+
+        MpscQueue <Packet> txQueue;                       // owns the queued packets
+        std::deque<std::unique_ptr < Packet>> txRetry;    // reactor only: pushed back, sent before txQueue
+        std::atomic<bool> txScheduled{false};             // on a reactor's txReady list
+        std::atomic<size_t> txQueuedBytes{0};             // payload bytes in txQueue + txRetry
+
+        /* backpressure, reactor only: reads stop above txHighWatermark until the queue drains */
+        bool rxPaused{false};
+
+        /* deficit round robin, reactor only */
+        size_t txDeficit{0};
+        bool txActive{false};           // on the reactor's txActive ring
+        bool txBlocked{false};          // socket buffer full, waiting for EPOLLOUT
+
+        /* tx queue residency of this connection, read by dumpStats */
+        std::atomic<uint64_t> residencyMaxUs{0};
+        std::atomic<uint64_t> residencySumUs{0};
+        std::atomic<uint64_t> residencyCount{0};
+    };
+
+    /* outcome of one flushPendingForFd pass */
+    enum class TxState {
+        IDLE,        // queue drained
+        BACKLOGGED,  // deficit used up, more to send next round
+        BLOCKED,     // socket buffer full
+        CLOSED,
+    };
+
+    /* One epoll loop. Each reactor owns its listen socket (SO_REUSEPORT) and the connections it accepted */
+    struct Reactor {
+        int idx{0};
+        int sockFd{-1};
+        int tlsSockFd{-1};              // reactor 0 only, with TcpConfig::tlsPort
+        int epFd{-1};
+        int txEventFd{-1};
+
+        /* edge-triggered mode: connections that used up their read budget and still have data */
+        std::deque<int> rxReady;
+
+        /* connections with queued packets, one txEventFd write per drain */
+        TxHandoff <Connection> txReady;
+
+        /* egress scheduler: backlogged connections in round robin order, tagged with gen */
+        std::deque<std::pair<Connection *, uint32_t>> txActive;
+
+        /* first-frame and idle deadlines of the owned connections; nowMs is taken once per loop pass */
+        TimerWheel timers;
+        uint64_t nowMs{0};
+
+        /* closed connections waiting for their zero-copy completions, polled once per tick */
+        ZeroCopyGraveyard zcGraves;
+        uint64_t zcReapAtMs{0};
+
+        /* accept under fd or memory exhaustion: reserveFd is given up to shed one pending client;
+         * listen fds in acceptPaused wait out a backoff off the poll set */
+        int reserveFd{-1};
+        std::vector<int> acceptPaused;
+        uint64_t acceptResumeAtMs{0};
+        uint64_t acceptWarnAtMs{0};
+        uint64_t acceptWarnSuppressed{0};
+
+        /* flush scratch, only touched by the reactor thread */
+        std::vector <std::unique_ptr<Packet>> txBatch;
+        std::vector <iovec> txIov;
+
+        /* io_uring backend. uring is declared last so the ring goes away before the buffers it points into */
+        std::unordered_map<uint64_t, std::unique_ptr<UringSend>> uringSends;
+        uint64_t uringSendSeq{0};
+        uint64_t uringEventValue{0};
+        __kernel_timespec uringTick{};      // periodic IORING_OP_TIMEOUT that drives the wheel
+        std::unique_ptr <IoUring> uring;    // null when the reactor runs on epoll
+    };
+
     bool init();
 
+    bool initReactor(Reactor &r);
+
+    int openListenSocket(const sockaddr_in &addr);
+
     void deinit();
 
+    void startReactors();
+
+    void runReactor(Reactor &r);
+
+    bool initUring(Reactor &r);
+
+    void runUringReactor(Reactor &r);
+
+    void handleUringCqe(Reactor &r, uint64_t userData, int res, uint32_t flags);
+
+    void armUringAccept(Reactor &r, int listenFd);
+
+    void armUringEventFd(Reactor &r);
+
+    void armUringTimeout(Reactor &r);
+
+    void armUringPoll(Reactor &r, int fd, uint32_t gen);
+
+    void armUringRecv(Reactor &r, int fd, uint32_t gen);
+
+    void cancelUringRecv(Reactor &r, Connection &conn);
+
+    void onUringAccept(Reactor &r, int fd, sockaddr_in clientAddr);
+
+    void onUringRecv(Reactor &r, int fd, uint32_t gen, int res, uint32_t flags);
+
+    void onUringSend(Reactor &r, uint64_t seq, int res);
+
+    void finishUringSends(Reactor &r, int fd, Connection &conn);
+
+    void flushUringPending(Reactor &r);
+
+    void submitUringSends(Reactor &r, int fd, Connection &conn);
+
     void startWorkers();
 
     void stopWorker();
 
     void processPacket();
 
-    void handleEvent(const epoll_event &ev);
+    void handleEvent(Reactor &r, const epoll_event &ev);
+
+    void acceptConnection(Reactor &r, int listenFd);
+
+    bool onAcceptError(Reactor &r, int listenFd, int err);
+
+    void resumeAccept(Reactor &r);
+
+    bool admitConnection(const sockaddr_in &clientAddr);
+
+    void releaseAdmission(const sockaddr_in &clientAddr);
+
+    bool receivePacket(Reactor &r, int fd, size_t budget);
+
+    void markRxReady(Reactor &r, int fd);
 
-    void handleTxEvent();
+    void serviceRxReady(Reactor &r);
 
-    void acceptConnection();
+    bool drainFrames(Reactor &r, int fd, Connection &conn);
 
-    void receivePacket(int fd);
+    void closeConnection(Reactor &r, int fd);
 
-    void closeConnection(int fd);
+    bool hasPendingTx(Reactor &r, int fd);
 
-    bool hasPendingTx(int fd);
+    Connection *pushTx(std::unique_ptr <Packet> packet);
 
-    void flushAllPending(size_t budget);
+    Reactor *linkTx(Connection &conn);
 
-    size_t flushPendingForFd(int fd, size_t budget);
+    void scheduleTx(Connection &conn);
 
-    bool isTlsClientHello(int fd);
+    void kickTx(Reactor &r);
 
-    bool handoverToTls(int fd);
+    std::unique_ptr <Packet> popTx(Connection &conn);
+
+    void retryTx(Connection &conn, std::unique_ptr <Packet> pkt);
+
+    void dropTxQueue(Connection &conn);
+
+    void updateBackpressure(Reactor &r, Connection &conn);
+
+    void flushAllPending(Reactor &r);
+
+    void activateTx(Reactor &r, Connection &conn);
+
+    void runTxRound(Reactor &r);
+
+    TxState flushPendingForFd(Reactor &r, Connection &conn);
+
+    void recordResidency(Connection &conn, const Packet &pkt, uint64_t nowNs);
+
+    size_t requeueTx(Reactor &r, int fd, size_t sent);
+
+    bool isZeroCopyCandidate(const Connection &conn, const Packet &pkt);
+
+    size_t completeZeroCopySend(Reactor &r, Connection &conn, int fd, size_t sent, bool pinned);
+
+    bool drainZeroCopyCompletions(Reactor &r, int fd);
+
+    void reapZeroCopy(Reactor &r);
+
+    void countZeroCopy(const ZeroCopyCounts &counts);
+
+    ConnProto sniffProtocol(int fd);
+
+    bool handoverToTls(Reactor &r, int fd);
 
     bool setNonBlocking(int fd);
 
     void drainEventFd(int efd);
 
-    bool addToEpoll(int fd, uint32_t events);
+    bool addToEpoll(int epFd, int fd, uint32_t events);
 
-    bool modEpoll(int fd, uint32_t events);
+    bool modEpoll(int epFd, int fd, uint32_t events);
 
-    void setInterest(int fd, bool wantOut);
+    void setInterest(Reactor &r, int fd, bool wantOut);
+
+    void armConnTimer(Reactor &r, Connection &conn);
+
+    void onConnTimer(Reactor &r, Connection &conn);
+
+    void expireTimers(Reactor &r);
+
+    Connection *openConnection(Reactor &r, int fd, const sockaddr_in &clientAddr);
+
+    void releaseConnection(Reactor &r, Connection &conn);
+
+    Connection *findOwned(Reactor &r, int fd);
+
+    Reactor *getOwner(const Connection &conn);
 
     int m_port;
-    int m_sockFd{-1};
-    int m_epFd{-1};
-    int m_txEventFd{-1};
 
     sockaddr_in m_serverAddr{};
+    sockaddr_in m_tlsAddr{};
 
     RxRouter *m_rxRouter;
     ThreadManager *m_threadManager;
     std::shared_ptr <TlsServer> m_tlsServer;
 
+    TcpConfig m_config;
+
     std::atomic<bool> m_running{false};
     int m_workerCount;
 
-    std::unordered_map<int, sockaddr_in> m_clients;
-    std::unordered_map<int, std::vector<uint8_t>> m_rxBuffer;
+    std::atomic<bool> m_zeroCopy{false};
+
+    std::vector <std::unique_ptr<Reactor>> m_reactors;
+
+    /* per-fd connection state, shared by all reactors; each slot is owned by the reactor that accepted it */
+    FdSlab <Connection> m_conns;
+
+    TcpIoStats m_stats;
+
+    /* admission control, shared by all reactors */
+    std::atomic<size_t> m_connCount{0};
+    std::mutex m_ipLock;
+    std::unordered_map<uint32_t, size_t> m_ipConns;   // client IPv4 -> open connections, only with maxConnectionsPerIp
+
+    /* accept rate between two dumpStats calls */
+    uint64_t m_statsAccepted{0};
+    uint64_t m_statsAtNs{0};
 
     std::mutex m_rxLock;
     std::condition_variable m_cv;
     std::queue <std::unique_ptr<Packet>> m_rxQueue;
-
-    std::mutex m_txLock;
-    std::unordered_map<int, std::deque<std::unique_ptr < Packet>>>
-    m_txQueue;
 };
-
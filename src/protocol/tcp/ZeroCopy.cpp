@@ -0,0 +1,104 @@
+#include "ZeroCopy.h"
+#include "packet/Packet.h"
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+
+#define ZC_ERRQUEUE_CTRL_SIZE (CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in)))
+
+ZeroCopyCounts ZeroCopyState::drain(int fd) {
+    ZeroCopyCounts counts;
+
+    while (true) {
+        uint8_t ctrl[ZC_ERRQUEUE_CTRL_SIZE];
+        msghdr msg{};
+        msg.msg_control = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE) < 0)
+            break;
+
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR)
+                continue;
+
+            const auto *serr = reinterpret_cast<const sock_extended_err *>(CMSG_DATA(cmsg));
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+
+            /* ids [ee_info, ee_data] are done, release every packet up to ee_data (wraps at 2^32) */
+            const uint32_t hi = serr->ee_data;
+            while (!pending.empty() && (int32_t) (hi - pending.front().first) >= 0)
+                pending.pop_front();
+
+            counts.completions += hi - serr->ee_info + 1;
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                counts.deferredCopies++;
+        }
+    }
+    return counts;
+}
+
+ZeroCopyGraveyard::~ZeroCopyGraveyard() {
+    clear();
+}
+
+ZeroCopyCounts ZeroCopyGraveyard::park(int fd, std::unique_ptr<ZeroCopyState> zc, uint64_t deadlineMs) {
+    /* the peer sees the close now; queued data still goes out and is acked as usual */
+    shutdown(fd, SHUT_RDWR);
+
+    ZeroCopyCounts counts;
+    if (zc)
+        counts = zc->drain(fd);
+
+    if (!zc || zc->pending.empty()) {
+        close(fd);
+        counts.closed++;
+        return counts;
+    }
+
+    m_graves.push_back(Grave{fd, deadlineMs, std::move(zc)});
+    return counts;
+}
+
+ZeroCopyCounts ZeroCopyGraveyard::reap(uint64_t nowMs) {
+    ZeroCopyCounts counts;
+
+    for (size_t i = 0; i < m_graves.size();) {
+        Grave &g = m_graves[i];
+
+        const ZeroCopyCounts drained = g.zc->drain(g.fd);
+        counts.completions += drained.completions;
+        counts.deferredCopies += drained.deferredCopies;
+
+        if (g.zc->pending.empty()) {
+            close(g.fd);
+            counts.closed++;
+        } else if (nowMs >= g.deadlineMs) {
+            abort(g.fd);
+            counts.aborted++;
+        } else {
+            ++i;
+            continue;
+        }
+
+        g = std::move(m_graves.back());
+        m_graves.pop_back();
+    }
+    return counts;
+}
+
+void ZeroCopyGraveyard::clear() {
+    /* packets are freed only after the reset has dropped the kernel's references */
+    for (auto &g : m_graves)
+        abort(g.fd);
+    m_graves.clear();
+}
+
+void ZeroCopyGraveyard::abort(int fd) {
+    linger lg{1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    close(fd);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+
+class Packet;
+
+/* what one drain or reap pass did; the caller adds it to its stats */
+struct ZeroCopyCounts {
+    uint64_t completions{0};
+    uint64_t deferredCopies{0};  // completions where the kernel fell back to copying
+    uint64_t closed{0};          // parked fds closed after their last completion
+    uint64_t aborted{0};         // parked fds reset at their deadline
+};
+
+/* MSG_ZEROCOPY sends of one connection. A packet stays here until the error queue reports its id */
+struct ZeroCopyState {
+    uint32_t nextId{0};
+    std::deque<std::pair<uint32_t, std::unique_ptr<Packet>>> pending;
+
+    /* reads every notification queued on fd's error queue and releases the packets it covers */
+    ZeroCopyCounts drain(int fd);
+};
+
+/*
+ * Closed connections whose zero-copy pages the kernel may still read.
+ *
+ *  park : shutdown(fd) -> [ fd | deadline | pending packets ]
+ *  reap : drain error queue -> all ids done ? close(fd) : deadline ? SO_LINGER{1,0} + close(fd)
+ *
+ * Freeing a pending packet lets the allocator hand its pages to someone else while
+ * a retransmit can still read them, and closing the fd loses the error queue that
+ * says when that stops. So the fd stays open, shut down, until the last id
+ * completes. A peer that never acks is reset at the deadline: the reset purges
+ * the write queue, the kernel's only remaining reference to the pages.
+ * Single threaded, one per reactor.
+ */
+class ZeroCopyGraveyard {
+public:
+    ZeroCopyGraveyard() = default;
+
+    ZeroCopyGraveyard(const ZeroCopyGraveyard &) = delete;
+
+    ZeroCopyGraveyard &operator=(const ZeroCopyGraveyard &) = delete;
+
+    /* resets and closes whatever is still parked */
+    ~ZeroCopyGraveyard();
+
+    /* takes over fd; closes it at once when nothing is pending */
+    ZeroCopyCounts park(int fd, std::unique_ptr<ZeroCopyState> zc, uint64_t deadlineMs);
+
+    ZeroCopyCounts reap(uint64_t nowMs);
+
+    void clear();
+
+    bool empty() const { return m_graves.empty(); }
+
+    size_t size() const { return m_graves.size(); }
+
+private:
+    struct Grave {
+        int fd{-1};
+        uint64_t deadlineMs{0};
+        std::unique_ptr<ZeroCopyState> zc;
+    };
+
+    static void abort(int fd);
+
+    std::vector<Grave> m_graves;
+};
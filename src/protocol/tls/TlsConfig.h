@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+
+enum class TlsEngine {
+    SOCKET,       // SSL bound to the fd, SSL_read / SSL_write on the reactor
+    MEMORY_BIO,   // reactor moves ciphertext, record crypto and framing on the connection's tls_worker;
+                  // kTLS sessions stay on SOCKET, the kernel already does their crypto
+};
+
+enum class TlsBalance {
+    LEAST_CONNECTIONS,   // reactor with the fewest open connections
+    HASH,                // hash of the client address and port, no shared counters
+};
+
+struct TlsConfig {
+    int reactorCount = 1;                  // epoll loops serving TLS connections, handed over fds are spread across them
+    TlsBalance balance = TlsBalance::LEAST_CONNECTIONS;
+    TlsEngine engine = TlsEngine::SOCKET;  // MEMORY_BIO needs tls workers, else it stays SOCKET
+    int handshakeWorkers = 0;              // threads running SSL_accept off the reactor, 0 = on the reactor
+    int handshakeTimeoutMs = 10 * 1000;    // handover until SSL_accept completes, 0 disables
+    int firstFrameTimeoutMs = 10 * 1000;   // handshake done until the first complete frame, 0 disables
+    int idleTimeoutMs = 120 * 1000;        // no complete frame for this long closes the connection, 0 disables
+    bool sessionTickets = true;            // stateless resumption, ticket keys live in memory only
+    int ticketKeyRotationSec = 3600;       // a new ticket encryption key this often; older keys still decrypt
+    int sessionLifetimeSec = 7200;         // how long a ticket or cached session can be resumed
+    size_t sessionCacheSize = 0;           // server-side session cache entries (session-id resumption), 0 = off
+    bool ktls = false;                     // kernel TLS record crypto when the tls module is present, else user space
+    size_t txRecordSize = 16 * 1024;       // queued frames gathered per SSL_write, i.e. plaintext per TLS record (max 16 KB)
+    size_t txHighWatermark = 4 * 1024 * 1024;  // unsent tx bytes that pause reads and the session's shard, 0 disables
+    size_t txLowWatermark = 1024 * 1024;       // both resume once the connection drains to this
+    bool releaseBuffers = true;            // idle sessions give back OpenSSL record buffers, rx buffers and memory BIOs
+    size_t sslPoolSize = 256;              // closed SSL objects kept per reactor and reset with SSL_clear, 0 = SSL_new each time
+    bool memoryAccounting = true;          // count OpenSSL's heap through CRYPTO_set_mem_functions, shown in dumpStats
+};
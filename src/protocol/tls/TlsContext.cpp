@@ -1,8 +1,28 @@
 #include "TlsContext.h"
+#include "TlsMemory.h"
 #include "util/Logger.h"
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/core_names.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define TLS_SESSION_ID_CONTEXT "nf-server"
+
+static uint64_t nowSec() {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 TlsContext::TlsContext()
         : m_ctx(nullptr) {
@@ -22,7 +42,13 @@ void TlsContext::logOpenSslError(const char *msg) {
     LOG_FATAL("{}: {}", msg, buf);
 }
 
-bool TlsContext::init(const std::string &certPath, const std::string &keyPath) {
+bool TlsContext::init(const std::string &certPath, const std::string &keyPath, const TlsConfig &config) {
+    m_config = config;
+
+    /* has to precede OpenSSL's first allocation */
+    if (m_config.memoryAccounting && !TlsMemory::install())
+        LOG_WARN("TlsContext: OpenSSL allocated before init, its heap is not accounted");
+
     if (OPENSSL_init_ssl(0, nullptr) == 0) {
         LOG_FATAL("OPENSSL_init_ssl failed");
         return false;
@@ -42,6 +68,14 @@ bool TlsContext::init(const std::string &certPath, const std::string &keyPath) {
 
     SSL_CTX_set_min_proto_version(m_ctx, TLS1_2_VERSION);
 
+    /* TlsServer gathers frames into a reused staging buffer: a write returns once its records are out,
+     * and a retry after WANT_WRITE may come from a copy of the unsent bytes */
+    SSL_CTX_set_mode(m_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    /* the 16 KB+ read and write record buffers are freed whenever they drain */
+    if (m_config.releaseBuffers)
+        SSL_CTX_set_mode(m_ctx, SSL_MODE_RELEASE_BUFFERS);
+
     if (SSL_CTX_use_certificate_file(m_ctx, certPath.c_str(), SSL_FILETYPE_PEM) <= 0) {
         logOpenSslError("SSL_CTX_use_certificate_file failed");
         SSL_CTX_free(m_ctx);
@@ -63,9 +97,182 @@ bool TlsContext::init(const std::string &certPath, const std::string &keyPath) {
         return false;
     }
 
+    setupSessions();
+    setupKtls();
+
     LOG_INFO("TLS context loaded successfully (cert={}, key={})",
              certPath.c_str(), keyPath.c_str());
 
     return true;
 }
 
+
+/* the tls ULP loads on demand; on an unconnected socket it fails with ENOTCONN when present, ENOENT when not */
+static bool kernelTlsAvailable() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return false;
+
+    int rc = setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls"));
+    int err = errno;
+    close(fd);
+    return rc == 0 || err == ENOTCONN;
+}
+
+void TlsContext::setupKtls() {
+    if (!m_config.ktls)
+        return;
+
+    if (!kernelTlsAvailable()) {
+        LOG_WARN("TlsContext: kernel tls module not available, record crypto stays in user space");
+        return;
+    }
+
+    SSL_CTX_set_options(m_ctx, SSL_OP_ENABLE_KTLS);
+    m_ktls = true;
+    LOG_INFO("TlsContext: kernel TLS enabled for supported ciphers");
+}
+
+void TlsContext::setupSessions() {
+    SSL_CTX_set_app_data(m_ctx, this);
+    SSL_CTX_set_session_id_context(m_ctx, (const unsigned char *) TLS_SESSION_ID_CONTEXT,
+                                   sizeof(TLS_SESSION_ID_CONTEXT) - 1);
+    SSL_CTX_set_timeout(m_ctx, (long) m_config.sessionLifetimeSec);
+
+    if (m_config.sessionCacheSize > 0) {
+        SSL_CTX_set_session_cache_mode(m_ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(m_ctx, (long) m_config.sessionCacheSize);
+    } else {
+        SSL_CTX_set_session_cache_mode(m_ctx, SSL_SESS_CACHE_OFF);
+    }
+
+    if (!m_config.sessionTickets) {
+        SSL_CTX_set_options(m_ctx, SSL_OP_NO_TICKET);
+        return;
+    }
+
+    /* keys are made here rather than by OpenSSL so they rotate; a restart invalidates every ticket */
+    {
+        std::lock_guard<std::mutex> lock(m_ticketLock);
+        if (!rotateTicketKeysLocked(nowSec())) {
+            LOG_WARN("TlsContext: ticket key generation failed, session tickets disabled");
+            SSL_CTX_set_options(m_ctx, SSL_OP_NO_TICKET);
+            return;
+        }
+    }
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(m_ctx, &TlsContext::ticketKeyCallback);
+}
+
+bool TlsContext::rotateTicketKeysLocked(uint64_t now) {
+    const uint64_t rotation = (uint64_t) std::max(m_config.ticketKeyRotationSec, 1);
+
+    if (!m_ticketKeys.empty() && now - m_ticketKeys.front().createdSec < rotation)
+        return true;
+
+    TicketKey key;
+    if (RAND_bytes(key.name, sizeof(key.name)) != 1 ||
+        RAND_priv_bytes(key.aesKey, sizeof(key.aesKey)) != 1 ||
+        RAND_priv_bytes(key.hmacKey, sizeof(key.hmacKey)) != 1)
+        return false;
+    key.createdSec = now;
+    const bool first = m_ticketKeys.empty();
+    m_ticketKeys.push_front(key);
+
+    /* a key issues tickets for one rotation period, and those stay valid for the session lifetime */
+    const uint64_t keep = rotation + (uint64_t) std::max(m_config.sessionLifetimeSec, 0);
+    while (m_ticketKeys.size() > 1 && now - m_ticketKeys.back().createdSec >= keep)
+        m_ticketKeys.pop_back();
+
+    if (!first) {
+        m_ticketRotations.fetch_add(1, std::memory_order_relaxed);
+        LOG_INFO("TlsContext: session ticket key rotated, {} key(s) active", m_ticketKeys.size());
+    }
+    return true;
+}
+
+int TlsContext::ticketKeyCallback(SSL *ssl, unsigned char *keyName, unsigned char *iv,
+                                  EVP_CIPHER_CTX *cipherCtx, EVP_MAC_CTX *macCtx, int enc) {
+    auto *self = static_cast<TlsContext *>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+    return self ? self->onTicketKey(SSL_version(ssl) == TLS1_3_VERSION, keyName, iv, cipherCtx, macCtx, enc) : -1;
+}
+
+int TlsContext::onTicketKey(bool tls13, unsigned char *keyName, unsigned char *iv,
+                            EVP_CIPHER_CTX *cipherCtx, EVP_MAC_CTX *macCtx, int enc) {
+    /* runs on the reactor or a handshake worker; rotation happens lazily on the first ticket past the period */
+    std::lock_guard<std::mutex> lock(m_ticketLock);
+    rotateTicketKeysLocked(nowSec());
+
+    const TicketKey *key = nullptr;
+    bool current = false;
+
+    if (enc) {
+        key = &m_ticketKeys.front();
+        current = true;
+        if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) != 1)
+            return -1;
+        std::memcpy(keyName, key->name, sizeof(key->name));
+    } else {
+        for (const auto &k : m_ticketKeys) {
+            if (std::memcmp(keyName, k.name, sizeof(k.name)) == 0) {
+                key = &k;
+                current = (&k == &m_ticketKeys.front());
+                break;
+            }
+        }
+        if (!key) {
+            m_ticketsUnknown.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        }
+    }
+
+    OSSL_PARAM params[] = {
+            OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, (void *) key->hmacKey, sizeof(key->hmacKey)),
+            OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *) "SHA256", 0),
+            OSSL_PARAM_construct_end()
+    };
+    if (EVP_MAC_CTX_set_params(macCtx, params) != 1)
+        return -1;
+
+    if (enc) {
+        if (EVP_EncryptInit_ex(cipherCtx, EVP_aes_256_cbc(), nullptr, key->aesKey, iv) != 1)
+            return -1;
+        m_ticketsIssued.fetch_add(1, std::memory_order_relaxed);
+        return 1;
+    }
+
+    if (EVP_DecryptInit_ex(cipherCtx, EVP_aes_256_cbc(), nullptr, key->aesKey, iv) != 1)
+        return -1;
+
+    if (!current)
+        m_ticketsRenewed.fetch_add(1, std::memory_order_relaxed);
+    else
+        m_ticketsAccepted.fetch_add(1, std::memory_order_relaxed);
+
+    /* 2: accept and issue a fresh ticket. Needed for an older key, and for TLS 1.3 whose tickets
+     * are single use on the client: without a new one every other reconnect is a full handshake */
+    return (!current || tls13) ? 2 : 1;
+}
+
+void TlsContext::dumpStats() {
+    if (!m_ctx)
+        return;
+
+    size_t keys;
+    {
+        std::lock_guard<std::mutex> lock(m_ticketLock);
+        keys = m_ticketKeys.size();
+    }
+
+    LOG_TRACE("TlsContext tickets(enabled={} rotation={}s lifetime={}s): keys={} rotations={} issued={} accepted={} renewed={} unknownKey={}",
+              m_config.sessionTickets, m_config.ticketKeyRotationSec, m_config.sessionLifetimeSec, keys,
+              m_ticketRotations.load(std::memory_order_relaxed),
+              m_ticketsIssued.load(std::memory_order_relaxed),
+              m_ticketsAccepted.load(std::memory_order_relaxed),
+              m_ticketsRenewed.load(std::memory_order_relaxed),
+              m_ticketsUnknown.load(std::memory_order_relaxed));
+
+    LOG_TRACE("TlsContext cache(size={}): entries={} hits={} misses={} timeouts={} full={}",
+              m_config.sessionCacheSize,
+              SSL_CTX_sess_number(m_ctx), SSL_CTX_sess_hits(m_ctx), SSL_CTX_sess_misses(m_ctx),
+              SSL_CTX_sess_timeouts(m_ctx), SSL_CTX_sess_cache_full(m_ctx));
+}
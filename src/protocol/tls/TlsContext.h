@@ -1,6 +1,11 @@
 #pragma once
 
+#include "protocol/tls/TlsConfig.h"
 #include <string>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
 #include <openssl/ssl.h>
 
 class TlsContext {
@@ -9,13 +14,48 @@ public:
 
     ~TlsContext();
 
-    bool init(const std::string &certPath, const std::string &keyPath);
+    bool init(const std::string &certPath, const std::string &keyPath, const TlsConfig &config = TlsConfig{});
 
     SSL_CTX *get() const { return m_ctx; }
 
+    bool ktlsEnabled() const { return m_ktls; }
+
+    void dumpStats();
+
 private:
+    /* session ticket key: AES-256-CBC + HMAC-SHA256, identified in the ticket by name */
+    struct TicketKey {
+        unsigned char name[16];
+        unsigned char aesKey[32];
+        unsigned char hmacKey[32];
+        uint64_t createdSec{0};
+    };
+
     void logOpenSslError(const char *msg);
 
+    void setupSessions();
+
+    void setupKtls();
+
+    static int ticketKeyCallback(SSL *ssl, unsigned char *keyName, unsigned char *iv,
+                                 EVP_CIPHER_CTX *cipherCtx, EVP_MAC_CTX *macCtx, int enc);
+
+    int onTicketKey(bool tls13, unsigned char *keyName, unsigned char *iv,
+                    EVP_CIPHER_CTX *cipherCtx, EVP_MAC_CTX *macCtx, int enc);
+
+    bool rotateTicketKeysLocked(uint64_t nowSec);
+
     SSL_CTX *m_ctx;
+    TlsConfig m_config;
+    bool m_ktls{false};
+
+    /* front encrypts new tickets, the rest only decrypt until their tickets expire */
+    std::mutex m_ticketLock;
+    std::deque <TicketKey> m_ticketKeys;
+
+    std::atomic<uint64_t> m_ticketRotations{0};
+    std::atomic<uint64_t> m_ticketsIssued{0};
+    std::atomic<uint64_t> m_ticketsAccepted{0};
+    std::atomic<uint64_t> m_ticketsRenewed{0};   // decrypted with an older key, reissued under the current one
+    std::atomic<uint64_t> m_ticketsUnknown{0};   // key already retired: full handshake
 };
-
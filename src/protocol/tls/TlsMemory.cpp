@@ -0,0 +1,99 @@
+#include "TlsMemory.h"
+
+#include <openssl/crypto.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#define TLS_MEM_HEADER_SIZE (16)   // keeps the block max_align_t aligned
+
+static std::atomic<bool> s_installed{false};
+static std::atomic<uint64_t> s_bytesInUse{0};
+static std::atomic<uint64_t> s_peakBytes{0};
+static std::atomic<uint64_t> s_liveAllocs{0};
+static std::atomic<uint64_t> s_totalAllocs{0};
+
+static void countAlloc(size_t bytes) {
+    const uint64_t inUse = s_bytesInUse.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    s_liveAllocs.fetch_add(1, std::memory_order_relaxed);
+    s_totalAllocs.fetch_add(1, std::memory_order_relaxed);
+
+    /* the peak only moves while the heap grows past it, so the CAS is rare */
+    uint64_t peak = s_peakBytes.load(std::memory_order_relaxed);
+    while (inUse > peak && !s_peakBytes.compare_exchange_weak(peak, inUse, std::memory_order_relaxed)) {}
+}
+
+static void countFree(size_t bytes) {
+    s_bytesInUse.fetch_sub(bytes, std::memory_order_relaxed);
+    s_liveAllocs.fetch_sub(1, std::memory_order_relaxed);
+}
+
+static size_t blockSize(void *ptr) {
+    size_t bytes;
+    std::memcpy(&bytes, (uint8_t *) ptr - TLS_MEM_HEADER_SIZE, sizeof(bytes));
+    return bytes;
+}
+
+static void *tlsMalloc(size_t num, const char *, int) {
+    auto *base = (uint8_t *) std::malloc(num + TLS_MEM_HEADER_SIZE);
+    if (!base)
+        return nullptr;
+
+    std::memcpy(base, &num, sizeof(num));
+    countAlloc(num);
+    return base + TLS_MEM_HEADER_SIZE;
+}
+
+static void tlsFree(void *ptr, const char *, int) {
+    if (!ptr)
+        return;
+
+    countFree(blockSize(ptr));
+    std::free((uint8_t *) ptr - TLS_MEM_HEADER_SIZE);
+}
+
+static void *tlsRealloc(void *ptr, size_t num, const char *file, int line) {
+    if (!ptr)
+        return tlsMalloc(num, file, line);
+
+    /* CRYPTO_realloc frees on zero and returns nullptr */
+    if (num == 0) {
+        tlsFree(ptr, file, line);
+        return nullptr;
+    }
+
+    const size_t old = blockSize(ptr);
+    auto *base = (uint8_t *) std::realloc((uint8_t *) ptr - TLS_MEM_HEADER_SIZE, num + TLS_MEM_HEADER_SIZE);
+    if (!base)
+        return nullptr;
+
+    std::memcpy(base, &num, sizeof(num));
+    countFree(old);
+    countAlloc(num);
+    return base + TLS_MEM_HEADER_SIZE;
+}
+
+bool TlsMemory::install() {
+    if (s_installed.load(std::memory_order_acquire))
+        return true;
+
+    if (CRYPTO_set_mem_functions(tlsMalloc, tlsRealloc, tlsFree) == 0)
+        return false;
+
+    s_installed.store(true, std::memory_order_release);
+    return true;
+}
+
+bool TlsMemory::installed() {
+    return s_installed.load(std::memory_order_acquire);
+}
+
+TlsMemoryStats TlsMemory::stats() {
+    TlsMemoryStats st;
+    st.bytesInUse = s_bytesInUse.load(std::memory_order_relaxed);
+    st.peakBytes = s_peakBytes.load(std::memory_order_relaxed);
+    st.liveAllocs = s_liveAllocs.load(std::memory_order_relaxed);
+    st.totalAllocs = s_totalAllocs.load(std::memory_order_relaxed);
+    return st;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct TlsMemoryStats {
+    uint64_t bytesInUse{0};    // OpenSSL heap currently allocated, headers excluded
+    uint64_t peakBytes{0};
+    uint64_t liveAllocs{0};
+    uint64_t totalAllocs{0};
+};
+
+/*
+ * Accounting for OpenSSL's heap.
+ *
+ *  CRYPTO_malloc / realloc / free -> [ size header | block ] on the libc heap
+ *
+ * install() must run before OpenSSL allocates anything (OpenSSL refuses the
+ * switch afterwards), i.e. before the first OPENSSL_init_ssl. Every TLS object
+ * in the process is counted: contexts, sessions, SSL objects and their record
+ * buffers, in-process clients included.
+ */
+class TlsMemory {
+public:
+    static bool install();
+
+    static bool installed();
+
+    static TlsMemoryStats stats();
+};
@@ -1,28 +1,40 @@
 #include "TlsServer.h"
+#include "TlsMemory.h"
 #include "util/Logger.h"
 #include "packet/Packet.h"
 #include "ingress/RxRouter.h"
 #include "util/ThreadManager.h"
 
+#include <openssl/err.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/eventfd.h>
 #include <sys/epoll.h>
+#include <sys/socket.h>
 
+#include <algorithm>
 #include <cstring>
+#include <string>
+#include <endian.h>
 
 #define TLS_HEADER_SIZE        (sizeof(CommonPacketHeader)) // 8 Byte
 #define TLS_MAX_BODY_LEN       (64 * 1024) // 64 KB
 #define TLS_RECV_CHUNK_SIZE    (4096)
 #define TLS_MAX_RX_BUFFER_SIZE (TLS_HEADER_SIZE + TLS_MAX_BODY_LEN)
 #define TLS_MAX_EVENTS         (64)
+#define TLS_MAX_HANDSHAKE_WORKERS (64)
+#define TLS_MAX_REACTORS       (64)
+#define TLS_CIPHER_RECV_SIZE   (64 * 1024)   // MEMORY_BIO: one recv per readable event
+#define TLS_CRYPTO_RX_INFLIGHT (256 * 1024)  // MEMORY_BIO: undecrypted bytes per connection before reads pause
 
 TlsServer::TlsServer(SSL_CTX* ctx,
                      RxRouter* rxRouter,
                      int workerCount,
-                     ThreadManager* threadManager)
+                     ThreadManager* threadManager,
+                     const TlsConfig& config)
     : m_ctx(ctx),
+      m_config(config),
       m_workerCount(workerCount),
       m_threadManager(threadManager),
       m_rxRouter(rxRouter) {
@@ -34,63 +46,188 @@ TlsServer::~TlsServer() {
 }
 
 bool TlsServer::init() {
-    m_stopEventFd     = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
-    m_handoverEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
-    m_txEventFd       = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
-    m_epFd            = epoll_create1(0);
+    /* a record carries at most 16 KB of plaintext, a bigger stage would only be split again */
+    m_config.txRecordSize = std::clamp<size_t>(m_config.txRecordSize, 1, SSL3_RT_MAX_PLAIN_LENGTH);
 
-    if (m_epFd < 0 || m_stopEventFd < 0 ||
-        m_handoverEventFd < 0 || m_txEventFd < 0) {
+    if (m_config.txLowWatermark > m_config.txHighWatermark) {
+        LOG_WARN("TlsServer: txLowWatermark {} above txHighWatermark {}, clamped",
+                 m_config.txLowWatermark, m_config.txHighWatermark);
+        m_config.txLowWatermark = m_config.txHighWatermark;
+    }
+
+    const int reactorCount = std::min(std::max(1, m_config.reactorCount), TLS_MAX_REACTORS);
+    for (int i = 0; i < reactorCount; ++i) {
+        auto reactor = std::make_unique<Reactor>();
+        reactor->idx = i;
+
+        if (!initReactor(*reactor)) {
+            LOG_ERROR("TlsServer: reactor {} init failed errno={}", i, errno);
+            return false;
+        }
+        m_reactors.push_back(std::move(reactor));
+    }
+
+    if (m_config.engine == TlsEngine::MEMORY_BIO) {
+        if (m_workerCount > 0) {
+            for (int i = 0; i < m_workerCount; ++i) {
+                auto w = std::make_unique<CryptoWorker>();
+                w->idx = i;
+                w->txStage.reserve(m_config.txRecordSize);
+                m_cryptoWorkers.push_back(std::move(w));
+            }
+            for (auto& r : m_reactors)
+                r->cipherScratch.resize(TLS_CIPHER_RECV_SIZE);
+        } else {
+            LOG_WARN("TlsServer: memory BIO engine needs tls workers, record crypto stays on the reactor");
+        }
+    }
+
+    const int workers = std::min(std::max(0, m_config.handshakeWorkers), TLS_MAX_HANDSHAKE_WORKERS);
+    for (int i = 0; i < workers; ++i) {
+        auto w = std::make_unique<HandshakeWorker>();
+        w->idx = i;
+        w->epFd = epoll_create1(0);
+        w->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (w->epFd < 0 || w->eventFd < 0) {
+            LOG_WARN("TlsServer: handshake worker {} init failed errno={}, handshakes stay on the reactor", i, errno);
+            if (w->epFd >= 0) close(w->epFd);
+            if (w->eventFd >= 0) close(w->eventFd);
+            m_hsWorkers.clear();
+            break;
+        }
+
+        addToEpoll(w->epFd, w->eventFd, EPOLLIN);
+        m_hsWorkers.push_back(std::move(w));
+    }
+
+    /* the context, certificate and OpenSSL's own tables; dumpStats charges what grows past this to connections */
+    m_opensslBaseline = TlsMemory::stats().bytesInUse;
+
+    LOG_INFO("TlsServer: {} reactor(s), {} handshake worker(s), {} engine", m_reactors.size(), m_hsWorkers.size(),
+             m_cryptoWorkers.empty() ? "socket" : "memory-bio");
+    return true;
+}
+
+bool TlsServer::initReactor(Reactor& r) {
+    r.epFd             = epoll_create1(0);
+    r.stopEventFd      = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    r.handoverEventFd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    r.txEventFd        = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    r.handshakeEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    r.cryptoEventFd    = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (r.epFd < 0 || r.stopEventFd < 0 || r.handoverEventFd < 0 ||
+        r.txEventFd < 0 || r.handshakeEventFd < 0 || r.cryptoEventFd < 0) {
         return false;
     }
 
-    addToEpoll(m_stopEventFd, EPOLLIN);
-    addToEpoll(m_handoverEventFd, EPOLLIN);
-    addToEpoll(m_txEventFd, EPOLLIN);
+    addToEpoll(r.epFd, r.stopEventFd, EPOLLIN);
+    addToEpoll(r.epFd, r.handoverEventFd, EPOLLIN);
+    addToEpoll(r.epFd, r.txEventFd, EPOLLIN);
+    addToEpoll(r.epFd, r.handshakeEventFd, EPOLLIN);
+    addToEpoll(r.epFd, r.cryptoEventFd, EPOLLIN);
+
+    r.txStage.reserve(m_config.txRecordSize);
     return true;
 }
 
 void TlsServer::deinit() {
-    for (auto& kv : m_sslMap)
-        SSL_free(kv.second);
-
-    m_sslMap.clear();
-    m_addrMap.clear();
-    m_rxBuffer.clear();
+    m_conns.forEach([this](int, Connection& conn) {
+        if (conn.ssl)
+            SSL_free(conn.ssl);
+        conn.ssl = nullptr;
+        conn.open = false;
+        conn.crypto = false;
+        dropTxQueue(conn);
+    });
+
+    for (auto& r : m_reactors) {
+        for (SSL* ssl : r->sslPool)
+            SSL_free(ssl);
+        r->sslPool.clear();
+
+        if (r->epFd >= 0) close(r->epFd);
+        if (r->stopEventFd >= 0) close(r->stopEventFd);
+        if (r->handoverEventFd >= 0) close(r->handoverEventFd);
+        if (r->txEventFd >= 0) close(r->txEventFd);
+        if (r->handshakeEventFd >= 0) close(r->handshakeEventFd);
+        if (r->cryptoEventFd >= 0) close(r->cryptoEventFd);
+    }
+    m_reactors.clear();
 
-    if (m_epFd >= 0) close(m_epFd);
-    if (m_stopEventFd >= 0) close(m_stopEventFd);
-    if (m_handoverEventFd >= 0) close(m_handoverEventFd);
-    if (m_txEventFd >= 0) close(m_txEventFd);
+    for (auto& w : m_hsWorkers) {
+        close(w->epFd);
+        close(w->eventFd);
+    }
+    m_hsWorkers.clear();
 }
 
 void TlsServer::start() {
     m_running = true;
     startWorkers();
+    startHandshakeWorkers();
+    startReactors();
+
+    if (!m_reactors.empty())
+        runReactor(*m_reactors[0]);
+}
 
+void TlsServer::startReactors() {
+    /* reactor 0 runs on the caller thread (tls_reactor) */
+    for (size_t i = 1; i < m_reactors.size(); ++i) {
+        m_threadManager->addThread(
+            "tls_reactor_" + std::to_string(i),
+            std::bind(&TlsServer::runReactor, this, std::ref(*m_reactors[i])),
+            std::bind(&TlsServer::stopReact, this));
+    }
+}
+
+void TlsServer::runReactor(Reactor& r) {
     epoll_event events[TLS_MAX_EVENTS];
 
     while (m_running) {
-        int n = epoll_wait(m_epFd, events, TLS_MAX_EVENTS, -1);
+        int n = epoll_wait(r.epFd, events, TLS_MAX_EVENTS, r.timers.nextTimeoutMs(TimerWheel::nowMs()));
         if (n < 0) {
             if (errno == EINTR) continue;
             break;
         }
+
+        r.nowMs = TimerWheel::nowMs();
         for (int i = 0; i < n; ++i)
-            handleEvent(events[i]);
+            handleEvent(r, events[i]);
+
+        /* after the batch: a handed over fd may reuse the number of one closed above, whose event may still be queued in it */
+        if (r.handoverPending) {
+            r.handoverPending = false;
+            processHandoverQueue(r);
+        }
+
+        r.timers.advance(r.nowMs, [this, &r](TimerNode& node) {
+            onConnTimer(r, static_cast<Connection&>(node));
+        });
     }
 
-    processHandoverQueue();
+    processHandoverQueue(r);
 }
 
 void TlsServer::stopReact() {
     m_running = false;
     m_cv.notify_all();
     uint64_t v = 1;
-    write(m_stopEventFd, &v, sizeof(v));
+    for (auto& r : m_reactors)
+        write(r->stopEventFd, &v, sizeof(v));
+    for (auto& w : m_hsWorkers)
+        stopHandshakeWorker(*w);
+    for (auto& w : m_cryptoWorkers)
+        stopCryptoWorker(*w);
 }
 
 void TlsServer::startWorkers() {
+    if (!m_cryptoWorkers.empty()) {
+        startCryptoWorkers();
+        return;
+    }
+
     for (int i = 0; i < m_workerCount; ++i) {
         m_threadManager->addThread(
             "tls_worker_" + std::to_string(i),
@@ -121,51 +258,75 @@ void TlsServer::processPacket() {
     }
 }
 
-void TlsServer::handleEvent(const epoll_event& ev) {
+void TlsServer::handleEvent(Reactor& r, const epoll_event& ev) {
     int fd = ev.data.fd;
 
-    if (fd == m_stopEventFd)     return handleStopEvent();
-    if (fd == m_handoverEventFd) return handleHandoverEvent();
-    if (fd == m_txEventFd)       return handleTxEvent();
+    if (fd == r.stopEventFd)      return handleStopEvent(r);
+    if (fd == r.handoverEventFd)  return handleHandoverEvent(r);
+    if (fd == r.txEventFd)        return handleTxEvent(r);
+    if (fd == r.handshakeEventFd) return handleHandshakeDoneEvent(r);
+    if (fd == r.cryptoEventFd)    return handleCryptoEvent(r);
 
-    if (ev.events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
-        handleClose(fd);
+    Connection* conn = findOwned(r, fd);
+    if (!conn)
+        return;
+
+    if (ev.events & (EPOLLERR | EPOLLHUP)) {
+        handleClose(r, fd, CloseReason::ERROR);
+        return;
+    }
+    if (ev.events & EPOLLRDHUP) {
+        handleClose(r, fd, CloseReason::PEER);
         return;
     }
 
     if (ev.events & EPOLLOUT)
-        flushPendingForFd(fd, 256);
+        flushPendingForFd(r, fd, 256);
 
-    if (!isHandshakeDone(fd)) {
-        handleHandshake(fd);
+    /* the flush may have closed it */
+    if (!conn->open)
+        return;
+
+    if (ev.events & EPOLLOUT)
+        updateBackpressure(r, *conn);
+
+    /* the worker owns the SSL now, the reactor only reads ciphertext */
+    if (conn->crypto.load(std::memory_order_relaxed)) {
+        if (ev.events & EPOLLIN)
+            readCipher(r, fd, *conn);
+        return;
+    }
+
+    if (!SSL_is_init_finished(conn->ssl)) {
+        handleHandshake(r, fd, *conn);
         return;
     }
 
     if (ev.events & EPOLLIN)
-        receivePacket(fd);
+        receivePacket(r, fd, *conn);
 }
 
-void TlsServer::handleStopEvent() {
-    drainEventFd(m_stopEventFd);
+void TlsServer::handleStopEvent(Reactor& r) {
+    drainEventFd(r.stopEventFd);
     m_running = false;
     m_cv.notify_all();
 }
 
-void TlsServer::handleHandoverEvent() {
-    drainEventFd(m_handoverEventFd);
-    processHandoverQueue();
+void TlsServer::handleHandoverEvent(Reactor& r) {
+    drainEventFd(r.handoverEventFd);
+    r.handoverPending = true;
 }
 
-void TlsServer::handleTxEvent() {
-    drainEventFd(m_txEventFd);
-    flushAllPending(256);
+void TlsServer::handleTxEvent(Reactor& r) {
+    drainEventFd(r.txEventFd);
+    flushAllPending(r, 256);
 }
 
-void TlsServer::processHandoverQueue() {
+void TlsServer::processHandoverQueue(Reactor& r) {
     std::queue<HandoverItem> q;
     {
-        std::lock_guard<std::mutex> lock(m_handoverLock);
-        q.swap(m_handoverQueue);
+        std::lock_guard<std::mutex> lock(r.handoverLock);
+        q.swap(r.handoverQueue);
     }
 
     while (!q.empty()) {
@@ -174,211 +335,1284 @@ void TlsServer::processHandoverQueue() {
 
         int fd = item.fd;
 
-        SSL* ssl = SSL_new(m_ctx);
+        Connection* conn = m_conns.acquire(fd);
+        if (!conn) {
+            LOG_WARN("TlsServer: fd={} exceeds connection table size {}", fd, m_conns.capacity());
+            r.connCount.fetch_sub(1, std::memory_order_relaxed);
+            releaseAdmission(item.connInfo.second);
+            close(fd);
+            continue;
+        }
+
+        SSL* ssl = newSsl(r);
         if (!ssl) {
+            r.connCount.fetch_sub(1, std::memory_order_relaxed);
+            releaseAdmission(item.connInfo.second);
             close(fd);
             continue;
         }
 
+        /* a recycled SSL still holds the previous connection's BIOs, SSL_set_fd frees them */
         SSL_set_accept_state(ssl);
         SSL_set_fd(ssl, fd);
 
-        m_sslMap.emplace(fd, ssl);
-        m_addrMap.emplace(fd, item.connInfo);
-        m_rxBuffer.emplace(fd, std::vector<uint8_t>{});
+        conn->fd = fd;
+        conn->ssl = ssl;
+        conn->addr = item.connInfo;
+        conn->rxBuffer = RxBuffer(TLS_MAX_RX_BUFFER_SIZE);
+        conn->interest = EPOLLIN | EPOLLRDHUP;
+        conn->owner.store(r.idx, std::memory_order_relaxed);
+        if (!m_cryptoWorkers.empty())
+            conn->cryptoWorker = (int)(m_cryptoNext++ % m_cryptoWorkers.size());
+
+        /* pushes that raced the last close of this fd are dropped */
+        dropTxQueue(*conn);
+        conn->gen.fetch_add(1, std::memory_order_acq_rel);
+        conn->open.store(true, std::memory_order_release);
+
+        conn->acceptedMs = r.nowMs;
+        conn->lastRxMs = r.nowMs;
+        if (!m_hsWorkers.empty()) {
+            offloadHandshake(fd, *conn);
+            continue;
+        }
 
-        addToEpoll(fd, EPOLLIN | EPOLLRDHUP);
+        armConnTimer(r, *conn);
+        addToEpoll(r.epFd, fd, conn->interest);
     }
 }
 
-bool TlsServer::isHandshakeDone(int fd) const {
-    auto it = m_sslMap.find(fd);
-    return it != m_sslMap.end() &&
-           SSL_is_init_finished(it->second);
+TlsServer::Connection* TlsServer::findOwned(Reactor& r, int fd) {
+    Connection* conn = m_conns.find(fd);
+    if (!conn || !conn->open || conn->owner.load(std::memory_order_relaxed) != r.idx)
+        return nullptr;
+    return conn;
+}
+
+TlsServer::Reactor& TlsServer::ownerOf(const Connection& conn) {
+    return *m_reactors[(size_t)conn.owner.load(std::memory_order_acquire)];
+}
+
+TlsServer::Reactor& TlsServer::pickReactor(const std::pair<sockaddr_in, sockaddr_in>& connInfo) {
+    if (m_reactors.size() == 1)
+        return *m_reactors[0];
+
+    if (m_config.balance == TlsBalance::HASH) {
+        /* fibonacci hash of the client address and port; connInfo is {local, peer} */
+        const sockaddr_in& peer = connInfo.second;
+        const uint64_t key = ((uint64_t)peer.sin_addr.s_addr << 16) | peer.sin_port;
+        return *m_reactors[(size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) % m_reactors.size()];
+    }
+
+    /* least connections, scanned from a rotating start so ties do not all land on reactor 0 */
+    const size_t n = m_reactors.size();
+    const size_t start = m_reactorNext.fetch_add(1, std::memory_order_relaxed);
+    Reactor* best = m_reactors[start % n].get();
+    for (size_t i = 1; i < n; ++i) {
+        Reactor* r = m_reactors[(start + i) % n].get();
+        if (r->connCount.load(std::memory_order_relaxed) < best->connCount.load(std::memory_order_relaxed))
+            best = r;
+    }
+    return *best;
 }
 
-void TlsServer::handleHandshake(int fd) {
-    SSL* ssl = m_sslMap[fd];
+void TlsServer::handleHandshake(Reactor& r, int fd, Connection& conn) {
+    SSL* ssl = conn.ssl;
 
+    /* SSL_get_error reads the thread's error queue: a leftover from another connection would turn WANT_READ fatal */
+    ERR_clear_error();
     int ret = SSL_accept(ssl);
     if (ret == 1) {
-        setInterest(fd, hasPendingTx(fd));
-        receivePacket(fd);
+        completeHandshake(conn, r.nowMs);
+        if (attachCryptoWorker(r, fd, conn))
+            return;
+        armConnTimer(r, conn);
+        setInterest(r, fd, hasPendingTx(r, fd));
+        receivePacket(r, fd, conn);
         return;
     }
 
     int err = SSL_get_error(ssl, ret);
     if (err == SSL_ERROR_WANT_READ)  return;
     if (err == SSL_ERROR_WANT_WRITE) {
-        setInterest(fd, true);
+        setInterest(r, fd, true);
         return;
     }
 
-    handleClose(fd);
+    m_stats.handshakeFailures.fetch_add(1, std::memory_order_relaxed);
+    handleClose(r, fd, CloseReason::ERROR);
 }
 
-void TlsServer::receivePacket(int fd) {
-    SSL* ssl = m_sslMap[fd];
-    auto& buf = m_rxBuffer.at(fd);
+void TlsServer::startHandshakeWorkers() {
+    for (auto& w : m_hsWorkers) {
+        m_threadManager->addThread(
+            "tls_handshake_" + std::to_string(w->idx),
+            std::bind(&TlsServer::runHandshakeWorker, this, std::ref(*w)),
+            std::bind(&TlsServer::stopHandshakeWorker, this, std::ref(*w)));
+    }
+}
 
-    while (true) {
-        size_t oldSize = buf.size();
-        buf.resize(oldSize + TLS_RECV_CHUNK_SIZE);
+void TlsServer::stopHandshakeWorker(HandshakeWorker& w) {
+    uint64_t v = 1;
+    write(w.eventFd, &v, sizeof(v));
+}
 
-        int n = SSL_read(ssl, buf.data() + oldSize, TLS_RECV_CHUNK_SIZE);
-        if (n > 0) {
-            buf.resize(oldSize + (size_t)n);
+void TlsServer::offloadHandshake(int fd, Connection& conn) {
+    /* the fd is not in the reactor's epoll set until the worker hands it back */
+    conn.handshaking = true;
 
-            if (buf.size() > TLS_MAX_RX_BUFFER_SIZE) {
-                handleClose(fd);
-                return;
+    HandshakeWorker& w = *m_hsWorkers[m_hsNext++ % m_hsWorkers.size()];
+    {
+        std::lock_guard<std::mutex> lock(w.inboxLock);
+        w.inbox.push_back(fd);
+    }
+
+    uint64_t v = 1;
+    write(w.eventFd, &v, sizeof(v));
+}
+
+void TlsServer::runHandshakeWorker(HandshakeWorker& w) {
+    epoll_event events[TLS_MAX_EVENTS];
+    std::vector<int> inbox;
+    bool inboxPending = false;
+
+    while (m_running) {
+        int n = epoll_wait(w.epFd, events, TLS_MAX_EVENTS, w.timers.nextTimeoutMs(TimerWheel::nowMs()));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        w.nowMs = TimerWheel::nowMs();
+        for (int i = 0; i < n; ++i) {
+            const int fd = events[i].data.fd;
+
+            if (fd == w.eventFd) {
+                drainEventFd(w.eventFd);
+                inboxPending = true;
+                continue;
             }
 
-            while (true) {
-                if (buf.size() < TLS_HEADER_SIZE)
-                    break;
+            Connection* conn = m_conns.find(fd);
+            if (!conn)
+                continue;
 
-                CommonPacketHeader hdr{};
-                std::memcpy(&hdr, buf.data(), TLS_HEADER_SIZE);
+            if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+                m_stats.handshakeFailures.fetch_add(1, std::memory_order_relaxed);
+                finishHandshake(w, fd, *conn, false);
+            } else {
+                stepHandshake(w, fd, *conn);
+            }
+        }
 
-                uint16_t bodyLen = ntohs(hdr.bodyLen);
-                if (bodyLen > TLS_MAX_BODY_LEN) {
-                    handleClose(fd);
-                    return;
-                }
+        if (inboxPending) {
+            inboxPending = false;
+            {
+                std::lock_guard<std::mutex> lock(w.inboxLock);
+                inbox.swap(w.inbox);
+            }
 
-                size_t frameLen = TLS_HEADER_SIZE + bodyLen;
-                if (buf.size() < frameLen)
-                    break;
+            /* the ClientHello is usually in the socket already, so try before waiting */
+            for (int newFd : inbox) {
+                Connection* conn = m_conns.find(newFd);
+                if (!conn)
+                    continue;
+
+                conn->interest = EPOLLIN | EPOLLRDHUP;
+                epoll_event ev{};
+                ev.events = conn->interest;
+                ev.data.fd = newFd;
+                epoll_ctl(w.epFd, EPOLL_CTL_ADD, newFd, &ev);
+
+                if (m_config.handshakeTimeoutMs > 0)
+                    w.timers.arm(*conn, w.nowMs, (uint64_t)m_config.handshakeTimeoutMs);
+                stepHandshake(w, newFd, *conn);
+            }
+            inbox.clear();
+        }
 
-                std::vector<uint8_t> payload(
-                    buf.begin(), buf.begin() + frameLen);
+        w.timers.advance(w.nowMs, [this, &w](TimerNode& node) {
+            auto& conn = static_cast<Connection&>(node);
+            m_stats.timeoutsHandshake.fetch_add(1, std::memory_order_relaxed);
+            LOG_DEBUG("TlsServer: handshake timeout fd={} worker={}", conn.fd, w.idx);
+            finishHandshake(w, conn.fd, conn, false);
+        });
+    }
+}
 
-                buf.erase(buf.begin(), buf.begin() + frameLen);
+void TlsServer::stepHandshake(HandshakeWorker& w, int fd, Connection& conn) {
+    ERR_clear_error();
+    int ret = SSL_accept(conn.ssl);
+    if (ret == 1) {
+        finishHandshake(w, fd, conn, true);
+        return;
+    }
 
-                auto& addr = m_addrMap[fd];
-                auto pkt = std::make_unique<Packet>(
-                    fd, Protocol::TLS,
-                    std::move(payload),
-                    addr.second,
-                    addr.first);
+    uint32_t want = 0;
+    int err = SSL_get_error(conn.ssl, ret);
+    if (err == SSL_ERROR_WANT_READ)
+        want = EPOLLIN | EPOLLRDHUP;
+    else if (err == SSL_ERROR_WANT_WRITE)
+        want = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
 
-                {
-                    std::lock_guard<std::mutex> lock(m_rxLock);
-                    m_rxQueue.push(std::move(pkt));
-                }
-                m_cv.notify_one();
+    if (!want) {
+        m_stats.handshakeFailures.fetch_add(1, std::memory_order_relaxed);
+        finishHandshake(w, fd, conn, false);
+        return;
+    }
+
+    if (want != conn.interest) {
+        epoll_event ev{};
+        ev.events = want;
+        ev.data.fd = fd;
+        epoll_ctl(w.epFd, EPOLL_CTL_MOD, fd, &ev);
+        conn.interest = want;
+    }
+}
+
+void TlsServer::finishHandshake(HandshakeWorker& w, int fd, Connection& conn, bool ok) {
+    epoll_ctl(w.epFd, EPOLL_CTL_DEL, fd, nullptr);
+    w.timers.cancel(conn);
+    conn.interest = 0;
+
+    if (ok)
+        completeHandshake(conn, w.nowMs);
+
+    /* the lock orders every write above before the reactor takes the connection back */
+    Reactor& r = ownerOf(conn);
+    {
+        std::lock_guard<std::mutex> lock(r.hsDoneLock);
+        r.hsDone.push_back(HandshakeResult{fd, conn.gen.load(std::memory_order_relaxed), ok});
+    }
+
+    uint64_t v = 1;
+    write(r.handshakeEventFd, &v, sizeof(v));
+}
+
+void TlsServer::handleHandshakeDoneEvent(Reactor& r) {
+    drainEventFd(r.handshakeEventFd);
+
+    std::vector<HandshakeResult> done;
+    {
+        std::lock_guard<std::mutex> lock(r.hsDoneLock);
+        done.swap(r.hsDone);
+    }
+
+    for (const auto& res : done) {
+        Connection* conn = findOwned(r, res.fd);
+        if (!conn || !conn->handshaking || conn->gen.load(std::memory_order_relaxed) != res.gen)
+            continue;
+
+        conn->handshaking = false;
+        if (!res.ok) {
+            handleClose(r, res.fd, CloseReason::ERROR);
+            continue;
+        }
+        onHandshakeDone(r, res.fd, *conn);
+    }
+}
+
+void TlsServer::completeHandshake(Connection& conn, uint64_t nowMs) {
+    m_stats.handshakes.fetch_add(1, std::memory_order_relaxed);
+    if (SSL_session_reused(conn.ssl))
+        m_stats.handshakesResumed.fetch_add(1, std::memory_order_relaxed);
+    m_stats.handshakeUs.fetch_add((nowMs - conn.acceptedMs) * 1000, std::memory_order_relaxed);
+
+    /* with SSL_OP_ENABLE_KTLS, SSL_accept installed the keys in the socket if kernel and cipher allow;
+     * SSL_read / SSL_write then pass records through and the kernel does the crypto */
+    conn.ktlsTx = BIO_get_ktls_send(SSL_get_wbio(conn.ssl));
+    conn.ktlsRx = BIO_get_ktls_recv(SSL_get_rbio(conn.ssl));
+    if (conn.ktlsTx)
+        m_stats.ktlsTx.fetch_add(1, std::memory_order_relaxed);
+    if (conn.ktlsRx)
+        m_stats.ktlsRx.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TlsServer::onHandshakeDone(Reactor& r, int fd, Connection& conn) {
+    conn.interest = EPOLLIN | EPOLLRDHUP;
+    addToEpoll(r.epFd, fd, conn.interest);
+    if (attachCryptoWorker(r, fd, conn))
+        return;
+
+    armConnTimer(r, conn);
+
+    /* SSL_accept may have buffered application data already, so read without waiting for an event */
+    receivePacket(r, fd, conn);
+
+    /* responses queued while the worker had the connection */
+    if (hasPendingTx(r, fd))
+        flushPendingForFd(r, fd, 256);
+    if (conn.open)
+        updateBackpressure(r, conn);
+}
+
+void TlsServer::receivePacket(Reactor& r, int fd, Connection& conn) {
+    SSL* ssl = conn.ssl;
+    auto& buf = conn.rxBuffer;
+
+    while (true) {
+        uint8_t* dst = prepareRx(conn);
+        if (!dst) {
+            handleClose(r, fd, CloseReason::ERROR);
+            return;
+        }
+
+        ERR_clear_error();
+        int n = SSL_read(ssl, dst, (int) buf.writable());
+        if (n > 0) {
+            buf.commit((size_t)n);
+
+            const bool wasFramed = conn.framed.load(std::memory_order_relaxed);
+            if (!parseFrames(conn, r.nowMs)) {
+                handleClose(r, fd, CloseReason::ERROR);
+                return;
             }
+            if (!wasFramed && conn.framed.load(std::memory_order_relaxed))
+                armConnTimer(r, conn);
         } else {
-            buf.resize(oldSize);
-
             int err = SSL_get_error(ssl, n);
-            if (err == SSL_ERROR_WANT_READ)
+            if (err == SSL_ERROR_WANT_READ) {
+                shrinkRxBuffer(conn);
                 return;
+            }
 
-            handleClose(fd);
+            handleClose(r, fd, err == SSL_ERROR_ZERO_RETURN ? CloseReason::PEER : CloseReason::ERROR);
             return;
         }
     }
 }
 
-void TlsServer::enqueueTx(std::unique_ptr<Packet> packet) {
-    int fd = packet->getFd();
+bool TlsServer::parseFrames(Connection& conn, uint64_t nowMs) {
+    auto& buf = conn.rxBuffer;
+
+    while (buf.size() >= TLS_HEADER_SIZE) {
+        const uint8_t* frame = buf.data();
+
+        CommonPacketHeader hdr{};
+        std::memcpy(&hdr, frame, TLS_HEADER_SIZE);
+
+        uint16_t bodyLen = ntohs(hdr.bodyLen);
+        if (bodyLen > TLS_MAX_BODY_LEN)
+            return false;
+
+        size_t frameLen = TLS_HEADER_SIZE + bodyLen;
+        if (buf.size() < frameLen)
+            break;
+
+        if (hdr.sessionId != 0)
+            conn.sessionId.store(be64toh(hdr.sessionId), std::memory_order_relaxed);
+
+        /* the idle timer is not touched per frame, it checks lastRxMs when it fires */
+        conn.lastRxMs.store(nowMs, std::memory_order_relaxed);
+        conn.framed.store(true, std::memory_order_relaxed);
+
+        std::vector<uint8_t> payload(frame, frame + frameLen);
+        buf.consume(frameLen);
+
+        auto& addr = conn.addr;
+        auto pkt = std::make_unique<Packet>(
+            conn.fd, Protocol::TLS,
+            std::move(payload),
+            addr.second,
+            addr.first);
+        pkt->setConnGen(conn.gen.load(std::memory_order_relaxed));
+        deliver(conn, std::move(pkt));
+    }
+    return true;
+}
+
+void TlsServer::deliver(Connection& conn, std::unique_ptr<Packet> pkt) {
+    /* on the pinned worker already */
+    if (conn.crypto.load(std::memory_order_relaxed)) {
+        m_rxRouter->handlePacket(std::move(pkt));
+        return;
+    }
+
+    if (!m_cryptoWorkers.empty()) {
+        CryptoJob job;
+        job.op = CryptoOp::DELIVER;
+        job.fd = conn.fd;
+        job.gen = conn.gen.load(std::memory_order_relaxed);
+        job.pkt = std::move(pkt);
+        postCryptoJob(conn, std::move(job));
+        return;
+    }
+
     {
-        std::lock_guard<std::mutex> lock(m_txLock);
-        m_txQueue[fd].push_back(std::move(packet));
+        std::lock_guard<std::mutex> lock(m_rxLock);
+        m_rxQueue.push(std::move(pkt));
+    }
+    m_cv.notify_one();
+}
+
+void TlsServer::startCryptoWorkers() {
+    for (auto& w : m_cryptoWorkers) {
+        m_threadManager->addThread(
+            "tls_worker_" + std::to_string(w->idx),
+            std::bind(&TlsServer::runCryptoWorker, this, std::ref(*w)),
+            std::bind(&TlsServer::stopCryptoWorker, this, std::ref(*w)));
     }
-    uint64_t v = 1;
-    write(m_txEventFd, &v, sizeof(v));
 }
 
-bool TlsServer::hasPendingTx(int fd) {
-    std::lock_guard<std::mutex> lock(m_txLock);
-    auto it = m_txQueue.find(fd);
-    return it != m_txQueue.end() && !it->second.empty();
+void TlsServer::stopCryptoWorker(CryptoWorker& w) {
+    std::lock_guard<std::mutex> lock(w.lock);
+    w.cv.notify_all();
 }
 
-void TlsServer::flushAllPending(size_t budget) {
-    std::vector<int> fds;
+bool TlsServer::attachCryptoWorker(Reactor& r, int fd, Connection& conn) {
+    /* kTLS sessions keep the socket BIO; anything SSL_accept buffered or half wrote would be lost in the swap */
+    if (m_cryptoWorkers.empty() || conn.ktlsTx || conn.ktlsRx ||
+        SSL_has_pending(conn.ssl) || !conn.txRetry.empty() || !conn.txPending.empty())
+        return false;
+
+    BIO* rbio = BIO_new(BIO_s_mem());
+    BIO* wbio = BIO_new(BIO_s_mem());
+    if (!rbio || !wbio) {
+        LOG_WARN("TlsServer: memory BIO alloc failed fd={}, session stays on the reactor", fd);
+        BIO_free(rbio);
+        BIO_free(wbio);
+        return false;
+    }
+
+    /* frees the socket BIO, which does not own the fd */
+    SSL_set_bio(conn.ssl, rbio, wbio);
+    m_stats.cryptoSessions.fetch_add(1, std::memory_order_relaxed);
+
+    conn.crypto.store(true, std::memory_order_seq_cst);
+    armConnTimer(r, conn);
+    setInterest(r, fd, hasPendingTx(r, fd));
+
+    /* responses queued during the handshake; see enqueueTx for pushes racing the store above.
+     * Posted unconditionally: a late push to the previous connection on this slot may have left the flag set */
+    conn.txCryptoPending.store(true, std::memory_order_seq_cst);
+    CryptoJob job;
+    job.op = CryptoOp::TX;
+    job.fd = fd;
+    job.gen = conn.gen.load(std::memory_order_relaxed);
+    postCryptoJob(conn, std::move(job));
+    return true;
+}
+
+void TlsServer::postCryptoJob(Connection& conn, CryptoJob job) {
+    CryptoWorker& w = *m_cryptoWorkers[(size_t)conn.cryptoWorker];
+
+    bool wake;
     {
-        std::lock_guard<std::mutex> lock(m_txLock);
-        for (auto& kv : m_txQueue)
-            if (!kv.second.empty())
-                fds.push_back(kv.first);
+        std::lock_guard<std::mutex> lock(w.lock);
+        w.jobs.push_back(std::move(job));
+        wake = w.jobs.size() == 1;
     }
+    if (wake)
+        w.cv.notify_one();
+}
 
-    size_t used = 0;
-    for (int fd : fds) {
-        if (used >= budget) break;
-        used += flushPendingForFd(fd, budget - used);
+void TlsServer::postCryptoTx(Connection& conn) {
+    /* one TX job drains every push made before it runs */
+    if (conn.txCryptoPending.exchange(true, std::memory_order_seq_cst))
+        return;
+
+    CryptoJob job;
+    job.op = CryptoOp::TX;
+    job.fd = conn.fd;
+    job.gen = conn.gen.load(std::memory_order_relaxed);
+    postCryptoJob(conn, std::move(job));
+}
+
+void TlsServer::runCryptoWorker(CryptoWorker& w) {
+    std::vector<CryptoJob> jobs;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(w.lock);
+            while (w.jobs.empty() && m_running)
+                w.cv.wait(lock);
+
+            if (!m_running)
+                break;
+
+            jobs.swap(w.jobs);
+        }
+
+        for (auto& job : jobs)
+            runCryptoJob(job);
+        jobs.clear();
     }
 }
 
-size_t TlsServer::flushPendingForFd(int fd, size_t budget) {
-    SSL* ssl = m_sslMap[fd];
+void TlsServer::runCryptoJob(CryptoJob& job) {
+    Connection* conn = m_conns.find(job.fd);
+    if (!conn)
+        return;
+
+    if (job.op == CryptoOp::DELIVER) {
+        m_rxRouter->handlePacket(std::move(job.pkt));
+        return;
+    }
+
+    if (conn->gen.load(std::memory_order_acquire) != job.gen)
+        return;
+
+    /* the SSL itself is recycled by the reactor once CLOSED arrives */
+    if (job.op == CryptoOp::CLOSE) {
+        releaseRxBuffer(*conn);
+        notifyReactor(*conn, CryptoNotice::CLOSED);
+        return;
+    }
+
+    /* closing: its CLOSE job is behind this one */
+    if (!conn->open.load(std::memory_order_acquire))
+        return;
+
+    if (job.op == CryptoOp::RX)
+        cryptoRx(*conn, job.data);
+    else
+        cryptoTx(*conn);
+}
+
+void TlsServer::cryptoRx(Connection& conn, const std::vector<uint8_t>& cipher) {
+    m_stats.cryptoRxJobs.fetch_add(1, std::memory_order_relaxed);
+
+    /* a read-only BIO over the job's bytes: no copy into the SSL, and nothing is held once SSL_read drained it.
+     * Every exit below but WANT_READ closes, so the BIO never outlives its bytes with data left in it */
+    SSL* ssl = conn.ssl;
+    BIO* rbio = BIO_new_mem_buf(cipher.data(), (int) cipher.size());
+    bool ok = rbio != nullptr;
+    if (ok) {
+        BIO_set_mem_eof_return(rbio, -1);   // drained reads as WANT_READ, not EOF
+        SSL_set0_rbio(ssl, rbio);
+    }
+
+    const size_t left = conn.rxInflight.fetch_sub(cipher.size(), std::memory_order_acq_rel) - cipher.size();
+    if (left < TLS_CRYPTO_RX_INFLIGHT / 2 && conn.rxResumeWanted.load(std::memory_order_acquire) &&
+        conn.rxResumeWanted.exchange(false, std::memory_order_acq_rel))
+        notifyReactor(conn, CryptoNotice::RX_RESUME);
+
+    const uint64_t nowMs = TimerWheel::nowMs();
+    auto& buf = conn.rxBuffer;
+    bool peerClosed = false;
+
+    while (ok) {
+        uint8_t* dst = prepareRx(conn);
+        if (!dst) {
+            ok = false;
+            break;
+        }
+
+        ERR_clear_error();
+        int n = SSL_read(ssl, dst, (int) buf.writable());
+        if (n > 0) {
+            buf.commit((size_t)n);
+            ok = parseFrames(conn, nowMs);
+            continue;
+        }
+
+        /* close_notify and fatal alerts end up here too */
+        const int err = SSL_get_error(ssl, n);
+        ok = err == SSL_ERROR_WANT_READ;
+        peerClosed = err == SSL_ERROR_ZERO_RETURN;
+        break;
+    }
+
+    if (ok)
+        shrinkRxBuffer(conn);
+
+    /* alerts, KeyUpdate replies */
+    drainCipher(conn);
+
+    if (!ok)
+        notifyReactor(conn, peerClosed ? CryptoNotice::PEER_CLOSE : CryptoNotice::CLOSE);
+}
+
+void TlsServer::cryptoTx(Connection& conn) {
+    m_stats.cryptoTxJobs.fetch_add(1, std::memory_order_relaxed);
+
+    /* cleared before draining: a push from here on posts another job */
+    conn.txCryptoPending.store(false, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    SSL* ssl = conn.ssl;
+    const uint32_t connGen = conn.gen.load(std::memory_order_relaxed);
+    const size_t record = m_config.txRecordSize;
+    auto& stage = m_cryptoWorkers[(size_t)conn.cryptoWorker]->txStage;
+    bool ok = true;
+
+    /* the memory BIO grows, so a write is never partial */
+    auto writeStage = [&]() {
+        ERR_clear_error();
+        if (SSL_write(ssl, stage.data(), (int) stage.size()) <= 0)
+            return false;
+        m_stats.txRecords.fetch_add(1, std::memory_order_relaxed);
+        m_stats.txPlainBytes.fetch_add(stage.size(), std::memory_order_relaxed);
+        stage.clear();
+        return true;
+    };
+
+    /* frames are packed back to back into full records; one that straddles a record boundary is split */
+    stage.clear();
+    while (ok) {
+        Packet* p = conn.txQueue.pop();
+        if (!p)
+            break;
+
+        std::unique_ptr<Packet> pkt(p);
+        const auto& payload = pkt->getPayload();
+        size_t off = pkt->getTxOffset();
+
+        /* counted again as ciphertext by drainCipher */
+        conn.txQueuedBytes.fetch_sub(payload.size() - off, std::memory_order_relaxed);
+
+        const uint32_t gen = pkt->getConnGen();
+        if (gen != 0 && gen != connGen) {
+            LOG_WARN("TlsServer: drop stale tx, fd={} gen={}", conn.fd, gen);
+            continue;
+        }
+
+        if (off >= payload.size())
+            continue;
+
+        m_stats.txFrames.fetch_add(1, std::memory_order_relaxed);
+        while (ok && off < payload.size()) {
+            const size_t take = std::min(payload.size() - off, record - stage.size());
+            stage.insert(stage.end(), payload.begin() + (ptrdiff_t)off, payload.begin() + (ptrdiff_t)(off + take));
+            off += take;
+            if (stage.size() == record)
+                ok = writeStage();
+        }
+    }
+    if (ok && !stage.empty())
+        ok = writeStage();
+
+    drainCipher(conn);
+
+    if (!ok)
+        notifyReactor(conn, CryptoNotice::CLOSE);
+}
+
+void TlsServer::drainCipher(Connection& conn) {
+    BIO* wbio = SSL_get_wbio(conn.ssl);
+    const size_t pending = BIO_ctrl_pending(wbio);
+    if (pending == 0)
+        return;
+
+    /* every record written since the last drain goes out in one send */
+    std::vector<uint8_t> cipher(pending);
+    const int n = BIO_read(wbio, cipher.data(), (int) pending);
+    if (n <= 0)
+        return;
+    cipher.resize((size_t)n);
+    m_stats.cipherTxBytes.fetch_add((uint64_t)n, std::memory_order_relaxed);
+    conn.txQueuedBytes.fetch_add((size_t)n, std::memory_order_relaxed);
+
+    /* a drained memory BIO keeps its high-water storage, a fresh one holds none */
+    if (m_config.releaseBuffers) {
+        if (BIO* fresh = BIO_new(BIO_s_mem()))
+            SSL_set0_wbio(conn.ssl, fresh);
+    }
+
+    auto& addr = conn.addr;
+    auto* pkt = new Packet(conn.fd, Protocol::TLS, std::move(cipher), addr.second, addr.first);
+    pkt->setConnGen(conn.gen.load(std::memory_order_relaxed));
+
+    conn.cipherQueue.push(pkt);
+    scheduleTx(conn);
+}
+
+void TlsServer::notifyReactor(const Connection& conn, CryptoNotice what) {
+    Reactor& r = ownerOf(conn);
+    {
+        std::lock_guard<std::mutex> lock(r.cryptoEventLock);
+        r.cryptoEvents.push_back(CryptoEvent{what, conn.fd, conn.gen.load(std::memory_order_relaxed)});
+    }
+
+    uint64_t v = 1;
+    write(r.cryptoEventFd, &v, sizeof(v));
+}
+
+void TlsServer::handleCryptoEvent(Reactor& r) {
+    drainEventFd(r.cryptoEventFd);
+
+    std::vector<CryptoEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(r.cryptoEventLock);
+        events.swap(r.cryptoEvents);
+    }
+
+    for (const auto& ev : events) {
+        Connection* conn = m_conns.find(ev.fd);
+        if (!conn || !conn->crypto.load(std::memory_order_relaxed) ||
+            conn->gen.load(std::memory_order_relaxed) != ev.gen)
+            continue;
+
+        switch (ev.what) {
+            case CryptoNotice::CLOSE:
+                handleClose(r, ev.fd, CloseReason::ERROR);
+                break;
+            case CryptoNotice::PEER_CLOSE:
+                handleClose(r, ev.fd, CloseReason::PEER);
+                break;
+            case CryptoNotice::CLOSED:
+                if (!conn->open.load(std::memory_order_relaxed))
+                    finishClose(r, ev.fd, *conn, conn->closeReason);
+                break;
+            case CryptoNotice::RX_RESUME:
+                if (conn->open.load(std::memory_order_relaxed) && conn->rxPaused) {
+                    conn->rxPaused = false;
+                    setInterest(r, ev.fd, (conn->interest & EPOLLOUT) != 0);
+                }
+                break;
+        }
+    }
+}
+
+void TlsServer::readCipher(Reactor& r, int fd, Connection& conn) {
+    ssize_t n;
+    do {
+        n = recv(fd, r.cipherScratch.data(), r.cipherScratch.size(), 0);
+    } while (n < 0 && errno == EINTR);
+
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        handleClose(r, fd, n == 0 ? CloseReason::PEER : CloseReason::ERROR);
+        return;
+    }
+    if (n < 0)
+        return;
+
+    m_stats.cipherRxBytes.fetch_add((uint64_t)n, std::memory_order_relaxed);
+
+    CryptoJob job;
+    job.op = CryptoOp::RX;
+    job.fd = fd;
+    job.gen = conn.gen.load(std::memory_order_relaxed);
+    job.data.assign(r.cipherScratch.data(), r.cipherScratch.data() + n);
+
+    const size_t inflight = conn.rxInflight.fetch_add((size_t)n, std::memory_order_acq_rel) + (size_t)n;
+    postCryptoJob(conn, std::move(job));
+
+    if (inflight < TLS_CRYPTO_RX_INFLIGHT)
+        return;
+
+    /* the worker is behind: stop reading until it signals RX_RESUME; the re-check covers a drain that
+     * finished before rxResumeWanted was set */
+    m_stats.cryptoRxPauses.fetch_add(1, std::memory_order_relaxed);
+    conn.rxPaused = true;
+    conn.rxResumeWanted.store(true, std::memory_order_seq_cst);
+    if (conn.rxInflight.load(std::memory_order_seq_cst) < TLS_CRYPTO_RX_INFLIGHT / 2 &&
+        conn.rxResumeWanted.exchange(false, std::memory_order_acq_rel))
+        conn.rxPaused = false;
+
+    setInterest(r, fd, (conn.interest & EPOLLOUT) != 0);
+}
+
+size_t TlsServer::flushCipherForFd(Reactor& r, int fd, Connection& conn, size_t budget) {
     size_t used = 0;
 
     while (used < budget) {
         std::unique_ptr<Packet> pkt;
-        {
-            std::lock_guard<std::mutex> lock(m_txLock);
-            auto it = m_txQueue.find(fd);
-            if (it == m_txQueue.end() || it->second.empty()) {
-                setInterest(fd, false);
+        if (!conn.txRetry.empty()) {
+            pkt = std::move(conn.txRetry.front());
+            conn.txRetry.pop_front();
+        } else if (Packet* p = conn.cipherQueue.pop()) {
+            pkt.reset(p);
+        } else {
+            setInterest(r, fd, false);
+            return used;
+        }
+
+        const auto& cipher = pkt->getPayload();
+
+        while (pkt->getTxOffset() < cipher.size()) {
+            ssize_t n = send(fd, cipher.data() + pkt->getTxOffset(), cipher.size() - pkt->getTxOffset(), MSG_NOSIGNAL);
+            if (n > 0) {
+                pkt->updateTxOffset((size_t)n);
+                conn.txQueuedBytes.fetch_sub((size_t)n, std::memory_order_relaxed);
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+                continue;
+
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                conn.txRetry.push_front(std::move(pkt));
+                setInterest(r, fd, true);
                 return used;
             }
-            pkt = std::move(it->second.front());
-            it->second.pop_front();
+
+            handleClose(r, fd, CloseReason::ERROR);
+            return used;
         }
+        used++;
+    }
+    setInterest(r, fd, hasPendingTx(r, fd));
+    return used;
+}
 
-        const auto& payload = pkt->getPayload();
+void TlsServer::enqueueTx(std::unique_ptr<Packet> packet) {
+    int fd = packet->getFd();
+    uint32_t gen = packet->getConnGen();
+
+    Connection* conn = m_conns.find(fd);
+    if (!conn || !conn->open.load(std::memory_order_acquire) ||
+        (gen != 0 && conn->gen.load(std::memory_order_acquire) != gen)) {
+        LOG_WARN("TlsServer: drop stale tx, fd={} gen={}", fd, gen);
+        return;
+    }
+
+    /* no lock: a close racing with this push is caught by the gen check in popTx */
+    conn->txQueuedBytes.fetch_add(packet->getPayload().size(), std::memory_order_relaxed);
+    conn->txQueue.push(packet.release());
 
-        while (pkt->getTxOffset() < payload.size()){
-            const uint8_t* p = payload.data() + pkt->getTxOffset();
-            size_t bytes = payload.size() - pkt->getTxOffset();
+    /* a push that still saw crypto false is picked up by the TX job posted when it was set */
+    if (conn->crypto.load(std::memory_order_seq_cst))
+        postCryptoTx(*conn);
+    else
+        scheduleTx(*conn);
+}
+
+void TlsServer::scheduleTx(Connection& conn) {
+    if (!TxHandoff<Connection>::claim(conn))
+        return;
+
+    Reactor& r = ownerOf(conn);
+    r.txReady.link(conn);
+    kickTx(r);
+}
+
+void TlsServer::kickTx(Reactor& r) {
+    if (!r.txReady.kick())
+        return;
+
+    uint64_t v = 1;
+    write(r.txEventFd, &v, sizeof(v));
+}
+
+std::unique_ptr<Packet> TlsServer::popTx(Connection& conn) {
+    if (!conn.txRetry.empty()) {
+        auto pkt = std::move(conn.txRetry.front());
+        conn.txRetry.pop_front();
+        return pkt;
+    }
+
+    while (Packet* p = conn.txQueue.pop()) {
+        std::unique_ptr<Packet> pkt(p);
+        const uint32_t gen = pkt->getConnGen();
+        if (gen == 0 || gen == conn.gen.load(std::memory_order_relaxed))
+            return pkt;
+
+        conn.txQueuedBytes.fetch_sub(pkt->getPayload().size() - pkt->getTxOffset(), std::memory_order_relaxed);
+        LOG_WARN("TlsServer: drop stale tx, fd={} gen={}", conn.fd, gen);
+    }
+    return nullptr;
+}
+
+void TlsServer::dropTxQueue(Connection& conn) {
+    size_t dropped = conn.txPending.size();
+    for (const auto& pkt : conn.txRetry)
+        dropped += pkt->getPayload().size() - pkt->getTxOffset();
+    conn.txRetry.clear();
+    std::vector<uint8_t>().swap(conn.txPending);
+    while (Packet* p = conn.txQueue.pop()) {
+        dropped += p->getPayload().size() - p->getTxOffset();
+        delete p;
+    }
+    while (Packet* p = conn.cipherQueue.pop()) {
+        dropped += p->getPayload().size() - p->getTxOffset();
+        delete p;
+    }
+    conn.txQueuedBytes.fetch_sub(dropped, std::memory_order_relaxed);
+}
 
-            int ret = SSL_write(ssl, p, (int) bytes);
-            if (ret > 0){
-                pkt->updateTxOffset(size_t(ret));
+bool TlsServer::hasPendingTx(Reactor& r, int fd) {
+    Connection* conn = findOwned(r, fd);
+    if (!conn)
+        return false;
+    if (conn->crypto.load(std::memory_order_relaxed))
+        return !conn->txRetry.empty() || !conn->cipherQueue.empty();
+    return !conn->txPending.empty() || !conn->txRetry.empty() || !conn->txQueue.empty();
+}
+
+void TlsServer::flushAllPending(Reactor& r, size_t budget) {
+    r.txReady.beginDrain();
+
+    size_t used = 0;
+    while (used < budget) {
+        Connection* conn = r.txReady.pop();
+        if (!conn)
+            break;
+
+        if (!conn->open.load(std::memory_order_acquire))
+            continue;
+
+        /* scheduled for an earlier connection on this fd, which another reactor now owns */
+        if (conn->owner.load(std::memory_order_relaxed) != r.idx) {
+            scheduleTx(*conn);
+            continue;
+        }
+
+        /* a connection on a handshake worker is flushed when it comes back */
+        if (conn->handshaking)
+            continue;
+
+        used += flushPendingForFd(r, conn->fd, budget - used);
+        if (conn->open.load(std::memory_order_relaxed))
+            updateBackpressure(r, *conn);
+    }
+
+    if (!r.txReady.empty())
+        kickTx(r);
+}
+
+size_t TlsServer::flushPendingForFd(Reactor& r, int fd, size_t budget) {
+    Connection* conn = findOwned(r, fd);
+    if (!conn)
+        return 0;
+
+    if (conn->crypto.load(std::memory_order_relaxed))
+        return flushCipherForFd(r, fd, *conn, budget);
+
+    SSL* ssl = conn->ssl;
+    size_t used = 0;
+
+    while (true) {
+        /* bytes left by a blocked write go first and as they are: their record is already encrypted */
+        const uint8_t* p;
+        size_t len;
+        if (!conn->txPending.empty()) {
+            p = conn->txPending.data();
+            len = conn->txPending.size();
+        } else {
+            if (used >= budget)
+                break;
+
+            const size_t staged = stageTx(r, *conn, budget - used);
+            if (staged == 0) {
+                setInterest(r, fd, false);
+                return used;
+            }
+            used += staged;
+            if (r.txStage.empty())
+                continue;
+
+            p = r.txStage.data();
+            len = r.txStage.size();
+            m_stats.txRecords.fetch_add(1, std::memory_order_relaxed);
+            m_stats.txPlainBytes.fetch_add(len, std::memory_order_relaxed);
+        }
+
+        size_t off = 0;
+        while (off < len) {
+            ERR_clear_error();
+            int ret = SSL_write(ssl, p + off, (int)(len - off));
+            if (ret > 0) {
+                off += (size_t)ret;
+                conn->txQueuedBytes.fetch_sub((size_t)ret, std::memory_order_relaxed);
                 continue;
             }
 
             int err = SSL_get_error(ssl, ret);
             if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) {
-                {
-                    std::lock_guard<std::mutex> lock(m_txLock);
-                    m_txQueue[fd].push_front(std::move(pkt));
-                }
-                setInterest(fd, true);
-                return used + 1;
+                /* r.txStage is reused by the next connection; the retry only needs the same bytes */
+                if (p == conn->txPending.data())
+                    conn->txPending.erase(conn->txPending.begin(), conn->txPending.begin() + (ptrdiff_t)off);
+                else
+                    conn->txPending.assign(p + off, p + len);
+                setInterest(r, fd, true);
+                return used;
             }
 
-            handleClose(fd);
-            return used + 1;
+            handleClose(r, fd, CloseReason::ERROR);
+            return used;
         }
+
+        if (p == conn->txPending.data())
+            std::vector<uint8_t>().swap(conn->txPending);
+    }
+    setInterest(r, fd, hasPendingTx(r, fd));
+    return used;
+}
+
+void TlsServer::updateBackpressure(Reactor& r, Connection& conn) {
+    if (m_config.txHighWatermark == 0)
+        return;
+
+    const size_t queued = conn.txQueuedBytes.load(std::memory_order_relaxed);
+    if (!conn.txPaused && queued >= m_config.txHighWatermark) {
+        conn.txPaused = true;
+        m_stats.rxPauses.fetch_add(1, std::memory_order_relaxed);
+    } else if (conn.txPaused && queued <= m_config.txLowWatermark) {
+        conn.txPaused = false;
+        m_stats.rxResumes.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        return;
+    }
+
+    /* the session's shard holds its output while paused; reads alone only stop new requests */
+    m_rxRouter->handleTxBackpressure(conn.sessionId.load(std::memory_order_relaxed), conn.txPaused);
+    setInterest(r, conn.fd, (conn.interest & EPOLLOUT) != 0);
+}
+
+size_t TlsServer::stageTx(Reactor& r, Connection& conn, size_t budget) {
+    /* frames are packed back to back up to one record; the rest of a frame that does not fit waits on txRetry */
+    auto& stage = r.txStage;
+    const size_t record = m_config.txRecordSize;
+    size_t used = 0;
+
+    stage.clear();
+    while (stage.size() < record && used < budget) {
+        std::unique_ptr<Packet> pkt = popTx(conn);
+        if (!pkt)
+            break;
         used++;
+
+        const auto& payload = pkt->getPayload();
+        const size_t off = pkt->getTxOffset();
+        const size_t take = std::min(payload.size() - off, record - stage.size());
+        stage.insert(stage.end(), payload.begin() + (ptrdiff_t)off, payload.begin() + (ptrdiff_t)(off + take));
+        pkt->updateTxOffset(take);
+
+        if (pkt->getTxOffset() < payload.size()) {
+            conn.txRetry.push_front(std::move(pkt));
+            break;
+        }
+        m_stats.txFrames.fetch_add(1, std::memory_order_relaxed);
     }
-    setInterest(fd, hasPendingTx(fd));
     return used;
 }
 
-void TlsServer::handleClose(int fd) {
-    epoll_ctl(m_epFd, EPOLL_CTL_DEL, fd, nullptr);
+void TlsServer::handleClose(Reactor& r, int fd, CloseReason reason) {
+    Connection* conn = findOwned(r, fd);
+    if (!conn)
+        return;
+
+    epoll_ctl(r.epFd, EPOLL_CTL_DEL, fd, nullptr);
+    r.timers.cancel(*conn);
+
+    /* late enqueueTx calls see open false; a txReady entry left behind is skipped */
+    conn->open.store(false, std::memory_order_release);
+
+    /* the worker still holds the SSL: it lets go and sends CLOSED, the fd number stays taken until then */
+    if (conn->crypto.load(std::memory_order_relaxed)) {
+        conn->closeReason = reason;
+        CryptoJob job;
+        job.op = CryptoOp::CLOSE;
+        job.fd = fd;
+        job.gen = conn->gen.load(std::memory_order_relaxed);
+        postCryptoJob(*conn, std::move(job));
+        return;
+    }
+
+    releaseRxBuffer(*conn);
+    finishClose(r, fd, *conn, reason);
+}
+
+void TlsServer::finishClose(Reactor& r, int fd, Connection& conn, CloseReason reason) {
+    if (conn.txPaused)
+        m_rxRouter->handleTxBackpressure(conn.sessionId.load(std::memory_order_relaxed), false);
+
+    releaseAdmission(conn.addr.second);
+    recycleSsl(r, conn.ssl, reason);
+    conn.ssl = nullptr;
+    conn.addr = {};
+    conn.interest = 0;
+    conn.sessionId = 0;
+    conn.handshaking = false;
+    conn.acceptedMs = 0;
+    conn.ktlsTx = false;
+    conn.ktlsRx = false;
+    conn.framed = false;
+    conn.lastRxMs = 0;
+    conn.crypto = false;
+    conn.txCryptoPending = false;
+    conn.rxInflight = 0;
+    conn.rxResumeWanted = false;
+    conn.rxPaused = false;
+    conn.txPaused = false;
+    conn.closeReason = CloseReason::ERROR;
+    dropTxQueue(conn);
+    r.connCount.fetch_sub(1, std::memory_order_relaxed);
+
+    /* close last: the fd number may be handed over again right after */
     close(fd);
+}
 
-    {
-        std::lock_guard<std::mutex> lock(m_txLock);
-        m_txQueue.erase(fd);
+SSL* TlsServer::newSsl(Reactor& r) {
+    if (!r.sslPool.empty()) {
+        SSL* ssl = r.sslPool.back();
+        r.sslPool.pop_back();
+        m_stats.sslPooled.fetch_sub(1, std::memory_order_relaxed);
+        m_stats.sslReused.fetch_add(1, std::memory_order_relaxed);
+        return ssl;
     }
 
-    auto it = m_sslMap.find(fd);
-    if (it != m_sslMap.end()) {
-        SSL_free(it->second);
-        m_sslMap.erase(it);
+    SSL* ssl = SSL_new(m_ctx);
+    if (ssl)
+        m_stats.sslNew.fetch_add(1, std::memory_order_relaxed);
+    return ssl;
+}
+
+void TlsServer::recycleSsl(Reactor& r, SSL* ssl, CloseReason reason) {
+    if (!ssl)
+        return;
+
+    /* SSL_clear / SSL_free drop the session from the server cache unless the shutdown was marked sent.
+     * Only an orderly end keeps it resumable: the peer's close_notify was read, or a clean session went idle.
+     * Aborted, failed or truncated connections leave it unmarked and OpenSSL evicts the session */
+    const bool orderly = reason == CloseReason::IDLE ||
+                         (reason == CloseReason::PEER && (SSL_get_shutdown(ssl) & SSL_RECEIVED_SHUTDOWN));
+    if (orderly)
+        SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    else if (SSL_is_init_finished(ssl))
+        m_stats.sessionsEvicted.fetch_add(1, std::memory_order_relaxed);
+
+    /* SSL_clear keeps what SSL_new copies from the context and frees the per-connection state */
+    if (r.sslPool.size() < m_config.sslPoolSize) {
+        ERR_clear_error();
+        if (SSL_clear(ssl) == 1) {
+            r.sslPool.push_back(ssl);
+            m_stats.sslPooled.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ERR_clear_error();
     }
+    SSL_free(ssl);
+}
+
+uint8_t* TlsServer::prepareRx(Connection& conn) {
+    auto& buf = conn.rxBuffer;
+    const size_t held = buf.allocated();
 
-    m_addrMap.erase(fd);
-    m_rxBuffer.erase(fd);
+    uint8_t* dst = buf.prepare(TLS_RECV_CHUNK_SIZE);
+    if (buf.allocated() != held)
+        m_stats.rxBufferBytes.fetch_add(buf.allocated() - held, std::memory_order_relaxed);
+    return dst;
+}
+
+void TlsServer::shrinkRxBuffer(Connection& conn) {
+    /* after a read burst: no partial frame left, the storage goes back until the next read */
+    if (!m_config.releaseBuffers || !conn.rxBuffer.empty())
+        return;
+
+    m_stats.rxBufferBytes.fetch_sub(conn.rxBuffer.allocated(), std::memory_order_relaxed);
+    conn.rxBuffer.shrink();
+}
+
+void TlsServer::releaseRxBuffer(Connection& conn) {
+    m_stats.rxBufferBytes.fetch_sub(conn.rxBuffer.allocated(), std::memory_order_relaxed);
+    conn.rxBuffer = RxBuffer(0);
+}
+
+void TlsServer::armConnTimer(Reactor& r, Connection& conn) {
+    /* one timer per connection, its deadline follows the phase: handshake, first frame, idle */
+    int ms = m_config.idleTimeoutMs;
+    if (!conn.crypto.load(std::memory_order_relaxed) && !SSL_is_init_finished(conn.ssl))
+        ms = m_config.handshakeTimeoutMs;
+    else if (!conn.framed)
+        ms = m_config.firstFrameTimeoutMs;
+
+    if (ms > 0)
+        r.timers.arm(conn, r.nowMs, (uint64_t)ms);
+    else
+        r.timers.cancel(conn);
+}
+
+void TlsServer::onConnTimer(Reactor& r, Connection& conn) {
+    const int fd = conn.fd;
+
+    if (!conn.crypto.load(std::memory_order_relaxed) && !SSL_is_init_finished(conn.ssl)) {
+        m_stats.timeoutsHandshake.fetch_add(1, std::memory_order_relaxed);
+        LOG_DEBUG("TlsServer: handshake timeout fd={}", fd);
+        handleClose(r, fd, CloseReason::ERROR);
+        return;
+    }
+
+    if (!conn.framed) {
+        m_stats.timeoutsFirstFrame.fetch_add(1, std::memory_order_relaxed);
+        LOG_DEBUG("TlsServer: first frame timeout fd={}", fd);
+        handleClose(r, fd, CloseReason::ERROR);
+        return;
+    }
+
+    /* frames since arming pushed the deadline out; a worker's clock may be a little ahead of r.nowMs.
+     * A paused connection is not read, so it is not idle either */
+    const uint64_t idleMs = (uint64_t)m_config.idleTimeoutMs;
+    const uint64_t lastRxMs = conn.lastRxMs.load(std::memory_order_relaxed);
+    if (conn.txPaused || r.nowMs < lastRxMs + idleMs) {
+        r.timers.arm(conn, conn.txPaused ? r.nowMs : lastRxMs, idleMs);
+        return;
+    }
+
+    m_stats.timeoutsIdle.fetch_add(1, std::memory_order_relaxed);
+    LOG_DEBUG("TlsServer: idle timeout fd={} sessionId={}", fd, conn.sessionId.load(std::memory_order_relaxed));
+    handleClose(r, fd, CloseReason::IDLE);
+}
+
+void TlsServer::dumpStats() {
+    std::string perReactor;
+    for (auto& r : m_reactors) {
+        if (!perReactor.empty())
+            perReactor += ' ';
+        perReactor += std::to_string(r->connCount.load(std::memory_order_relaxed));
+    }
+    LOG_TRACE("TlsServer reactors({} balance={}): conns=[{}]", m_reactors.size(),
+              m_config.balance == TlsBalance::HASH ? "hash" : "least-conn", perReactor);
+
+    const uint64_t handshakes = m_stats.handshakes.load(std::memory_order_relaxed);
+    const uint64_t resumed = m_stats.handshakesResumed.load(std::memory_order_relaxed);
+
+    LOG_TRACE("TlsServer handshake(workers={}): done={} full={} resumed={} resumedPct={:.1f} failed={} evicted={} avgMs={:.2f}",
+              m_hsWorkers.size(), handshakes, handshakes - resumed, resumed,
+              handshakes ? 100.0 * (double)resumed / (double)handshakes : 0.0,
+              m_stats.handshakeFailures.load(std::memory_order_relaxed),
+              m_stats.sessionsEvicted.load(std::memory_order_relaxed),
+              handshakes ? (double)m_stats.handshakeUs.load(std::memory_order_relaxed) / 1000.0 / (double)handshakes : 0.0);
+
+    LOG_TRACE("TlsServer ktls(enabled={}): txSessions={} rxSessions={} of {} handshakes",
+              (SSL_CTX_get_options(m_ctx) & SSL_OP_ENABLE_KTLS) != 0,
+              m_stats.ktlsTx.load(std::memory_order_relaxed),
+              m_stats.ktlsRx.load(std::memory_order_relaxed), handshakes);
+
+    if (!m_cryptoWorkers.empty()) {
+        LOG_TRACE("TlsServer engine(memory-bio workers={}): sessions={} rxJobs={} txJobs={} cipherRxMB={:.1f} cipherTxMB={:.1f} rxPauses={}",
+                  m_cryptoWorkers.size(),
+                  m_stats.cryptoSessions.load(std::memory_order_relaxed),
+                  m_stats.cryptoRxJobs.load(std::memory_order_relaxed),
+                  m_stats.cryptoTxJobs.load(std::memory_order_relaxed),
+                  (double)m_stats.cipherRxBytes.load(std::memory_order_relaxed) / (1024.0 * 1024.0),
+                  (double)m_stats.cipherTxBytes.load(std::memory_order_relaxed) / (1024.0 * 1024.0),
+                  m_stats.cryptoRxPauses.load(std::memory_order_relaxed));
+    }
+
+    const uint64_t frames = m_stats.txFrames.load(std::memory_order_relaxed);
+    const uint64_t records = m_stats.txRecords.load(std::memory_order_relaxed);
+    LOG_TRACE("TlsServer egress(recordSize={}): frames={} records={} recordsPerFrame={:.3f} avgRecordB={:.0f}",
+              m_config.txRecordSize, frames, records,
+              frames ? (double)records / (double)frames : 0.0,
+              records ? (double)m_stats.txPlainBytes.load(std::memory_order_relaxed) / (double)records : 0.0);
+
+    size_t open = 0;
+    for (auto& r : m_reactors)
+        open += r->connCount.load(std::memory_order_relaxed);
+    const TlsMemoryStats mem = TlsMemory::stats();
+    const uint64_t rxBytes = m_stats.rxBufferBytes.load(std::memory_order_relaxed);
+
+    /* per connection: OpenSSL's growth since init (session cache and sslPool included) plus rx buffers, over open connections */
+    const uint64_t grown = mem.bytesInUse > m_opensslBaseline ? mem.bytesInUse - m_opensslBaseline : 0;
+    LOG_TRACE("TlsServer memory(accounted={} releaseBuffers={} sslPool={}): open={} opensslKB={:.1f} peakKB={:.1f} rxBufferKB={:.1f} perConnB={} sslNew={} sslReused={} pooled={}",
+              TlsMemory::installed(), m_config.releaseBuffers, m_config.sslPoolSize, open,
+              (double)mem.bytesInUse / 1024.0, (double)mem.peakBytes / 1024.0, (double)rxBytes / 1024.0,
+              open ? (grown + rxBytes) / open : 0,
+              m_stats.sslNew.load(std::memory_order_relaxed),
+              m_stats.sslReused.load(std::memory_order_relaxed),
+              m_stats.sslPooled.load(std::memory_order_relaxed));
+
+    LOG_TRACE("TlsServer backpressure(high={} low={}): pauses={} resumes={}",
+              m_config.txHighWatermark, m_config.txLowWatermark,
+              m_stats.rxPauses.load(std::memory_order_relaxed),
+              m_stats.rxResumes.load(std::memory_order_relaxed));
+
+    LOG_TRACE("TlsServer timeouts(handshake={}ms firstFrame={}ms idle={}ms): handshake={} firstFrame={} idle={}",
+              m_config.handshakeTimeoutMs, m_config.firstFrameTimeoutMs, m_config.idleTimeoutMs,
+              m_stats.timeoutsHandshake.load(std::memory_order_relaxed),
+              m_stats.timeoutsFirstFrame.load(std::memory_order_relaxed),
+              m_stats.timeoutsIdle.load(std::memory_order_relaxed));
 }
 
 bool TlsServer::setNonBlocking(int fd) {
@@ -392,38 +1626,59 @@ void TlsServer::drainEventFd(int efd) {
     while (read(efd, &v, sizeof(v)) > 0) {}
 }
 
-bool TlsServer::addToEpoll(int fd, uint32_t events) {
+bool TlsServer::addToEpoll(int epFd, int fd, uint32_t events) {
     epoll_event ev{};
     ev.events = events;
     ev.data.fd = fd;
-    return epoll_ctl(m_epFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+    return epoll_ctl(epFd, EPOLL_CTL_ADD, fd, &ev) == 0;
 }
 
-bool TlsServer::modEpoll(int fd, uint32_t events) {
+bool TlsServer::modEpoll(int epFd, int fd, uint32_t events) {
     epoll_event ev{};
     ev.events = events;
     ev.data.fd = fd;
-    return epoll_ctl(m_epFd, EPOLL_CTL_MOD, fd, &ev) == 0;
+    return epoll_ctl(epFd, EPOLL_CTL_MOD, fd, &ev) == 0;
 }
 
-void TlsServer::setInterest(int fd, bool wantOut) {
-    uint32_t ev = EPOLLIN | EPOLLRDHUP;
+void TlsServer::setInterest(Reactor& r, int fd, bool wantOut) {
+    Connection* conn = findOwned(r, fd);
+    if (!conn)
+        return;
+
+    uint32_t ev = (conn->rxPaused || conn->txPaused) ? EPOLLRDHUP : (EPOLLIN | EPOLLRDHUP);
     if (wantOut) ev |= EPOLLOUT;
-    modEpoll(fd, ev);
+    if (ev == conn->interest)
+        return;
+
+    modEpoll(r.epFd, fd, ev);
+    conn->interest = ev;
+}
+
+void TlsServer::releaseAdmission(const sockaddr_in& peer) {
+    if (m_releaseAdmission)
+        m_releaseAdmission(peer);
+}
+
+void TlsServer::setAdmissionRelease(std::function<void(const sockaddr_in&)> release) {
+    m_releaseAdmission = std::move(release);
 }
 
 void TlsServer::handleTlsConnection(int fd, std::pair<sockaddr_in, sockaddr_in> connInfo){
     if (!setNonBlocking(fd)) {
+        releaseAdmission(connInfo.second);
         close(fd);
         return;
     }
 
+    /* counted from here, so handovers racing on other tcp reactors see the pick */
+    Reactor& r = pickReactor(connInfo);
+    r.connCount.fetch_add(1, std::memory_order_relaxed);
     {
-        std::lock_guard<std::mutex> lock(m_handoverLock);
-        m_handoverQueue.push(HandoverItem{fd, connInfo});
+        std::lock_guard<std::mutex> lock(r.handoverLock);
+        r.handoverQueue.push(HandoverItem{fd, connInfo});
     }
 
     uint64_t v = 1;
-    write(m_handoverEventFd, &v, sizeof(v));
+    write(r.handoverEventFd, &v, sizeof(v));
 }
 
@@ -1,13 +1,21 @@
 #pragma once
 
+#include "protocol/tls/TlsConfig.h"
+#include "util/FdSlab.h"
+#include "util/MpscQueue.h"
+#include "util/RxBuffer.h"
+#include "util/TimerWheel.h"
+#include "util/TxHandoff.h"
+
 #include <openssl/ssl.h>
 
 #include <cstdint>
 #include <mutex>
 #include <condition_variable>
+#include <functional>
 #include <queue>
+#include <memory>
 #include <deque>
-#include <unordered_map>
 #include <vector>
 #include <utility>
 #include <atomic>
@@ -21,6 +29,34 @@ class ThreadManager;
 
 class Packet;
 
+struct TlsStats {
+    std::atomic<uint64_t> handshakes{0};          // SSL_accept completed
+    std::atomic<uint64_t> handshakesResumed{0};   // of those, abbreviated via ticket or session cache
+    std::atomic<uint64_t> handshakeFailures{0};   // SSL_accept failed or the peer went away, timeouts are counted below
+    std::atomic<uint64_t> handshakeUs{0};         // handover to completion, summed over handshakes
+    std::atomic<uint64_t> ktlsTx{0};              // sessions whose record encryption went to the kernel
+    std::atomic<uint64_t> ktlsRx{0};              // sessions whose record decryption went to the kernel
+    std::atomic<uint64_t> timeoutsHandshake{0};   // SSL_accept did not finish in time
+    std::atomic<uint64_t> timeoutsFirstFrame{0};  // handshake done, no complete frame followed
+    std::atomic<uint64_t> timeoutsIdle{0};
+    std::atomic<uint64_t> cryptoSessions{0};      // sessions moved to memory BIOs on a tls_worker
+    std::atomic<uint64_t> cryptoRxJobs{0};
+    std::atomic<uint64_t> cryptoTxJobs{0};
+    std::atomic<uint64_t> cipherRxBytes{0};       // ciphertext the reactor read for the workers
+    std::atomic<uint64_t> cipherTxBytes{0};       // ciphertext the workers produced for the reactor
+    std::atomic<uint64_t> cryptoRxPauses{0};      // reads paused because a worker fell behind
+    std::atomic<uint64_t> rxPauses{0};            // connections that crossed the tx high watermark
+    std::atomic<uint64_t> rxResumes{0};
+    std::atomic<uint64_t> txFrames{0};            // frames handed to SSL_write
+    std::atomic<uint64_t> txRecords{0};           // SSL_write calls on staged frames, one TLS record each
+    std::atomic<uint64_t> txPlainBytes{0};
+    std::atomic<uint64_t> sslNew{0};              // SSL_new at handover
+    std::atomic<uint64_t> sslReused{0};           // handovers served from a reactor's sslPool
+    std::atomic<uint64_t> sslPooled{0};           // SSL objects sitting in the pools now
+    std::atomic<uint64_t> sessionsEvicted{0};     // closes that were not orderly, their session left the cache
+    std::atomic<uint64_t> rxBufferBytes{0};       // rx buffer heap held by open connections
+};
+
 class TlsServer {
 public:
     struct HandoverItem {
@@ -28,7 +64,8 @@ public:
         std::pair <sockaddr_in, sockaddr_in> connInfo;
     };
 
-    TlsServer(SSL_CTX *ctx, RxRouter *rxRouter, int workerCount, ThreadManager *threadManager);
+    TlsServer(SSL_CTX *ctx, RxRouter *rxRouter, int workerCount, ThreadManager *threadManager,
+              const TlsConfig &config);
 
     ~TlsServer();
 
@@ -36,61 +73,290 @@ public:
 
     void stopReact();
 
+    /* every handed-over fd carries an admission slot of the caller; it goes back through this on close */
+    void setAdmissionRelease(std::function<void(const sockaddr_in &)> release);
+
     void handleTlsConnection(int fd, std::pair <sockaddr_in, sockaddr_in> connInfo);
 
     void enqueueTx(std::unique_ptr <Packet> packet);
 
+    void dumpStats();
+
 private:
+    /* why a connection closed; decides whether its session stays in the server cache */
+    enum class CloseReason {
+        ERROR,   // TLS, framing or socket error, a failed handshake or a timeout before the first frame
+        PEER,    // the peer closed; orderly only if its close_notify was read
+        IDLE,    // idle timeout after frames were exchanged
+    };
+
+    /*
+     * One slot of m_conns, reused with the fd. Workers push into txQueue and link the
+     * connection on its reactor's txReady (MpscNode); everything else belongs to that
+     * reactor, including the TimerNode on its wheel. Once crypto is set the SSL, rxBuffer and the txQueue consumer
+     * side belong to the tls_worker the connection is pinned to, and the reactor sends
+     * what the worker pushes on cipherQueue. The SSL comes back to the reactor with CLOSED.
+     */
+    struct Connection : MpscNode, TimerNode {
+        int fd{-1};
+        std::atomic<bool> open{false};
+        std::atomic<uint32_t> gen{0};   // bumped on every handover of this fd
+        std::atomic<int> owner{-1};     // reactor index, set at handover
+        SSL *ssl{nullptr};
+        std::pair <sockaddr_in, sockaddr_in> addr{};
+        RxBuffer rxBuffer{0};
+        uint32_t interest{0};           // epoll mask currently registered
+        std::atomic<uint64_t> sessionId{0};    // last non-zero sessionId seen in a frame header
+        bool handshaking{false};        // SSL and TimerNode belong to a handshake worker until it hands back
+        uint64_t acceptedMs{0};         // handover time, for the handshake latency stat
+        bool ktlsTx{false};             // kernel TLS: the socket encrypts, SSL_write passes records through
+        bool ktlsRx{false};             // kernel TLS: the socket decrypts
+        std::atomic<bool> framed{false};       // a complete frame arrived: the timer is an idle timer now
+        std::atomic<uint64_t> lastRxMs{0};     // last complete frame, checked when the idle timer fires
+        int cryptoWorker{0};                   // tls_worker index, frames are delivered in order there
+        std::atomic<bool> crypto{false};       // memory BIOs: record crypto on cryptoWorker
+        std::atomic<bool> txCryptoPending{false};  // a TX job for cryptoWorker is queued
+        std::atomic<size_t> rxInflight{0};     // ciphertext posted to the worker and not yet decrypted
+        std::atomic<bool> rxResumeWanted{false};   // reactor paused reads, the worker signals once drained
+        bool rxPaused{false};                  // reactor only: EPOLLIN is off
+        bool txPaused{false};                  // reactor only: over the tx high watermark, EPOLLIN is off
+        std::atomic<size_t> txQueuedBytes{0};  // plaintext and ciphertext accepted and not yet written
+        CloseReason closeReason{CloseReason::ERROR};   // reactor only: held while the worker lets go of the SSL
+
+        MpscQueue <Packet> txQueue;                       // owns the queued packets
+        std::deque<std::unique_ptr < Packet>> txRetry;    // reactor only: pushed back, sent before txQueue
+        std::vector<uint8_t> txPending;                   // reactor only: staged bytes an SSL_write left on WANT_WRITE
+        std::atomic<bool> txScheduled{false};             // on the owner's txReady
+        MpscQueue <Packet> cipherQueue;                   // crypto: TLS records from the worker, sent as is
+    };
+
+    /* One handshake thread. Owns the fds it was given (epoll set, SSL, TimerNode) until SSL_accept finishes */
+    struct HandshakeWorker {
+        int idx{0};
+        int epFd{-1};
+        int eventFd{-1};
+
+        std::mutex inboxLock;
+        std::vector<int> inbox;
+
+        TimerWheel timers;
+        uint64_t nowMs{0};
+    };
+
+    struct HandshakeResult {
+        int fd{-1};
+        uint32_t gen{0};
+        bool ok{false};
+    };
+
+    enum class CryptoOp {
+        RX,        // ciphertext from the socket: decrypt, frame, dispatch
+        TX,        // txQueue has plaintext: encrypt into cipherQueue
+        DELIVER,   // a frame the reactor parsed (SOCKET engine session), dispatch in order
+        CLOSE,     // release the worker side buffers and hand the connection back
+    };
+
+    struct CryptoJob {
+        CryptoOp op{CryptoOp::RX};
+        int fd{-1};
+        uint32_t gen{0};
+        std::vector<uint8_t> data;
+        std::unique_ptr<Packet> pkt;
+    };
+
+    /* One tls_worker in MEMORY_BIO mode. Jobs of a connection run in post order on its pinned worker */
+    struct CryptoWorker {
+        int idx{0};
+        std::mutex lock;
+        std::condition_variable cv;
+        std::vector<CryptoJob> jobs;
+        std::vector<uint8_t> txStage;   // frames gathered into one record
+    };
+
+    enum class CryptoNotice {
+        CLOSE,       // worker hit a TLS or framing error
+        PEER_CLOSE,  // worker read the peer's close_notify
+        CLOSED,      // worker let go of the SSL, the fd can be closed
+        RX_RESUME,   // rxInflight drained below the resume mark
+    };
+
+    struct CryptoEvent {
+        CryptoNotice what{CryptoNotice::CLOSE};
+        int fd{-1};
+        uint32_t gen{0};
+    };
+
+    /* One epoll loop. Handed over fds are spread across reactors, each owns its connections until they close */
+    struct Reactor {
+        int idx{0};
+        int epFd{-1};
+        int stopEventFd{-1};
+        int handoverEventFd{-1};
+        int txEventFd{-1};
+        int handshakeEventFd{-1};
+        int cryptoEventFd{-1};
+
+        std::atomic<size_t> connCount{0};   // handed over and not yet closed, for least-connections
+
+        std::mutex handoverLock;
+        std::queue <HandoverItem> handoverQueue;
+        bool handoverPending{false};   // drained after the current epoll batch
+
+        /* handshake, first-frame and idle deadlines; nowMs is taken once per loop pass */
+        TimerWheel timers;
+        uint64_t nowMs{0};
+
+        /* results from the handshake and crypto workers for connections owned here */
+        std::mutex hsDoneLock;
+        std::vector <HandshakeResult> hsDone;
+        std::mutex cryptoEventLock;
+        std::vector <CryptoEvent> cryptoEvents;
+        std::vector <uint8_t> cipherScratch;   // recv buffer, copied into RX jobs
+        std::vector <uint8_t> txStage;         // frames gathered into one SSL_write, reused across connections
+
+        /* connections with queued packets, one txEventFd write per drain */
+        TxHandoff <Connection> txReady;
+
+        /* closed SSL objects reset with SSL_clear, handed out again before SSL_new */
+        std::vector<SSL *> sslPool;
+    };
+
     bool init();
 
+    bool initReactor(Reactor &r);
+
     void deinit();
 
+    void startReactors();
+
+    void runReactor(Reactor &r);
+
+    Reactor &pickReactor(const std::pair <sockaddr_in, sockaddr_in> &connInfo);
+
+    Reactor &ownerOf(const Connection &conn);
+
     void startWorkers();
 
     void stopWorker();
 
     void processPacket();
 
-    void handleEvent(const epoll_event &ev);
+    void handleEvent(Reactor &r, const epoll_event &ev);
+
+    void handleStopEvent(Reactor &r);
+
+    void handleHandoverEvent(Reactor &r);
+
+    void handleTxEvent(Reactor &r);
+
+    void handleHandshakeDoneEvent(Reactor &r);
+
+    void processHandoverQueue(Reactor &r);
+
+    Connection *findOwned(Reactor &r, int fd);
+
+    void handleHandshake(Reactor &r, int fd, Connection &conn);
+
+    void startHandshakeWorkers();
 
-    void handleStopEvent();
+    void runHandshakeWorker(HandshakeWorker &w);
 
-    void handleHandoverEvent();
+    void stopHandshakeWorker(HandshakeWorker &w);
 
-    void handleTxEvent();
+    void offloadHandshake(int fd, Connection &conn);
 
-    void processHandoverQueue();
+    void stepHandshake(HandshakeWorker &w, int fd, Connection &conn);
 
-    bool isHandshakeDone(int fd) const;
+    void finishHandshake(HandshakeWorker &w, int fd, Connection &conn, bool ok);
 
-    void handleHandshake(int fd);
+    void completeHandshake(Connection &conn, uint64_t nowMs);
 
-    void receivePacket(int fd);
+    void onHandshakeDone(Reactor &r, int fd, Connection &conn);
 
-    void handleClose(int fd);
+    void receivePacket(Reactor &r, int fd, Connection &conn);
+
+    bool parseFrames(Connection &conn, uint64_t nowMs);
+
+    void deliver(Connection &conn, std::unique_ptr <Packet> pkt);
+
+    void handleClose(Reactor &r, int fd, CloseReason reason);
+
+    void finishClose(Reactor &r, int fd, Connection &conn, CloseReason reason);
+
+    void releaseAdmission(const sockaddr_in &peer);
+
+    SSL *newSsl(Reactor &r);
+
+    void recycleSsl(Reactor &r, SSL *ssl, CloseReason reason);
+
+    uint8_t *prepareRx(Connection &conn);
+
+    void shrinkRxBuffer(Connection &conn);
+
+    void releaseRxBuffer(Connection &conn);
+
+    void startCryptoWorkers();
+
+    void runCryptoWorker(CryptoWorker &w);
+
+    void stopCryptoWorker(CryptoWorker &w);
+
+    bool attachCryptoWorker(Reactor &r, int fd, Connection &conn);
+
+    void postCryptoJob(Connection &conn, CryptoJob job);
+
+    void postCryptoTx(Connection &conn);
+
+    void runCryptoJob(CryptoJob &job);
+
+    void cryptoRx(Connection &conn, const std::vector<uint8_t> &cipher);
+
+    void cryptoTx(Connection &conn);
+
+    void drainCipher(Connection &conn);
+
+    void notifyReactor(const Connection &conn, CryptoNotice what);
+
+    void handleCryptoEvent(Reactor &r);
+
+    void readCipher(Reactor &r, int fd, Connection &conn);
+
+    size_t flushCipherForFd(Reactor &r, int fd, Connection &conn, size_t budgetItems);
+
+    void armConnTimer(Reactor &r, Connection &conn);
+
+    void onConnTimer(Reactor &r, Connection &conn);
 
     bool setNonBlocking(int fd);
 
     void drainEventFd(int efd);
 
-    bool addToEpoll(int fd, uint32_t events);
+    bool addToEpoll(int epFd, int fd, uint32_t events);
 
-    bool modEpoll(int fd, uint32_t events);
+    bool modEpoll(int epFd, int fd, uint32_t events);
 
-    void setInterest(int fd, bool wantOut);
+    void setInterest(Reactor &r, int fd, bool wantOut);
 
-    bool hasPendingTx(int fd);
+    bool hasPendingTx(Reactor &r, int fd);
 
-    void flushAllPending(size_t budgetItems);
+    void scheduleTx(Connection &conn);
 
-    size_t flushPendingForFd(int fd, size_t budgetItems);
+    void kickTx(Reactor &r);
 
-    SSL_CTX *m_ctx;
+    std::unique_ptr <Packet> popTx(Connection &conn);
+
+    size_t stageTx(Reactor &r, Connection &conn, size_t budgetItems);
+
+    void dropTxQueue(Connection &conn);
+
+    void flushAllPending(Reactor &r, size_t budgetItems);
 
-    int m_epFd;
-    int m_stopEventFd;
-    int m_handoverEventFd;
-    int m_txEventFd;
+    size_t flushPendingForFd(Reactor &r, int fd, size_t budgetItems);
+
+    void updateBackpressure(Reactor &r, Connection &conn);
+
+    SSL_CTX *m_ctx;
+    TlsConfig m_config;
 
     std::atomic<bool> m_running{false};
     int m_workerCount;
@@ -98,19 +364,29 @@ private:
     ThreadManager *m_threadManager;
     RxRouter *m_rxRouter;
 
-    std::unordered_map<int, SSL *> m_sslMap;
-    std::unordered_map<int, std::pair<sockaddr_in, sockaddr_in>> m_addrMap;
-    std::unordered_map<int, std::vector<uint8_t>> m_rxBuffer;
+    /* TcpServer's maxConnections/maxConnectionsPerIp slot, held until finishClose */
+    std::function<void(const sockaddr_in &)> m_releaseAdmission;
+
+    std::vector <std::unique_ptr<Reactor>> m_reactors;
+    std::atomic<size_t> m_reactorNext{0};   // least-connections tie breaker
+
+    /* per-fd connection state, shared by all reactors; each slot is owned by the reactor it was handed to */
+    FdSlab <Connection> m_conns;
+
+    TlsStats m_stats;
+    uint64_t m_opensslBaseline{0};   // OpenSSL heap in use when the server was built
+
+    /* handshake offload: fds go out round robin, results come back through the owner's handshakeEventFd */
+    std::vector <std::unique_ptr<HandshakeWorker>> m_hsWorkers;
+    std::atomic<size_t> m_hsNext{0};
+
+    /* MEMORY_BIO engine: one CryptoWorker per tls_worker thread, notices come back through the owner's cryptoEventFd */
+    std::vector <std::unique_ptr<CryptoWorker>> m_cryptoWorkers;
+    std::atomic<size_t> m_cryptoNext{0};
 
     std::mutex m_rxLock;
     std::condition_variable m_cv;
     std::queue <std::unique_ptr<Packet>> m_rxQueue;
-
-    std::mutex m_handoverLock;
-    std::queue <HandoverItem> m_handoverQueue;
-
-    std::mutex m_txLock;
-    std::unordered_map<int, std::deque<std::unique_ptr < Packet>>> m_txQueue;
 };
 
 
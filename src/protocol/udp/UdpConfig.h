@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+
+struct UdpConfig {
+    int batchSize = 32;    // datagrams per recvmmsg / sendmmsg call
+    bool gso = true;       // UDP_SEGMENT for same-peer bursts, disabled if the kernel rejects it
+    bool gro = true;       // UDP_GRO coalesced receive
+    bool shardSockets = false;  // one SO_REUSEPORT socket per shard, steered by session id
+    int shardCount = 1;         // must match the shard worker count
+};
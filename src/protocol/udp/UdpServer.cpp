@@ -9,23 +9,34 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <cstring>
+#include <algorithm>
 #include <sys/socket.h>
 #include <sys/eventfd.h>
 #include <arpa/inet.h>
+#include <netinet/udp.h>
+#include <linux/filter.h>
 
 #define UDP_RECV_CHUNK_SIZE     (2048)
 #define UDP_MAX_RX_BUFFER_SIZE  (256 * 1024) // 256 KB
 #define UDP_MAX_EVENTS          (64)
+#define UDP_MAX_BATCH_SIZE      (UIO_MAXIOV)
+#define UDP_GRO_BUFFER_SIZE     (64 * 1024)
+#define UDP_MAX_GSO_SEGMENTS    (64)
+#define UDP_MAX_GSO_BYTES       (65507) // 65535 - IPv4 header - UDP header
+#define UDP_CTRL_SIZE           (CMSG_SPACE(sizeof(int)))
+#define UDP_SHARD_KEY_OFFSET    (4) // CommonPacketHeader::sessionId
 
 
 UdpServer::UdpServer(int port,
                      RxRouter *rxRouter,
                      int workerCount,
-                     ThreadManager *threadManager)
+                     ThreadManager *threadManager,
+                     const UdpConfig &config)
         : m_port(port),
           m_rxRouter(rxRouter),
           m_threadManager(threadManager),
-          m_workerCount(workerCount) {
+          m_workerCount(workerCount),
+          m_config(config) {
     init();
 }
 
@@ -34,100 +45,143 @@ UdpServer::~UdpServer() {
 }
 
 bool UdpServer::init() {
-    m_stopEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
-    if (m_stopEventFd < 0) {
-        LOG_ERROR("UdpServer: stop eventfd create failed");
-        return false;
+    m_batchSize = (size_t) std::clamp(m_config.batchSize, 1, UDP_MAX_BATCH_SIZE);
+    m_shardSockets = m_config.shardSockets && m_config.shardCount > 1;
+
+    m_serverAddr.sin_family = AF_INET;
+    m_serverAddr.sin_addr.s_addr = INADDR_ANY;
+    m_serverAddr.sin_port = htons(m_port);
+
+    /* bind order defines the reuseport group index, so reactor i is the socket the filter returns for shard i */
+    int reactorCount = m_shardSockets ? m_config.shardCount : 1;
+    for (int i = 0; i < reactorCount; ++i) {
+        auto reactor = std::make_unique<Reactor>();
+        reactor->idx = i;
+
+        if (!initReactor(*reactor)) {
+            LOG_ERROR("UdpServer: reactor {} init failed errno={}", i, errno);
+            return false;
+        }
+        m_reactors.push_back(std::move(reactor));
     }
 
-    m_txEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
-    if (m_txEventFd < 0) {
-        LOG_ERROR("UdpServer: tx eventfd create failed");
-        close(m_stopEventFd);
-        m_stopEventFd = -1;
-        return false;
+    if (m_shardSockets && !attachShardFilter()) {
+        LOG_WARN("UdpServer: SO_ATTACH_REUSEPORT_CBPF failed errno={}, fallback to kernel hash", errno);
     }
 
-    m_sockFd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (m_sockFd < 0) {
-        LOG_ERROR("UdpServer: socket create failed errno={}", errno);
+    LOG_INFO("UdpServer: {} socket(s) on port {} shardSockets={}", m_reactors.size(), m_port, m_shardSockets);
+    return true;
+}
+
+bool UdpServer::initReactor(Reactor &r) {
+    r.stopEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (r.stopEventFd < 0)
+        return false;
+
+    r.txEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (r.txEventFd < 0)
+        return false;
+
+    r.sockFd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (r.sockFd < 0)
         return false;
-    }
 
     int opt = 1;
-    setsockopt(m_sockFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(r.sockFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (m_shardSockets && setsockopt(r.sockFd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) != 0)
+        return false;
 
     int rcv = UDP_MAX_RX_BUFFER_SIZE;
-    setsockopt(m_sockFd, SOL_SOCKET, SO_RCVBUF, &rcv, sizeof(rcv));
+    setsockopt(r.sockFd, SOL_SOCKET, SO_RCVBUF, &rcv, sizeof(rcv));
 
-    if (!setNonBlocking(m_sockFd)) {
-        LOG_ERROR("UdpServer: setNonBlocking failed errno={}", errno);
+    if (!setNonBlocking(r.sockFd))
         return false;
-    }
 
-    m_serverAddr.sin_family = AF_INET;
-    m_serverAddr.sin_addr.s_addr = INADDR_ANY;
-    m_serverAddr.sin_port = htons(m_port);
+    initOffload(r);
 
-    if (bind(m_sockFd, (sockaddr * ) & m_serverAddr, sizeof(m_serverAddr)) != 0) {
-        LOG_ERROR("UdpServer: bind failed errno={}", errno);
+    if (bind(r.sockFd, (sockaddr * ) & m_serverAddr, sizeof(m_serverAddr)) != 0)
         return false;
-    }
 
-    m_epFd = epoll_create1(0);
-    if (m_epFd < 0) {
-        LOG_ERROR("UdpServer: epoll_create1 failed errno={}", errno);
+    r.epFd = epoll_create1(0);
+    if (r.epFd < 0)
         return false;
-    }
 
-    if (!addToEpoll(m_sockFd, EPOLLIN) ||
-        !addToEpoll(m_stopEventFd, EPOLLIN) ||
-        !addToEpoll(m_txEventFd, EPOLLIN)) {
-        LOG_ERROR("UdpServer: epoll_ctl add failed errno={}", errno);
+    if (!addToEpoll(r.epFd, r.sockFd, EPOLLIN) ||
+        !addToEpoll(r.epFd, r.stopEventFd, EPOLLIN) ||
+        !addToEpoll(r.epFd, r.txEventFd, EPOLLIN))
         return false;
-    }
 
     return true;
 }
 
-void UdpServer::deinit() {
-    {
-        std::lock_guard <std::mutex> lock(m_txLock);
-        m_txQueue.clear();
-    }
+/*
+ * Steer each datagram to the socket of the shard that owns its session:
+ *   A = payload[4..8)        high 32 bits of CommonPacketHeader::sessionId (big-endian)
+ *   A = A % shardCount       same as RxRouter::selectShard
+ *   return A                 reuseport group index == reactor idx == shard idx
+ * The filter runs on the UDP payload. Datagrams shorter than 8 bytes abort the
+ * load and land on socket 0, where the parser rejects them.
+ */
+bool UdpServer::attachShardFilter() {
+    sock_filter code[] = {
+            {BPF_LD | BPF_W | BPF_ABS,  0, 0, UDP_SHARD_KEY_OFFSET},
+            {BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t) m_reactors.size()},
+            {BPF_RET | BPF_A,           0, 0, 0},
+    };
+
+    sock_fprog prog{};
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+
+    return setsockopt(m_reactors[0]->sockFd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == 0;
+}
 
+void UdpServer::deinit() {
     {
         std::lock_guard <std::mutex> lock(m_rxLock);
         while (!m_rxQueue.empty()) m_rxQueue.pop();
     }
 
-    if (m_epFd >= 0) {
-        close(m_epFd);
-        m_epFd = -1;
-    }
-    if (m_sockFd >= 0) {
-        close(m_sockFd);
-        m_sockFd = -1;
-    }
-    if (m_stopEventFd >= 0) {
-        close(m_stopEventFd);
-        m_stopEventFd = -1;
-    }
-    if (m_txEventFd >= 0) {
-        close(m_txEventFd);
-        m_txEventFd = -1;
+    for (auto &r: m_reactors) {
+        {
+            std::lock_guard <std::mutex> lock(r->txLock);
+            r->txQueue.clear();
+        }
+
+        if (r->epFd >= 0) close(r->epFd);
+        if (r->sockFd >= 0) close(r->sockFd);
+        if (r->stopEventFd >= 0) close(r->stopEventFd);
+        if (r->txEventFd >= 0) close(r->txEventFd);
     }
+    m_reactors.clear();
 }
 
 void UdpServer::start() {
     m_running = true;
-    startWorkers();
+    if (!m_shardSockets)
+        startWorkers();
+    startReactors();
+
+    if (!m_reactors.empty())
+        runReactor(*m_reactors[0]);
+}
 
+void UdpServer::startReactors() {
+    /* reactor 0 runs on the caller thread (udp_reactor) */
+    for (size_t i = 1; i < m_reactors.size(); ++i) {
+        m_threadManager->addThread(
+                "udp_reactor_" + std::to_string(i),
+                std::bind(&UdpServer::runReactor, this, std::ref(*m_reactors[i])),
+                std::bind(&UdpServer::stopReact, this));
+    }
+}
+
+void UdpServer::runReactor(Reactor &r) {
     epoll_event events[UDP_MAX_EVENTS];
-    m_rxBuffer.resize(UDP_RECV_CHUNK_SIZE);
+    initBatch(r);
 
     while (m_running) {
-        int n = epoll_wait(m_epFd, events, UDP_MAX_EVENTS, -1);
+        int n = epoll_wait(r.epFd, events, UDP_MAX_EVENTS, -1);
         if (n < 0) {
             if (errno == EINTR) continue;
             LOG_ERROR("UdpServer: epoll_wait failed errno={}", errno);
@@ -135,7 +189,7 @@ void UdpServer::start() {
         }
 
         for (int i = 0; i < n; ++i) {
-            handleEvent(events[i]);
+            handleEvent(r, events[i]);
         }
     }
 }
@@ -144,9 +198,10 @@ void UdpServer::stopReact() {
     m_running = false;
     m_cv.notify_all();
 
-    if (m_stopEventFd >= 0) {
-        uint64_t v = 1;
-        (void) write(m_stopEventFd, &v, sizeof(v));
+    uint64_t v = 1;
+    for (auto &r: m_reactors) {
+        if (r->stopEventFd >= 0)
+            (void) write(r->stopEventFd, &v, sizeof(v));
     }
 }
 
@@ -183,179 +238,409 @@ void UdpServer::processPacket() {
     }
 }
 
-void UdpServer::handleEvent(const epoll_event &ev) {
+void UdpServer::handleEvent(Reactor &r, const epoll_event &ev) {
     const int fd = ev.data.fd;
 
-    if (fd == m_stopEventFd) {
-        handleStopEvent();
+    if (fd == r.stopEventFd) {
+        handleStopEvent(r);
         return;
     }
 
-    if (fd == m_txEventFd) {
-        handleTxEvent();
+    if (fd == r.txEventFd) {
+        handleTxEvent(r);
         return;
     }
 
-    if (fd == m_sockFd) {
+    if (fd == r.sockFd) {
         if (ev.events & (EPOLLERR | EPOLLHUP)) {
-            LOG_ERROR("UdpServer: socket error/hup");
+            LOG_ERROR("UdpServer: socket error/hup reactor={}", r.idx);
             handleClose();
             return;
         }
 
         if (ev.events & EPOLLIN) {
-            receivePacket();
+            receivePacket(r);
             return;
         }
     }
 }
 
-void UdpServer::handleStopEvent() {
-    drainEventFd(m_stopEventFd);
+void UdpServer::handleStopEvent(Reactor &r) {
+    drainEventFd(r.stopEventFd);
     m_running = false;
     m_cv.notify_all();
 }
 
-void UdpServer::handleTxEvent() {
-    drainEventFd(m_txEventFd);
-    flushAllPending(256);
+void UdpServer::handleTxEvent(Reactor &r) {
+    drainEventFd(r.txEventFd);
+    flushAllPending(r, 256);
+}
+
+void UdpServer::initOffload(Reactor &r) {
+    int on = 1;
+    if (m_config.gro) {
+        if (setsockopt(r.sockFd, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0) {
+            r.groEnabled = true;
+        } else {
+            LOG_WARN("UdpServer: UDP_GRO not supported errno={}, fallback to plain recv", errno);
+        }
+    }
+
+    /* GSO support is a kernel property, probe it once on the first socket */
+    int segSize = 0;
+    if (m_config.gso && r.idx == 0) {
+        if (setsockopt(r.sockFd, SOL_UDP, UDP_SEGMENT, &segSize, sizeof(segSize)) == 0) {
+            m_gsoEnabled.store(true, std::memory_order_relaxed);
+        } else {
+            LOG_WARN("UdpServer: UDP_SEGMENT not supported errno={}, fallback to plain send", errno);
+        }
+    }
+
+    LOG_INFO("UdpServer: reactor {} offload gro={} gso={}", r.idx, r.groEnabled,
+             m_gsoEnabled.load(std::memory_order_relaxed));
 }
 
-void UdpServer::receivePacket() {
-    sockaddr_in clientAddr{};
-    socklen_t addrLen = sizeof(clientAddr);
+void UdpServer::initBatch(Reactor &r) {
+    r.rxSlotSize = r.groEnabled ? UDP_GRO_BUFFER_SIZE : UDP_RECV_CHUNK_SIZE;
+
+    r.rxBuffer.resize(m_batchSize * r.rxSlotSize);
+    r.rxCtrl.resize(m_batchSize * UDP_CTRL_SIZE);
+    r.rxMsgs.resize(m_batchSize);
+    r.rxIov.resize(m_batchSize);
+    r.rxAddrs.resize(m_batchSize);
+    r.rxBatch.reserve(m_batchSize);
+
+    r.txMsgs.resize(m_batchSize);
+    r.txIov.resize(m_batchSize);
+    r.txAddrs.resize(m_batchSize);
+    r.txCtrl.resize(m_batchSize * UDP_CTRL_SIZE);
+    r.txMsgPackets.resize(m_batchSize);
+    r.txBatch.reserve(m_batchSize);
+
+    for (size_t i = 0; i < m_batchSize; ++i) {
+        r.rxIov[i].iov_base = r.rxBuffer.data() + i * r.rxSlotSize;
+        r.rxIov[i].iov_len = r.rxSlotSize;
+    }
+}
 
+void UdpServer::receivePacket(Reactor &r) {
     while (true) {
-        ssize_t bytes = recvfrom(
-                m_sockFd,
-                m_rxBuffer.data(),
-                m_rxBuffer.size(),
-                0,
-                reinterpret_cast<sockaddr *>(&clientAddr),
-                &addrLen);
-
-        if (bytes > 0) {
-            std::vector <uint8_t> payload(m_rxBuffer.begin(), m_rxBuffer.begin() + bytes);
-
-            auto pkt = std::make_unique<Packet>(
-                    m_sockFd,
-                    Protocol::UDP,
-                    std::move(payload),
-                    clientAddr,
-                    m_serverAddr);
+        for (size_t i = 0; i < m_batchSize; ++i) {
+            msghdr &hdr = r.rxMsgs[i].msg_hdr;
+            hdr = msghdr{};
+            hdr.msg_name = &r.rxAddrs[i];
+            hdr.msg_namelen = sizeof(sockaddr_in);
+            hdr.msg_iov = &r.rxIov[i];
+            hdr.msg_iovlen = 1;
+            if (r.groEnabled) {
+                hdr.msg_control = r.rxCtrl.data() + i * UDP_CTRL_SIZE;
+                hdr.msg_controllen = UDP_CTRL_SIZE;
+            }
+            r.rxMsgs[i].msg_len = 0;
+        }
+
+        int n = recvmmsg(r.sockFd, r.rxMsgs.data(), (unsigned int) m_batchSize, MSG_DONTWAIT, nullptr);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
 
+            if (errno == EINTR)
+                continue;
+
+            LOG_ERROR("UdpServer: recvmmsg failed errno={}", errno);
+            return;
+        }
+
+        if (n == 0) {
+            return;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            size_t bytes = r.rxMsgs[i].msg_len;
+            if (bytes == 0)
+                continue;
+
+            /* GRO may hand over several same-size datagrams from one peer in one buffer */
+            size_t segSize = r.groEnabled ? groSegmentSize(r.rxMsgs[i].msg_hdr) : 0;
+            if (segSize == 0 || segSize > bytes)
+                segSize = bytes;
+
+            const uint8_t *data = static_cast<const uint8_t *>(r.rxIov[i].iov_base);
+            for (size_t off = 0; off < bytes; off += segSize) {
+                size_t len = std::min(segSize, bytes - off);
+                std::vector <uint8_t> payload(data + off, data + off + len);
+
+                r.rxBatch.push_back(std::make_unique<Packet>(
+                        r.sockFd,
+                        Protocol::UDP,
+                        std::move(payload),
+                        r.rxAddrs[i],
+                        m_serverAddr));
+            }
+
+            if (segSize < bytes)
+                m_stats.rxGroSegments.fetch_add((bytes + segSize - 1) / segSize, std::memory_order_relaxed);
+        }
+        m_stats.rxCalls.fetch_add(1, std::memory_order_relaxed);
+        m_stats.rxPackets.fetch_add(n, std::memory_order_relaxed);
+        if ((size_t) n == m_batchSize)
+            m_stats.rxFullBatches.fetch_add(1, std::memory_order_relaxed);
+
+        if (m_shardSockets) {
+            /* the kernel already steered this socket's traffic to one shard, skip the udp_worker hop */
+            for (auto &pkt: r.rxBatch)
+                m_rxRouter->handlePacket(std::move(pkt));
+            r.rxBatch.clear();
+        } else if (!r.rxBatch.empty()) {
             {
                 std::lock_guard <std::mutex> lock(m_rxLock);
-                m_rxQueue.push(std::move(pkt));
+                for (auto &pkt: r.rxBatch)
+                    m_rxQueue.push(std::move(pkt));
             }
-            m_cv.notify_one();
 
-            clientAddr = sockaddr_in{};
-            addrLen = sizeof(clientAddr);
-            continue;
-        }
+            if (r.rxBatch.size() > 1)
+                m_cv.notify_all();
+            else
+                m_cv.notify_one();
 
-        if (bytes == 0) {
-            return;
+            r.rxBatch.clear();
         }
 
-        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        if ((size_t) n < m_batchSize)
             return;
+    }
+}
 
-        if (errno == EINTR)
-            continue;
-
-        LOG_ERROR("UdpServer: recvfrom failed errno={}", errno);
-        return;
+size_t UdpServer::groSegmentSize(const msghdr &hdr) {
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(const_cast<msghdr *>(&hdr), cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int segSize = 0;
+            std::memcpy(&segSize, CMSG_DATA(cmsg), sizeof(segSize));
+            return segSize > 0 ? (size_t) segSize : 0;
+        }
     }
+    return 0;
 }
 
 void UdpServer::enqueueTx(std::unique_ptr <Packet> packet) {
     if (!packet) return;
 
+    Reactor *owner = getOwner(packet->getFd());
+    if (!owner) {
+        LOG_WARN("UdpServer: enqueueTx no reactor for fd={}", packet->getFd());
+        return;
+    }
+
+    Reactor &r = *owner;
     {
-        std::lock_guard <std::mutex> lock(m_txLock);
-        m_txQueue.push_back(std::move(packet));
+        std::lock_guard <std::mutex> lock(r.txLock);
+        r.txQueue.push_back(std::move(packet));
     }
 
     uint64_t v = 1;
-    (void) write(m_txEventFd, &v, sizeof(v));
+    (void) write(r.txEventFd, &v, sizeof(v));
 }
 
-bool UdpServer::hasPendingTx() {
-    std::lock_guard <std::mutex> lock(m_txLock);
-    return !m_txQueue.empty();
+bool UdpServer::hasPendingTx(Reactor &r) {
+    std::lock_guard <std::mutex> lock(r.txLock);
+    return !r.txQueue.empty();
 }
 
-void UdpServer::flushAllPending(size_t budgetItems) {
-    (void) flushPending(budgetItems);
+void UdpServer::flushAllPending(Reactor &r, size_t budgetItems) {
+    (void) flushPending(r, budgetItems);
 }
 
-size_t UdpServer::flushPending(size_t budgetItems) {
+size_t UdpServer::flushPending(Reactor &r, size_t budgetItems) {
     size_t used = 0;
 
     while (used < budgetItems) {
-        std::unique_ptr <Packet> pkt;
+        size_t want = std::min(m_batchSize, budgetItems - used);
         {
-            std::lock_guard <std::mutex> lock(m_txLock);
-            if (m_txQueue.empty())
-                return used;
-
-            pkt = std::move(m_txQueue.front());
-            m_txQueue.pop_front();
+            std::lock_guard <std::mutex> lock(r.txLock);
+            while (!r.txQueue.empty() && r.txBatch.size() < want) {
+                r.txBatch.push_back(std::move(r.txQueue.front()));
+                r.txQueue.pop_front();
+            }
         }
 
-        const auto &payload = pkt->getPayload();
+        if (r.txBatch.empty())
+            return used;
 
-        sockaddr_in dstAddr{};
-        dstAddr.sin_family = AF_INET;
-        dstAddr.sin_addr.s_addr = htonl(pkt->getDstIp());
-        dstAddr.sin_port = htons(pkt->getDstPort());
-
-        ssize_t ret = sendto(
-                m_sockFd,
-                payload.data(),
-                payload.size(),
-                0,
-                reinterpret_cast<const sockaddr *>(&dstAddr),
-                sizeof(dstAddr));
-
-        if (ret >= 0) {
-            used++;
-            continue;
-        }
+        const size_t msgCount = buildTxMsgs(r);
 
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            {
-                std::lock_guard <std::mutex> lock(m_txLock);
-                m_txQueue.push_front(std::move(pkt));
+        int sent = sendmmsg(r.sockFd, r.txMsgs.data(), (unsigned int) msgCount, 0);
+
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                requeueTx(r, 0);
+
+                uint64_t v = 1;
+                (void) write(r.txEventFd, &v, sizeof(v));
+                return used;
             }
 
-            uint64_t v = 1;
-            (void) write(m_txEventFd, &v, sizeof(v));
-            return used + 1;
-        }
+            if (errno == EINTR) {
+                requeueTx(r, 0);
+                continue;
+            }
 
-        if (errno == EINTR) {
-            {
-                std::lock_guard <std::mutex> lock(m_txLock);
-                m_txQueue.push_front(std::move(pkt));
+            if (r.txMsgPackets[0] > 1 && isGsoRejected(errno)) {
+                LOG_WARN("UdpServer: UDP_SEGMENT send rejected errno={}, disable gso", errno);
+                m_gsoEnabled.store(false, std::memory_order_relaxed);
+                requeueTx(r, 0);
+                continue;
             }
+
+            /* first message is rejected, drop its datagrams and retry the rest */
+            LOG_ERROR("UdpServer: sendmmsg failed errno={}", errno);
+            requeueTx(r, r.txMsgPackets[0]);
+            used += r.txMsgPackets[0];
             continue;
         }
 
-        LOG_ERROR("UdpServer: sendto failed errno={}", errno);
-        used++;
+        size_t sentPackets = 0;
+        for (int i = 0; i < sent; ++i) {
+            sentPackets += r.txMsgPackets[i];
+            if (r.txMsgPackets[i] > 1)
+                m_stats.txGsoSegments.fetch_add(r.txMsgPackets[i], std::memory_order_relaxed);
+        }
+
+        m_stats.txCalls.fetch_add(1, std::memory_order_relaxed);
+        m_stats.txPackets.fetch_add(sentPackets, std::memory_order_relaxed);
+        if (sentPackets == m_batchSize)
+            m_stats.txFullBatches.fetch_add(1, std::memory_order_relaxed);
+
+        requeueTx(r, sentPackets);
+        used += sentPackets;
     }
 
-    if (hasPendingTx()) {
+    if (hasPendingTx(r)) {
         uint64_t v = 1;
-        (void) write(m_txEventFd, &v, sizeof(v));
+        (void) write(r.txEventFd, &v, sizeof(v));
     }
 
     return used;
 }
 
+size_t UdpServer::buildTxMsgs(Reactor &r) {
+    const size_t count = r.txBatch.size();
+    size_t msgCount = 0;
+    size_t i = 0;
+
+    while (i < count) {
+        const auto &first = r.txBatch[i];
+        const size_t segSize = first->getPayload().size();
+
+        /*
+         * GSO run : consecutive datagrams to the same peer, all segSize bytes
+         * except the last one which may be shorter.
+         */
+        size_t run = 1;
+        size_t runBytes = segSize;
+        if (m_gsoEnabled.load(std::memory_order_relaxed) && segSize > 0) {
+            while (i + run < count && run < UDP_MAX_GSO_SEGMENTS) {
+                const auto &next = r.txBatch[i + run];
+                const size_t len = next->getPayload().size();
+
+                if (next->getDstIp() != first->getDstIp() ||
+                    next->getDstPort() != first->getDstPort() ||
+                    len == 0 || len > segSize ||
+                    runBytes + len > UDP_MAX_GSO_BYTES)
+                    break;
+
+                runBytes += len;
+                ++run;
+
+                if (len < segSize)
+                    break;
+            }
+        }
+
+        for (size_t k = 0; k < run; ++k) {
+            const auto &payload = r.txBatch[i + k]->getPayload();
+            r.txIov[i + k].iov_base = const_cast<uint8_t *>(payload.data());
+            r.txIov[i + k].iov_len = payload.size();
+        }
+
+        sockaddr_in &dstAddr = r.txAddrs[msgCount];
+        dstAddr = sockaddr_in{};
+        dstAddr.sin_family = AF_INET;
+        dstAddr.sin_addr.s_addr = htonl(first->getDstIp());
+        dstAddr.sin_port = htons(first->getDstPort());
+
+        msghdr &hdr = r.txMsgs[msgCount].msg_hdr;
+        hdr = msghdr{};
+        hdr.msg_name = &dstAddr;
+        hdr.msg_namelen = sizeof(dstAddr);
+        hdr.msg_iov = &r.txIov[i];
+        hdr.msg_iovlen = run;
+
+        if (run > 1) {
+            uint8_t *ctrl = r.txCtrl.data() + msgCount * UDP_CTRL_SIZE;
+            std::memset(ctrl, 0, UDP_CTRL_SIZE);
+
+            hdr.msg_control = ctrl;
+            hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+
+            cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+
+            uint16_t gsoSize = (uint16_t) segSize;
+            std::memcpy(CMSG_DATA(cmsg), &gsoSize, sizeof(gsoSize));
+        }
+
+        r.txMsgPackets[msgCount] = run;
+        ++msgCount;
+        i += run;
+    }
+
+    return msgCount;
+}
+
+bool UdpServer::isGsoRejected(int err) {
+    return err == EIO || err == EINVAL || err == EOPNOTSUPP ||
+           err == ENOPROTOOPT || err == EMSGSIZE;
+}
+
+void UdpServer::requeueTx(Reactor &r, size_t sent) {
+    if (sent < r.txBatch.size()) {
+        std::lock_guard <std::mutex> lock(r.txLock);
+        for (size_t i = r.txBatch.size(); i > sent; --i)
+            r.txQueue.push_front(std::move(r.txBatch[i - 1]));
+    }
+    r.txBatch.clear();
+}
+
+void UdpServer::dumpStats() {
+    auto avg = [](uint64_t pkts, uint64_t calls) {
+        return calls ? (double) pkts / (double) calls : 0.0;
+    };
+
+    const uint64_t rxCalls = m_stats.rxCalls.load(std::memory_order_relaxed);
+    const uint64_t rxPkts = m_stats.rxPackets.load(std::memory_order_relaxed);
+    const uint64_t txCalls = m_stats.txCalls.load(std::memory_order_relaxed);
+    const uint64_t txPkts = m_stats.txPackets.load(std::memory_order_relaxed);
+
+    LOG_TRACE("UdpServer batch(size={}) rx: calls={} pkts={} avgFill={:.2f} full={} groSegs={} | "
+              "tx: calls={} pkts={} avgFill={:.2f} full={} gsoSegs={}",
+              m_batchSize,
+              rxCalls, rxPkts, avg(rxPkts, rxCalls), m_stats.rxFullBatches.load(std::memory_order_relaxed),
+              m_stats.rxGroSegments.load(std::memory_order_relaxed),
+              txCalls, txPkts, avg(txPkts, txCalls), m_stats.txFullBatches.load(std::memory_order_relaxed),
+              m_stats.txGsoSegments.load(std::memory_order_relaxed));
+}
+
+UdpServer::Reactor *UdpServer::getOwner(int fd) {
+    /* replies go out through the socket the request came in on, the reactor list is tiny */
+    for (auto &r: m_reactors) {
+        if (r->sockFd == fd)
+            return r.get();
+    }
+    return m_reactors.empty() ? nullptr : m_reactors[0].get();
+}
+
 void UdpServer::handleClose() {
     m_running = false;
     m_cv.notify_all();
@@ -377,10 +662,10 @@ void UdpServer::drainEventFd(int efd) {
     }
 }
 
-bool UdpServer::addToEpoll(int fd, uint32_t events) {
+bool UdpServer::addToEpoll(int epFd, int fd, uint32_t events) {
     epoll_event ev{};
     ev.events = events;
     ev.data.fd = fd;
-    return epoll_ctl(m_epFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+    return epoll_ctl(epFd, EPOLL_CTL_ADD, fd, &ev) == 0;
 }
 
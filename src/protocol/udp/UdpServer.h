@@ -1,5 +1,7 @@
 #pragma once
 
+#include "protocol/udp/UdpConfig.h"
+
 #include <atomic>
 #include <condition_variable>
 #include <deque>
@@ -11,6 +13,8 @@
 
 #include <netinet/in.h>
 #include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 class RxRouter;
 
@@ -18,13 +22,25 @@ class ThreadManager;
 
 class Packet;
 
+struct UdpBatchStats {
+    std::atomic<uint64_t> rxCalls{0};
+    std::atomic<uint64_t> rxPackets{0};
+    std::atomic<uint64_t> rxFullBatches{0};
+    std::atomic<uint64_t> rxGroSegments{0};    // datagrams split out of GRO coalesced reads
+
+    std::atomic<uint64_t> txCalls{0};
+    std::atomic<uint64_t> txPackets{0};
+    std::atomic<uint64_t> txFullBatches{0};
+    std::atomic<uint64_t> txGsoSegments{0};    // datagrams sent inside UDP_SEGMENT messages
+};
 
 class UdpServer {
 public:
     UdpServer(int port,
               RxRouter *rxRouter,
               int workerCount,
-              ThreadManager *threadManager);
+              ThreadManager *threadManager,
+              const UdpConfig &config);
 
     ~UdpServer();
 
@@ -34,46 +50,99 @@ public:
 
     void enqueueTx(std::unique_ptr <Packet> packet);
 
+    void dumpStats();
+
 private:
+    /*
+     * One epoll loop around one UDP socket. In shard socket mode there is one
+     * reactor per shard, all bound to the same port with SO_REUSEPORT.
+     */
+    struct Reactor {
+        int idx{0};
+        int sockFd{-1};
+        int epFd{-1};
+        int stopEventFd{-1};
+        int txEventFd{-1};
+
+        bool groEnabled{false};
+        size_t rxSlotSize{0};
+
+        /* recvmmsg slots, one rxSlotSize buffer each (64 KB when GRO is on) */
+        std::vector <uint8_t> rxBuffer;
+        std::vector <uint8_t> rxCtrl;
+        std::vector <mmsghdr> rxMsgs;
+        std::vector <iovec> rxIov;
+        std::vector <sockaddr_in> rxAddrs;
+        std::vector <std::unique_ptr<Packet>> rxBatch;
+
+        /* sendmmsg slots, one message per GSO run */
+        std::vector <mmsghdr> txMsgs;
+        std::vector <iovec> txIov;
+        std::vector <sockaddr_in> txAddrs;
+        std::vector <uint8_t> txCtrl;
+        std::vector <size_t> txMsgPackets;
+        std::vector <std::unique_ptr<Packet>> txBatch;
+
+        std::mutex txLock;
+        std::deque <std::unique_ptr<Packet>> txQueue;
+    };
+
     bool init();
 
+    bool initReactor(Reactor &r);
+
+    bool attachShardFilter();
+
     void deinit();
 
+    void startReactors();
+
+    void runReactor(Reactor &r);
+
     void startWorkers();
 
     void stopWorker();
 
     void processPacket();
 
-    void handleEvent(const epoll_event &ev);
+    void handleEvent(Reactor &r, const epoll_event &ev);
+
+    void handleStopEvent(Reactor &r);
+
+    void handleTxEvent(Reactor &r);
 
-    void handleStopEvent();
+    void initOffload(Reactor &r);
 
-    void handleTxEvent();
+    void initBatch(Reactor &r);
 
-    void receivePacket();
+    void receivePacket(Reactor &r);
+
+    static size_t groSegmentSize(const msghdr &hdr);
 
     void handleClose();
 
-    bool hasPendingTx();
+    bool hasPendingTx(Reactor &r);
+
+    void flushAllPending(Reactor &r, size_t budgetItems);
+
+    size_t flushPending(Reactor &r, size_t budgetItems);
 
-    void flushAllPending(size_t budgetItems);
+    size_t buildTxMsgs(Reactor &r);
 
-    size_t flushPending(size_t budgetItems);
+    static bool isGsoRejected(int err);
+
+    void requeueTx(Reactor &r, size_t sent);
+
+    Reactor *getOwner(int fd);
 
     bool setNonBlocking(int fd);
 
     void drainEventFd(int efd);
 
-    bool addToEpoll(int fd, uint32_t events);
+    bool addToEpoll(int epFd, int fd, uint32_t events);
 
 private:
     int m_port;
-    int m_sockFd{-1};
-    int m_epFd{-1};
-
-    int m_stopEventFd{-1};
-    int m_txEventFd{-1};
 
     sockaddr_in m_serverAddr{};
 
@@ -83,13 +152,17 @@ private:
     std::atomic<bool> m_running{false};
     int m_workerCount;
 
-    std::vector <uint8_t> m_rxBuffer;
+    UdpConfig m_config;
+    size_t m_batchSize{1};
+    bool m_shardSockets{false};
+
+    std::atomic<bool> m_gsoEnabled{false};
+
+    std::vector <std::unique_ptr<Reactor>> m_reactors;
+
+    UdpBatchStats m_stats;
 
     std::mutex m_rxLock;
     std::condition_variable m_cv;
     std::queue <std::unique_ptr<Packet>> m_rxQueue;
-
-    std::mutex m_txLock;
-    std::deque <std::unique_ptr<Packet>> m_txQueue;
 };
-
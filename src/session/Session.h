@@ -23,16 +23,23 @@ public:
         switch (m_connInfo.protocol) {
         case Protocol::TCP:
             m_tcpFd = parsed.getFd();
+            m_tcpGen = parsed.getConnGen();
             break;
 
         case Protocol::TLS:
             m_tlsFd = parsed.getFd();
+            m_tlsGen = parsed.getConnGen();
             break;
 
         case Protocol::UDP:
             m_udpFd = parsed.getFd(); // server fd
             break;
 
+        case Protocol::QUIC:
+            m_quicFd = parsed.getFd(); // stream handle
+            m_quicGen = parsed.getConnGen();
+            break;
+
         default:
             break;
         }
@@ -41,6 +48,10 @@ public:
     int getTlsFd() const { return m_tlsFd; }
     int getTcpFd() const { return m_tcpFd; }
     int getUdpFd() const { return m_udpFd; }
+    int getQuicFd() const { return m_quicFd; }
+    uint32_t getTlsGen() const { return m_tlsGen; }
+    uint32_t getTcpGen() const { return m_tcpGen; }
+    uint32_t getQuicGen() const { return m_quicGen; }
     const ConnInfo& getConnInfo() const { return m_connInfo; }
 
     SessionState getState() const { return m_state; }
@@ -55,6 +66,10 @@ private:
     int m_tlsFd{-1};        // TLS
     int m_tcpFd{-1};        // TCP
     int m_udpFd{-1};        // UDP server fd
+    int m_quicFd{-1};       // QUIC stream handle
+    uint32_t m_tlsGen{0};   // connection generation of m_tlsFd
+    uint32_t m_tcpGen{0};   // connection generation of m_tcpFd
+    uint32_t m_quicGen{0};  // stream generation of m_quicFd
     ConnInfo m_connInfo{};  // src/dst ip/port (UDP peer 포함)
 };
  
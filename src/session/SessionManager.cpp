@@ -5,6 +5,11 @@
 #include <iomanip>
 #include <openssl/rand.h>
 
+/* a QUIC stream handle is reused once its stream closes, only the generation tells the streams apart */
+static uint64_t quicStreamKey(int handle, uint32_t gen) {
+    return ((uint64_t) gen << 32) | (uint32_t) handle;
+}
+
 SessionManager::SessionManager() = default;
 
 void SessionManager::start() {
@@ -46,11 +51,13 @@ bool SessionManager::checkAndBind(const ParsedPacket& parsed)
 bool SessionManager::create(ParsedPacket& parsed)
 {
     const int fd = parsed.getFd();
+    const bool quic = parsed.getConnInfo().protocol == Protocol::QUIC;
+    const uint64_t quicKey = quicStreamKey(fd, parsed.getConnGen());
 
     std::lock_guard<std::mutex> lock(m_lock);
 
     
-    if (m_tlsFdToSessionId.count(fd) != 0) {
+    if (quic ? m_quicStreamToSessionId.count(quicKey) != 0 : m_tlsFdToSessionId.count(fd) != 0) {
         LOG_WARN("Duplicate LOGIN_REQ, fd={}", fd);
         return false;
     }
@@ -62,7 +69,11 @@ bool SessionManager::create(ParsedPacket& parsed)
     session->setState(SessionState::PRE_AUTH);
 
     m_sessions.emplace(sessionId, std::move(session));
-    m_tlsFdToSessionId.emplace(fd, sessionId);
+    if (quic) {
+        m_quicStreamToSessionId.emplace(quicKey, sessionId);
+    } else {
+        m_tlsFdToSessionId.emplace(fd, sessionId);
+    }
 
     parsed.setSessionId(sessionId);
 
@@ -82,6 +93,7 @@ void SessionManager::erase(uint64_t sessionId)
     int fd = it->second->getTlsFd();
     
     m_tlsFdToSessionId.erase(fd);
+    m_quicStreamToSessionId.erase(quicStreamKey(it->second->getQuicFd(), it->second->getQuicGen()));
     m_sessions.erase(sessionId);
 }
 
@@ -99,7 +111,8 @@ bool SessionManager::getTxSnapshot(uint64_t sessionId, Opcode opcode, SessionTxS
     switch(opcode) {
         case Opcode::LOGIN_RES_SUCCESS:
         case Opcode::LOGIN_RES_FAIL:
-            out.protocol = Protocol::TLS;
+            /* the login reply goes back over the secure transport the request came in on */
+            out.protocol = (s.getQuicFd() >= 0) ? Protocol::QUIC : Protocol::TLS;
             break;
 
         default:
@@ -110,6 +123,10 @@ bool SessionManager::getTxSnapshot(uint64_t sessionId, Opcode opcode, SessionTxS
     out.tlsFd    = s.getTlsFd();
     out.tcpFd    = s.getTcpFd();
     out.udpFd    = s.getUdpFd();
+    out.quicFd   = s.getQuicFd();
+    out.tlsGen   = s.getTlsGen();
+    out.tcpGen   = s.getTcpGen();
+    out.quicGen  = s.getQuicGen();
     out.connInfo = s.getConnInfo();
 
     return true;
@@ -14,6 +14,10 @@ struct SessionTxSnapshot {
     int tlsFd{-1};
     int tcpFd{-1};
     int udpFd{-1};
+    int quicFd{-1};
+    uint32_t tlsGen{0};
+    uint32_t tcpGen{0};
+    uint32_t quicGen{0};
     ConnInfo connInfo{};
 };
 
@@ -45,5 +49,6 @@ private:
 
     std::mutex m_lock;
     std::unordered_map <int, uint64_t> m_tlsFdToSessionId;
+    std::unordered_map <uint64_t, uint64_t> m_quicStreamToSessionId;   // (handle, gen): handles are recycled
     std::unordered_map <uint64_t, std::unique_ptr<Session>> m_sessions;
 };
@@ -2,8 +2,10 @@
 
 #include "shard/ShardManager.h"
 
+#include "execution/Action.h"
 #include "execution/login/LoginContext.h"
 #include "execution/world/WorldContext.h"
+#include "util/Logger.h"
 
 ShardContext::ShardContext(int shardIdx, ShardManager *shardManager, DbManager *dbManager)
         : m_shardIdx(shardIdx),
@@ -27,3 +29,38 @@ LoginContext &ShardContext::loginContext() {
 WorldContext& ShardContext::worldContext() {
     return *m_worldContext;
 }
+
+void ShardContext::setTxBackpressure(uint64_t sessionId, bool paused) {
+    if (paused) {
+        m_txBackpressured.insert(sessionId);
+    } else {
+        m_txBackpressured.erase(sessionId);
+    }
+    LOG_DEBUG("Shard {} tx backpressure {} sessionId: {}", m_shardIdx, paused ? "on" : "off", sessionId);
+
+    if (paused)
+        return;
+
+    auto it = m_txDeferred.find(sessionId);
+    if (it == m_txDeferred.end())
+        return;
+
+    /* a replayed action may not pause the session again: the transport only reports it on the next flush */
+    auto deferred = std::move(it->second);
+    m_txDeferred.erase(it);
+    for (auto &action : deferred)
+        action->handleAction(*this);
+}
+
+bool ShardContext::isTxBackpressured(uint64_t sessionId) const {
+    return m_txBackpressured.count(sessionId) != 0;
+}
+
+void ShardContext::deferAction(std::unique_ptr <Action> action) {
+    auto &deferred = m_txDeferred[action->sessionId()];
+    if (deferred.size() >= SHARD_TX_DEFERRED_MAX) {
+        LOG_WARN("Shard {} tx backpressure, dropping action sessionId: {}", m_shardIdx, action->sessionId());
+        return;
+    }
+    deferred.push_back(std::move(action));
+}
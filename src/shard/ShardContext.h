@@ -2,8 +2,14 @@
 
 #include "db/DbManager.h"
 
+#include <deque>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
 
+#define SHARD_TX_DEFERRED_MAX   (256)   // actions held per backpressured session before dropping
+
+class Action;
 class ShardManager;
 class TxRouter;
 class DbManager;
@@ -23,6 +29,13 @@ public:
 
     void setTxRouter(TxRouter *txRouter);
 
+    /* sessions whose connection is above its tx high watermark; bulk senders should hold off */
+    void setTxBackpressure(uint64_t sessionId, bool paused);
+    bool isTxBackpressured(uint64_t sessionId) const;
+
+    /* holds an action of a backpressured session until resume, then runs it in arrival order */
+    void deferAction(std::unique_ptr <Action> action);
+
 private:
     ShardManager *m_shardManager;
     DbManager *m_dbManager;
@@ -30,6 +43,9 @@ private:
     std::unique_ptr <LoginContext> m_loginContext;
     std::unique_ptr <WorldContext> m_worldContext;
 
+    std::unordered_set <uint64_t> m_txBackpressured;
+    std::unordered_map <uint64_t, std::deque<std::unique_ptr<Action>>> m_txDeferred;
+
     int m_shardIdx;
 };
 
@@ -1,6 +1,7 @@
 #include "ShardWorker.h"
 #include "ShardManager.h"
 #include "util/Logger.h"
+#include "egress/TxRouter.h"
 
 #include "execution/world/WorldContext.h"
 
@@ -38,6 +39,9 @@ void ShardWorker::processPacket() {
 
         now = std::chrono::steady_clock::now();
 
+        if (m_txRouter)
+            m_txRouter->beginBatch(m_txBatch);
+
         // ---- event handling ----
         if (event) 
         {
@@ -55,7 +59,11 @@ void ShardWorker::processPacket() {
 
             while (not snapshot.empty()) {
                 LOG_DEBUG("Shard idx:{}, handle action", m_shardIdx);
-                snapshot.front()->handleAction(*m_shardContext);
+                auto &action = snapshot.front();
+                if (m_shardContext->isTxBackpressured(action->sessionId()))
+                    m_shardContext->deferAction(std::move(action));
+                else
+                    action->handleAction(*m_shardContext);
                 snapshot.pop();
             }
         }
@@ -71,6 +79,10 @@ void ShardWorker::processPacket() {
                 m_nextTick = now + m_tickInterval;
             }
         }
+
+        // ---- egress ----
+        if (m_txRouter)
+            m_txRouter->flushBatch(m_txBatch);
     }
 }
 
@@ -112,5 +124,6 @@ void ShardWorker::enqueueAction(std::unique_ptr <Action> action) {
 }
 
 void ShardWorker::setTxRouter(TxRouter *txRouter) {
+    m_txRouter = txRouter;
     m_shardContext->setTxRouter(txRouter);
 }
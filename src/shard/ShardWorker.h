@@ -4,6 +4,7 @@
 #include "db/DbManager.h"
 #include "execution/Action.h"
 #include "execution/Event.h"
+#include "packet/Packet.h"
 
 #include <queue>
 #include <mutex>
@@ -11,6 +12,7 @@
 #include <atomic>
 #include <chrono>
 #include <memory>
+#include <vector>
 
 class ShardWorker {
 public:
@@ -35,6 +37,10 @@ private:
 
     std::unique_ptr <ShardContext> m_shardContext;
 
+    /* outbound TCP packets of the current loop pass, published in one go at its end */
+    TxRouter *m_txRouter{nullptr};
+    std::vector <std::unique_ptr<Packet>> m_txBatch;
+
     std::atomic<bool> m_running{false};
 
     size_t m_shardIdx;
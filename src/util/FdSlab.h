@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include <sys/resource.h>
+
+#define FD_SLAB_DEFAULT_MAX_FDS (64 * 1024)
+#define FD_SLAB_LIMIT_MAX_FDS   (1024 * 1024)
+#define FD_SLAB_CHUNK_SHIFT     (10)    // 1024 slots per chunk
+
+/*
+ * Flat fd-indexed table of per-connection state.
+ *
+ *  fd -> m_chunks[fd >> FD_SLAB_CHUNK_SHIFT][fd & mask]
+ *
+ * Capacity follows RLIMIT_NOFILE. A chunk is allocated the first time an fd in
+ * its range is opened and stays until the slab is destroyed, so a slot pointer
+ * never moves and a lookup from another thread needs no lock. Slots are reused
+ * with the fd; the owner resets them on close.
+ */
+template <typename T>
+class FdSlab {
+public:
+    FdSlab() {
+        rlimit rl{};
+        m_capacity = FD_SLAB_DEFAULT_MAX_FDS;
+        if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+            m_capacity = std::clamp<size_t>(rl.rlim_cur, FD_SLAB_DEFAULT_MAX_FDS, FD_SLAB_LIMIT_MAX_FDS);
+
+        m_chunkCount = (m_capacity + CHUNK_SIZE - 1) >> FD_SLAB_CHUNK_SHIFT;
+        m_chunks = std::make_unique<std::atomic<T *>[]>(m_chunkCount);
+        for (size_t i = 0; i < m_chunkCount; ++i)
+            m_chunks[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~FdSlab() {
+        for (size_t i = 0; i < m_chunkCount; ++i)
+            delete[] m_chunks[i].load(std::memory_order_relaxed);
+    }
+
+    FdSlab(const FdSlab &) = delete;
+
+    FdSlab &operator=(const FdSlab &) = delete;
+
+    /* nullptr when fd is out of range or no fd of its chunk was ever acquired */
+    T *find(int fd) const {
+        if (fd < 0 || (size_t) fd >= m_capacity)
+            return nullptr;
+
+        T *chunk = m_chunks[(size_t) fd >> FD_SLAB_CHUNK_SHIFT].load(std::memory_order_acquire);
+        return chunk ? &chunk[(size_t) fd & (CHUNK_SIZE - 1)] : nullptr;
+    }
+
+    /* like find, but allocates the chunk on first use. Safe to race from several threads */
+    T *acquire(int fd) {
+        if (fd < 0 || (size_t) fd >= m_capacity)
+            return nullptr;
+
+        auto &slot = m_chunks[(size_t) fd >> FD_SLAB_CHUNK_SHIFT];
+        T *chunk = slot.load(std::memory_order_acquire);
+        if (!chunk) {
+            T *fresh = new T[CHUNK_SIZE];
+            if (slot.compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel))
+                chunk = fresh;
+            else
+                delete[] fresh;
+        }
+        return &chunk[(size_t) fd & (CHUNK_SIZE - 1)];
+    }
+
+    /* visits every slot of the allocated chunks as (fd, T&) */
+    template <typename Fn>
+    void forEach(Fn &&fn) {
+        for (size_t i = 0; i < m_chunkCount; ++i) {
+            T *chunk = m_chunks[i].load(std::memory_order_acquire);
+            if (!chunk)
+                continue;
+            for (size_t j = 0; j < CHUNK_SIZE; ++j)
+                fn((int) ((i << FD_SLAB_CHUNK_SHIFT) | j), chunk[j]);
+        }
+    }
+
+    size_t capacity() const { return m_capacity; }
+
+private:
+    static constexpr size_t CHUNK_SIZE = (size_t) 1 << FD_SLAB_CHUNK_SHIFT;
+
+    std::unique_ptr<std::atomic<T *>[]> m_chunks;
+    size_t m_chunkCount{0};
+    size_t m_capacity{0};
+};
@@ -0,0 +1,189 @@
+#include "IoUring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+IoUring::~IoUring() {
+    release();
+}
+
+bool IoUring::init(unsigned entries) {
+    io_uring_params p{};
+    p.flags = IORING_SETUP_COOP_TASKRUN;
+
+    m_ringFd = (int) syscall(__NR_io_uring_setup, entries, &p);
+    if (m_ringFd < 0 && errno == EINVAL) {
+        p = io_uring_params{};
+        m_ringFd = (int) syscall(__NR_io_uring_setup, entries, &p);
+    }
+    if (m_ringFd < 0)
+        return false;
+
+    m_sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        m_sqSize = m_cqSize = std::max(m_sqSize, m_cqSize);
+
+    m_sqPtr = mmap(nullptr, m_sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   m_ringFd, IORING_OFF_SQ_RING);
+    if (m_sqPtr == MAP_FAILED) {
+        m_sqPtr = nullptr;
+        release();
+        return false;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        m_cqPtr = m_sqPtr;
+    } else {
+        m_cqPtr = mmap(nullptr, m_cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       m_ringFd, IORING_OFF_CQ_RING);
+        if (m_cqPtr == MAP_FAILED) {
+            m_cqPtr = nullptr;
+            release();
+            return false;
+        }
+    }
+
+    m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      m_ringFd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        release();
+        return false;
+    }
+    m_sqes = static_cast<io_uring_sqe *>(sqes);
+
+    auto *sq = static_cast<uint8_t *>(m_sqPtr);
+    m_sqHead = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    m_sqTail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    m_sqArray = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    m_sqMask = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    m_sqEntries = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_entries);
+    m_sqLocalTail = m_sqSubmitted = *m_sqTail;
+
+    auto *cq = static_cast<uint8_t *>(m_cqPtr);
+    m_cqHead = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    m_cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+    m_cqMask = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+
+    return true;
+}
+
+io_uring_sqe *IoUring::getSqe() {
+    if (m_sqLocalTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries) {
+        submit();
+        if (m_sqLocalTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries)
+            return nullptr;
+    }
+
+    unsigned idx = m_sqLocalTail & m_sqMask;
+    io_uring_sqe *sqe = &m_sqes[idx];
+    std::memset(sqe, 0, sizeof(*sqe));
+    m_sqArray[idx] = idx;
+    m_sqLocalTail++;
+    return sqe;
+}
+
+int IoUring::submit() {
+    return enter(m_sqLocalTail - m_sqSubmitted, 0, 0);
+}
+
+int IoUring::submitAndWait(unsigned waitNr) {
+    return enter(m_sqLocalTail - m_sqSubmitted, waitNr, IORING_ENTER_GETEVENTS);
+}
+
+int IoUring::enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    if (toSubmit == 0 && minComplete == 0)
+        return 0;
+
+    __atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+
+    int ret = (int) syscall(__NR_io_uring_enter, m_ringFd, toSubmit, minComplete, flags, nullptr, 0);
+    if (ret < 0)
+        return -errno;
+
+    m_sqSubmitted += (unsigned) ret;
+    return ret;
+}
+
+io_uring_cqe *IoUring::peekCqe() {
+    unsigned head = *m_cqHead;
+    if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+        return nullptr;
+
+    return &m_cqes[head & m_cqMask];
+}
+
+void IoUring::cqeSeen() {
+    __atomic_store_n(m_cqHead, *m_cqHead + 1, __ATOMIC_RELEASE);
+}
+
+bool IoUring::registerBufRing(uint16_t bgid, unsigned entries, size_t bufSize) {
+    m_bufRingSize = entries * sizeof(io_uring_buf);
+    void *ring = mmap(nullptr, m_bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+        return false;
+    m_bufRing = static_cast<io_uring_buf_ring *>(ring);
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = entries;
+    reg.bgid = bgid;
+    if (syscall(__NR_io_uring_register, m_ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        munmap(ring, m_bufRingSize);
+        m_bufRing = nullptr;
+        return false;
+    }
+
+    m_bufMask = entries - 1;
+    m_bufSize = bufSize;
+    m_bufs.resize(entries * bufSize);
+
+    for (unsigned bid = 0; bid < entries; ++bid)
+        recycleBuf((uint16_t) bid);
+
+    return true;
+}
+
+const uint8_t *IoUring::bufAddr(uint16_t bid) const {
+    return m_bufs.data() + (size_t) bid * m_bufSize;
+}
+
+void IoUring::recycleBuf(uint16_t bid) {
+    /* index from the ring base: in C++ the uapi flex array member sits 8 bytes in, past the tail overlay */
+    io_uring_buf &buf = reinterpret_cast<io_uring_buf *>(m_bufRing)[m_bufTail & m_bufMask];
+    buf.addr = reinterpret_cast<uint64_t>(m_bufs.data() + (size_t) bid * m_bufSize);
+    buf.len = (uint32_t) m_bufSize;
+    buf.bid = bid;
+
+    m_bufTail++;
+    __atomic_store_n(&m_bufRing->tail, m_bufTail, __ATOMIC_RELEASE);
+}
+
+void IoUring::release() {
+    if (m_bufRing) {
+        munmap(m_bufRing, m_bufRingSize);
+        m_bufRing = nullptr;
+    }
+    if (m_sqes) {
+        munmap(m_sqes, m_sqesSize);
+        m_sqes = nullptr;
+    }
+    if (m_cqPtr && m_cqPtr != m_sqPtr)
+        munmap(m_cqPtr, m_cqSize);
+    m_cqPtr = nullptr;
+    if (m_sqPtr) {
+        munmap(m_sqPtr, m_sqSize);
+        m_sqPtr = nullptr;
+    }
+    if (m_ringFd >= 0) {
+        close(m_ringFd);
+        m_ringFd = -1;
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <linux/io_uring.h>
+
+/*
+ * Minimal io_uring ring on raw syscalls (no liburing).
+ *
+ *  getSqe()  -> fill -> submit() / submitAndWait()
+ *  peekCqe() -> handle -> cqeSeen()
+ *
+ * One ring belongs to one thread. A provided buffer ring (registerBufRing)
+ * lets multishot recv pick its own buffer; the owner hands it back with
+ * recycleBuf() once the bytes are consumed.
+ */
+class IoUring {
+public:
+    IoUring() = default;
+
+    ~IoUring();
+
+    IoUring(const IoUring &) = delete;
+
+    IoUring &operator=(const IoUring &) = delete;
+
+    bool init(unsigned entries);
+
+    io_uring_sqe *getSqe();
+
+    int submit();
+
+    int submitAndWait(unsigned waitNr);
+
+    io_uring_cqe *peekCqe();
+
+    void cqeSeen();
+
+    bool registerBufRing(uint16_t bgid, unsigned entries, size_t bufSize);
+
+    const uint8_t *bufAddr(uint16_t bid) const;
+
+    void recycleBuf(uint16_t bid);
+
+private:
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags);
+
+    void release();
+
+    int m_ringFd{-1};
+
+    void *m_sqPtr{nullptr};
+    size_t m_sqSize{0};
+    void *m_cqPtr{nullptr};
+    size_t m_cqSize{0};
+    io_uring_sqe *m_sqes{nullptr};
+    size_t m_sqesSize{0};
+
+    unsigned *m_sqHead{nullptr};
+    unsigned *m_sqTail{nullptr};
+    unsigned *m_sqArray{nullptr};
+    unsigned m_sqMask{0};
+    unsigned m_sqEntries{0};
+    unsigned m_sqLocalTail{0};
+    unsigned m_sqSubmitted{0};
+
+    unsigned *m_cqHead{nullptr};
+    unsigned *m_cqTail{nullptr};
+    io_uring_cqe *m_cqes{nullptr};
+    unsigned m_cqMask{0};
+
+    io_uring_buf_ring *m_bufRing{nullptr};
+    size_t m_bufRingSize{0};
+    unsigned m_bufMask{0};
+    uint16_t m_bufTail{0};
+    size_t m_bufSize{0};
+    std::vector <uint8_t> m_bufs;
+};
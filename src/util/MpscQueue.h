@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+
+/* Link hook for MpscQueue. A node sits in at most one queue at a time */
+struct MpscNode {
+    std::atomic<MpscNode *> mpscNext{nullptr};
+};
+
+/*
+ * Intrusive multi-producer / single-consumer queue (Vyukov).
+ *
+ *  producers : push()           one exchange + one store, never blocks
+ *  consumer  : pop() / empty()  owner thread only
+ *
+ * The queue does not own its nodes. pop() may return nullptr while empty() is
+ * false: a producer has swapped the head but not linked its node yet. The
+ * producer finishes within a few instructions, so the consumer just retries
+ * on its next pass.
+ */
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : m_head(&m_stub), m_tail(&m_stub) {}
+
+    MpscQueue(const MpscQueue &) = delete;
+
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    void push(T *node) {
+        link(node);
+    }
+
+    T *pop() {
+        MpscNode *tail = m_tail;
+        MpscNode *next = tail->mpscNext.load(std::memory_order_acquire);
+
+        if (tail == &m_stub) {
+            if (!next)
+                return nullptr;
+            m_tail = next;
+            tail = next;
+            next = next->mpscNext.load(std::memory_order_acquire);
+        }
+
+        if (next) {
+            m_tail = next;
+            return static_cast<T *>(tail);
+        }
+
+        /* tail is the last linked node; a producer may be between exchange and link */
+        if (tail != m_head.load(std::memory_order_acquire))
+            return nullptr;
+
+        link(&m_stub);
+        next = tail->mpscNext.load(std::memory_order_acquire);
+        if (next) {
+            m_tail = next;
+            return static_cast<T *>(tail);
+        }
+        return nullptr;
+    }
+
+    bool empty() const {
+        return m_tail == &m_stub && m_head.load(std::memory_order_acquire) == &m_stub;
+    }
+
+private:
+    void link(MpscNode *node) {
+        node->mpscNext.store(nullptr, std::memory_order_relaxed);
+        MpscNode *prev = m_head.exchange(node, std::memory_order_acq_rel);
+        prev->mpscNext.store(node, std::memory_order_release);
+    }
+
+    std::atomic<MpscNode *> m_head;   // producers swap in here
+    MpscNode *m_tail;                 // consumer pops from here
+    MpscNode m_stub;
+};
@@ -0,0 +1,104 @@
+#include "RxBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#define RX_BUFFER_MIN_ALLOC (4096)
+
+RxBuffer::RxBuffer(size_t capacity)
+        : m_capacity(capacity) {
+}
+
+uint8_t *RxBuffer::prepare(size_t minBytes) {
+    if (m_head == m_tail) {
+        m_head = 0;
+        m_tail = 0;
+    }
+
+    if (m_alloc - m_tail < minBytes && m_head > 0) {
+        compact();
+    }
+
+    if (m_alloc - m_tail < minBytes && not grow(minBytes)) {
+        return nullptr;
+    }
+
+    return m_buf.get() + m_tail;
+}
+
+size_t RxBuffer::writable() const {
+    return m_alloc - m_tail;
+}
+
+void RxBuffer::commit(size_t bytes) {
+    m_tail = std::min(m_tail + bytes, m_alloc);
+}
+
+const uint8_t *RxBuffer::data() const {
+    return m_buf.get() + m_head;
+}
+
+size_t RxBuffer::size() const {
+    return m_tail - m_head;
+}
+
+void RxBuffer::consume(size_t bytes) {
+    m_head = std::min(m_head + bytes, m_tail);
+
+    if (m_head == m_tail) {
+        m_head = 0;
+        m_tail = 0;
+    }
+}
+
+bool RxBuffer::empty() const {
+    return m_head == m_tail;
+}
+
+size_t RxBuffer::capacity() const {
+    return m_capacity;
+}
+
+size_t RxBuffer::allocated() const {
+    return m_alloc;
+}
+
+void RxBuffer::shrink() {
+    if (m_head != m_tail || m_alloc == 0) {
+        return;
+    }
+
+    m_buf.reset();
+    m_alloc = 0;
+    m_head = 0;
+    m_tail = 0;
+}
+
+void RxBuffer::compact() {
+    size_t len = size();
+    if (len > 0) {
+        std::memmove(m_buf.get(), m_buf.get() + m_head, len);
+    }
+    m_head = 0;
+    m_tail = len;
+}
+
+bool RxBuffer::grow(size_t minBytes) {
+    if (m_alloc >= m_capacity) {
+        return m_alloc > m_tail;
+    }
+
+    size_t want = std::max({m_alloc * 2, m_tail + minBytes, (size_t) RX_BUFFER_MIN_ALLOC});
+    want = std::min(want, m_capacity);
+
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[want]);
+    if (m_tail > m_head) {
+        std::memcpy(buf.get(), m_buf.get() + m_head, m_tail - m_head);
+    }
+
+    m_tail -= m_head;
+    m_head = 0;
+    m_buf = std::move(buf);
+    m_alloc = want;
+    return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/*
+ * Per-connection receive buffer with a read cursor.
+ *
+ *  [ consumed | readable (data, size) | writable (prepare) ]
+ *  0          head                    tail                 alloc
+ *
+ * Frames are handed out as slices of the readable region and consumed by
+ * advancing head, so framing never shifts bytes. The leftover partial frame is
+ * moved to the front only when the tail has no room for the next read.
+ * Storage is allocated on the first prepare, grows up to capacity and can be
+ * given back with shrink() once the buffer is empty.
+ */
+class RxBuffer {
+public:
+    explicit RxBuffer(size_t capacity);
+
+    RxBuffer(RxBuffer &&) noexcept = default;
+
+    RxBuffer &operator=(RxBuffer &&) noexcept = default;
+
+    uint8_t *prepare(size_t minBytes);
+
+    size_t writable() const;
+
+    void commit(size_t bytes);
+
+    const uint8_t *data() const;
+
+    size_t size() const;
+
+    void consume(size_t bytes);
+
+    bool empty() const;
+
+    size_t capacity() const;
+
+    /* heap currently held, 0 until the first prepare and after shrink */
+    size_t allocated() const;
+
+    /* frees the storage while nothing is buffered; the next prepare allocates again */
+    void shrink();
+
+private:
+    void compact();
+
+    bool grow(size_t minBytes);
+
+    std::unique_ptr<uint8_t[]> m_buf;
+
+    size_t m_capacity;
+    size_t m_alloc{0};
+    size_t m_head{0};
+    size_t m_tail{0};
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define TIMER_WHEEL_DEFAULT_SLOTS   (512)
+#define TIMER_WHEEL_DEFAULT_TICK_MS (100)   // 512 x 100 ms = one rotation every 51.2 s
+
+/* Link hook for TimerWheel. A node sits in at most one wheel at a time */
+struct TimerNode {
+    TimerNode *timerPrev{nullptr};
+    TimerNode *timerNext{nullptr};
+    uint64_t timerExpireTick{0};
+
+    bool timerArmed() const { return timerPrev != nullptr; }
+};
+
+/*
+ * Hashed timing wheel (Varghese & Lauck, scheme 6).
+ *
+ *  node expiring at tick t -> m_slots[t % slots], a circular list with a sentinel head
+ *
+ * arm / re-arm / cancel are O(1) list splices. advance() visits only the slots
+ * of the ticks that passed, and a deadline longer than one rotation simply
+ * stays in its slot until its tick comes round. The wheel does not own its
+ * nodes and is meant for a single thread (a reactor).
+ */
+class TimerWheel {
+public:
+    explicit TimerWheel(size_t slots = TIMER_WHEEL_DEFAULT_SLOTS, uint64_t tickMs = TIMER_WHEEL_DEFAULT_TICK_MS)
+            : m_slots(std::max<size_t>(slots, 1)),
+              m_tickMs(std::max<uint64_t>(tickMs, 1)),
+              m_curTick(nowMs() / m_tickMs) {
+        for (auto &head : m_slots)
+            head.timerPrev = head.timerNext = &head;
+    }
+
+    TimerWheel(const TimerWheel &) = delete;
+
+    TimerWheel &operator=(const TimerWheel &) = delete;
+
+    static uint64_t nowMs() {
+        return (uint64_t) std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /* (re)arms node to fire delayMs after nowMs, rounded up to the next tick */
+    void arm(TimerNode &node, uint64_t nowMs, uint64_t delayMs) {
+        cancel(node);
+
+        const uint64_t expire = std::max((nowMs + delayMs + m_tickMs - 1) / m_tickMs, m_curTick + 1);
+        TimerNode &head = m_slots[expire % m_slots.size()];
+
+        node.timerExpireTick = expire;
+        node.timerPrev = head.timerPrev;
+        node.timerNext = &head;
+        head.timerPrev->timerNext = &node;
+        head.timerPrev = &node;
+        m_count++;
+    }
+
+    void cancel(TimerNode &node) {
+        if (!node.timerArmed())
+            return;
+
+        node.timerPrev->timerNext = node.timerNext;
+        node.timerNext->timerPrev = node.timerPrev;
+        node.timerPrev = node.timerNext = nullptr;
+        m_count--;
+    }
+
+    size_t size() const { return m_count; }
+
+    /* epoll_wait timeout: -1 while nothing is armed, otherwise until the next tick boundary */
+    int nextTimeoutMs(uint64_t nowMs) const {
+        if (m_count == 0)
+            return -1;
+        return (int) (m_tickMs - nowMs % m_tickMs);
+    }
+
+    /* fires onExpire(TimerNode &) for every node due by nowMs; the callback may re-arm or cancel */
+    template <typename Fn>
+    size_t advance(uint64_t nowMs, Fn &&onExpire) {
+        const uint64_t target = nowMs / m_tickMs;
+        if (target <= m_curTick)
+            return 0;
+
+        /* a gap longer than one rotation still visits every slot exactly once */
+        const uint64_t steps = std::min<uint64_t>(target - m_curTick, m_slots.size());
+
+        m_expired.clear();
+        for (uint64_t i = 1; i <= steps; ++i) {
+            TimerNode &head = m_slots[(m_curTick + i) % m_slots.size()];
+            for (TimerNode *node = head.timerNext; node != &head;) {
+                TimerNode *next = node->timerNext;
+                if (node->timerExpireTick <= target) {
+                    cancel(*node);
+                    m_expired.push_back(node);
+                }
+                node = next;
+            }
+        }
+        m_curTick = target;
+
+        for (TimerNode *node : m_expired)
+            onExpire(*node);
+        return m_expired.size();
+    }
+
+private:
+    std::vector <TimerNode> m_slots;
+    uint64_t m_tickMs;
+    uint64_t m_curTick;
+    size_t m_count{0};
+
+    std::vector<TimerNode *> m_expired;   // advance scratch
+};
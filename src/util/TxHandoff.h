@@ -0,0 +1,73 @@
+#pragma once
+
+#include "util/MpscQueue.h"
+
+#include <atomic>
+
+/*
+ * Producer -> reactor hand-off of connections with queued tx packets.
+ *
+ *  producer : push on the connection's own queue -> claim -> link -> kick ? wake the reactor
+ *  reactor  : woken -> beginDrain -> pop() each linked connection -> read its queue
+ *
+ * Conn is an MpscNode with a std::atomic<bool> txScheduled member. Only the
+ * producer whose claim() flips txScheduled links the connection, so it sits on
+ * the ready list once however many packets are behind it; kick() likewise lets
+ * one producer per drain write the reactor's eventfd.
+ *
+ * The reactor clears both flags before it reads the queues they cover, and the
+ * fences there pair with the seq_cst exchanges here: a producer either sees a
+ * flag already cleared and links or kicks again, or its packet is visible to
+ * the drain. Without them a push can land after the reactor found the queue
+ * empty while the producer still sees the flag set, and the packet waits for an
+ * unrelated wakeup.
+ */
+template <typename Conn>
+class TxHandoff {
+public:
+    /* producer: true for the one caller that has to link conn */
+    static bool claim(Conn &conn) {
+        return !conn.txScheduled.exchange(true, std::memory_order_seq_cst);
+    }
+
+    /* producer: gives a claim back when conn has no reactor to go to */
+    static void unclaim(Conn &conn) {
+        conn.txScheduled.store(false, std::memory_order_release);
+    }
+
+    /* producer: conn must be claimed */
+    void link(Conn &conn) {
+        m_ready.push(&conn);
+    }
+
+    /* producer: true for the one caller per drain that has to wake the reactor */
+    bool kick() {
+        return !m_kicked.exchange(true, std::memory_order_seq_cst);
+    }
+
+    /* reactor, once per wakeup before the first pop(): anything linked from here on kicks again */
+    void beginDrain() {
+        m_kicked.store(false, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    /* reactor: the next linked connection, unclaimed before the caller reads its queue */
+    Conn *pop() {
+        Conn *conn = m_ready.pop();
+        if (!conn)
+            return nullptr;
+
+        conn->txScheduled.store(false, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return conn;
+    }
+
+    /* reactor: false after a drain means a producer was mid-link or the drain stopped early; kick again */
+    bool empty() const {
+        return m_ready.empty();
+    }
+
+private:
+    MpscQueue <Conn> m_ready;
+    std::atomic<bool> m_kicked{false};
+};